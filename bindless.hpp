@@ -0,0 +1,255 @@
+#ifndef BINDLESS_HPP
+#define BINDLESS_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <array> // std::array
+#include <vector> // std::vector
+#include <deque> // std::deque
+#include <stdexcept> // std::runtime_error
+#include <cstdint> // uint32_t, uint64_t
+
+// One descriptor set holding every texture and the material buffer. The
+// texture array is partially bound and update-after-bind, so textures are
+// added while frames using the set are in flight and the set is bound once
+// per command buffer no matter how many textures exist. Draws select their
+// material by index and the material selects its textures by index.
+// A slot given up with RetireTexture() is handed out again by AddTexture()
+// once Collect() reports the frames that sampled it as completed.
+class BindlessTable
+{
+public:
+    static constexpr uint32_t MATERIAL_BINDING = 0;
+    static constexpr uint32_t TEXTURE_BINDING = 1;
+
+    void Create(VkDevice device, uint32_t textureCapacity,
+                const VkAllocationCallbacks *allocator);
+    void Destroy();
+
+    void SetMaterialBuffer(VkBuffer buffer, VkDeviceSize range);
+    uint32_t AddTexture(VkImageView imageView, VkSampler sampler);
+    void UpdateTexture(uint32_t index, VkImageView imageView, VkSampler sampler);
+    void RetireTexture(uint32_t index, uint64_t lastUse);
+    void Collect(uint64_t completed);
+
+    VkDescriptorSetLayout GetLayout() const;
+    VkDescriptorSet GetSet() const;
+    uint32_t GetTextureCount() const;
+    uint32_t GetTextureCapacity() const;
+
+private:
+    struct RetiredSlot
+    {
+        uint64_t m_lastUse;
+        uint32_t m_index;
+    };
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    const VkAllocationCallbacks *m_allocator{nullptr};
+    VkDescriptorSetLayout m_layout{VK_NULL_HANDLE};
+    VkDescriptorPool m_pool{VK_NULL_HANDLE};
+    VkDescriptorSet m_set{VK_NULL_HANDLE};
+    uint32_t m_textureCapacity{0};
+    uint32_t m_textureCount{0};
+    std::deque<RetiredSlot> m_retiredSlots;
+    std::vector<uint32_t> m_freeSlots;
+};
+
+inline void BindlessTable::Create(VkDevice device, uint32_t textureCapacity,
+                                const VkAllocationCallbacks *allocator)
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_textureCapacity = textureCapacity;
+    m_textureCount = 0;
+    m_retiredSlots.clear();
+    m_freeSlots.clear();
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = MATERIAL_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // the variable sized array has to be the last binding
+    bindings[1].binding = TEXTURE_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = textureCapacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    std::array<VkDescriptorBindingFlags, 2> bindingFlags =
+    {
+        VkDescriptorBindingFlags{0},
+        VkDescriptorBindingFlags{VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT}
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    flagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(m_device, &layoutInfo,
+                                                m_allocator, &m_layout))
+    {
+        throw std::runtime_error("failed to create bindless set layout");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = textureCapacity;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo,
+                                            m_allocator, &m_pool))
+    {
+        throw std::runtime_error("failed to create bindless descriptor pool");
+    }
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
+    countInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+    countInfo.descriptorSetCount = 1;
+    countInfo.pDescriptorCounts = &textureCapacity;
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = &countInfo;
+    allocInfo.descriptorPool = m_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_layout;
+
+    if (VK_SUCCESS != vkAllocateDescriptorSets(m_device, &allocInfo, &m_set))
+    {
+        throw std::runtime_error("failed to allocate bindless descriptor set");
+    }
+}
+
+inline void BindlessTable::Destroy()
+{
+    vkDestroyDescriptorPool(m_device, m_pool, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_layout, m_allocator);
+
+    m_pool = VK_NULL_HANDLE;
+    m_layout = VK_NULL_HANDLE;
+    m_set = VK_NULL_HANDLE;
+}
+
+// the material binding is not update-after-bind, it is written once before
+// the first frame
+inline void BindlessTable::SetMaterialBuffer(VkBuffer buffer, VkDeviceSize range)
+{
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = range;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_set;
+    descriptorWrite.dstBinding = MATERIAL_BINDING;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+}
+
+inline uint32_t BindlessTable::AddTexture(VkImageView imageView,
+                                            VkSampler sampler)
+{
+    if (!m_freeSlots.empty())
+    {
+        uint32_t index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        UpdateTexture(index, imageView, sampler);
+
+        return index;
+    }
+
+    if (m_textureCount == m_textureCapacity)
+    {
+        throw std::runtime_error("bindless texture table is full");
+    }
+
+    UpdateTexture(m_textureCount, imageView, sampler);
+
+    return m_textureCount++;
+}
+
+// slots that frames in flight may still sample must not be overwritten
+inline void BindlessTable::UpdateTexture(uint32_t index, VkImageView imageView,
+                                            VkSampler sampler)
+{
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = sampler;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_set;
+    descriptorWrite.dstBinding = TEXTURE_BINDING;
+    descriptorWrite.dstArrayElement = index;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+}
+
+// lastUse is the timeline value of the last frame that may sample the slot
+inline void BindlessTable::RetireTexture(uint32_t index, uint64_t lastUse)
+{
+    m_retiredSlots.push_back({lastUse, index});
+}
+
+inline void BindlessTable::Collect(uint64_t completed)
+{
+    while (!m_retiredSlots.empty() &&
+           (m_retiredSlots.front().m_lastUse <= completed))
+    {
+        m_freeSlots.push_back(m_retiredSlots.front().m_index);
+        m_retiredSlots.pop_front();
+    }
+}
+
+inline VkDescriptorSetLayout BindlessTable::GetLayout() const
+{
+    return m_layout;
+}
+
+inline VkDescriptorSet BindlessTable::GetSet() const
+{
+    return m_set;
+}
+
+inline uint32_t BindlessTable::GetTextureCount() const
+{
+    return m_textureCount;
+}
+
+inline uint32_t BindlessTable::GetTextureCapacity() const
+{
+    return m_textureCapacity;
+}
+
+#endif // BINDLESS_HPP
@@ -0,0 +1,986 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp> // linear algebra
+
+#include <vector> // std::vector
+#include <array> // std::array
+#include <atomic> // std::atomic
+#include <algorithm> // std::partition, std::min, std::max
+#include <limits> // std::numeric_limits
+#include <utility> // std::swap
+#include <cstdint> // uint32_t, uint64_t
+
+#include "profiler.hpp" // PROFILE_ZONE
+#include "scene_graph.hpp" // SceneGraph::Bounds
+#include "worker_pool.hpp" // WorkerPool
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE, AVX2
+#define BVH_X86
+#endif
+
+// A binary bounding volume hierarchy over axis aligned boxes. Build() splits
+// with the surface area heuristic evaluated on 16 bins per axis. The upper
+// levels bin their ranges on all workers, the subtrees below them are built
+// by the workers independently and appended in order. Nodes are 32 bytes and
+// both children of a node are stored next to each other, after their parent,
+// so a traversal tests a pair with one cache line and Refit() updates the
+// boxes in one backward pass. Every node covers a contiguous range of the
+// primitive order, a node inside the frustum hands out its range as a whole.
+// Cull() tests a node against all frustum planes at once in SIMD lanes.
+class Bvh
+{
+public:
+    using Bounds = SceneGraph::Bounds;
+
+    static constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+
+    enum class Isa
+    {
+        SCALAR,
+        SSE,
+        AVX2
+    };
+
+    struct Hit
+    {
+        uint32_t m_primitive;
+        float m_distance;
+    };
+
+    ~Bvh();
+
+    void Create(uint32_t workerCount);
+    void Destroy();
+
+    void Build(const std::vector<Bounds>& bounds);
+    void Refit(const std::vector<Bounds>& bounds);
+
+    // planes point inwards, (a, b, c, d) of a * x + b * y + c * z + d
+    void Cull(const glm::vec4 (&planes)[6],
+                std::vector<uint32_t>& visible) const;
+    // the nearest primitive box along the ray
+    Hit Raycast(const glm::vec3& origin, const glm::vec3& direction,
+                float maxDistance) const;
+    // intersect(primitive, maxDistance) returns the distance of a hit closer
+    // than maxDistance, or infinity
+    template <typename Intersect>
+    Hit Raycast(const glm::vec3& origin, const glm::vec3& direction,
+                float maxDistance, Intersect intersect) const;
+
+    uint32_t GetNodeCount() const;
+    uint32_t GetPrimitiveCount() const;
+    uint32_t GetWorkerCount() const;
+
+    void SetIsa(Isa isa);
+    Isa GetIsa() const;
+    static Isa DetectIsa();
+    static const char *GetIsaName(Isa isa);
+
+private:
+    static constexpr uint32_t BINS = 16;
+    static constexpr uint32_t MAX_LEAF = 4;
+    static constexpr uint32_t MAX_DEPTH = 64;
+    // ranges at least this large bin on all workers
+    static constexpr uint32_t PARALLEL_MIN = 1 << 16;
+    static constexpr uint32_t MIN_JOB = 1024;
+
+    struct Node
+    {
+        glm::vec3 m_min;
+        uint32_t m_offset; // first child of an inner node, first primitive
+        glm::vec3 m_max;
+        uint32_t m_count; // primitives of a leaf, 0 for inner nodes
+    };
+
+    struct Bin
+    {
+        Bounds m_bounds;
+        Bounds m_centroids;
+        uint32_t m_count;
+    };
+
+    using Bins = std::array<Bin, 3 * BINS>;
+
+    // partitioned along with the primitive order, so binning reads in order
+    struct Reference
+    {
+        Bounds m_bounds;
+        glm::vec3 m_centroid;
+        uint32_t m_primitive;
+    };
+
+    struct Split
+    {
+        bool m_valid;
+        uint32_t m_axis;
+        uint32_t m_bin;
+        float m_cost;
+        uint32_t m_leftCount;
+        Bounds m_left;
+        Bounds m_leftCentroids;
+        Bounds m_right;
+        Bounds m_rightCentroids;
+    };
+
+    struct Task
+    {
+        uint32_t m_node;
+        uint32_t m_begin;
+        uint32_t m_end;
+        uint32_t m_depth;
+        Bounds m_bounds;
+        Bounds m_centroids;
+    };
+
+    // frustum planes as structure of arrays, the padding lanes always pass
+    struct alignas(32) Planes
+    {
+        float m_x[8];
+        float m_y[8];
+        float m_z[8];
+        float m_w[8];
+        float m_absX[8];
+        float m_absY[8];
+        float m_absZ[8];
+    };
+
+    enum class Containment
+    {
+        OUTSIDE,
+        PARTIAL,
+        INSIDE
+    };
+
+    void BinRange(uint32_t begin, uint32_t end, const Bounds& centroids,
+                    Bins& bins) const;
+    Split FindSplit(const Task& task, Bins& bins, bool parallel);
+    void SplitTask(const Task& task, const Split& split, uint32_t firstChild,
+                    Task& left, Task& right);
+    bool MakeLeaf(const Task& task, Node& node) const;
+    void BuildSubtree(const Task& root, std::vector<Node>& nodes);
+    void GetPrimitiveRange(uint32_t node, uint32_t& first,
+                            uint32_t& last) const;
+
+    template <Containment (*TEST)(const Planes&, const Node&)>
+    void CullNodes(const Planes& planes, std::vector<uint32_t>& visible) const;
+    template <typename LeafHit>
+    Hit Traverse(const glm::vec3& origin, const glm::vec3& direction,
+                    float maxDistance, LeafHit leafHit) const;
+
+    static Planes MakePlanes(const glm::vec4 (&planes)[6]);
+    static Containment TestScalar(const Planes& planes, const Node& node);
+#ifdef BVH_X86
+    static Containment TestSse(const Planes& planes, const Node& node);
+    static Containment TestAvx2(const Planes& planes, const Node& node);
+#endif
+    static float IntersectBox(const glm::vec3& origin,
+                                const glm::vec3& inverseDirection,
+                                const glm::vec3& minPos,
+                                const glm::vec3& maxPos, float maxDistance);
+    static float GetBinScale(const Bounds& centroids, uint32_t axis);
+    static uint32_t GetBin(float centroid, float minPos, float scale);
+    static void Grow(Bounds& bounds, const Bounds& other);
+    static void Grow(Bounds& bounds, const glm::vec3& point);
+    static float GetHalfArea(const Bounds& bounds);
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_primitives; // leaf order to primitive index
+    std::vector<Bounds> m_primitiveBounds; // in leaf order
+    Isa m_isa{DetectIsa()};
+
+    // build scratch
+    std::vector<Reference> m_references;
+    std::vector<Bins> m_workerBins;
+    std::vector<Task> m_jobs;
+    std::vector<std::vector<Node>> m_jobNodes;
+
+    WorkerPool m_pool;
+};
+
+inline Bvh::~Bvh()
+{
+    Destroy();
+}
+
+// zero workers builds on the calling thread inside Build()
+inline void Bvh::Create(uint32_t workerCount)
+{
+    m_pool.Create(workerCount, "bvh worker");
+}
+
+inline void Bvh::Destroy()
+{
+    m_pool.Destroy();
+}
+
+// The upper levels are split here until the ranges are small enough to give
+// every worker a few subtrees. Those are built into their own node arrays and
+// appended in job order, the child offsets are moved by where they landed.
+inline void Bvh::Build(const std::vector<Bounds>& bounds)
+{
+    PROFILE_ZONE("bvh build");
+    uint32_t count = static_cast<uint32_t>(bounds.size());
+    uint32_t threadCount = m_pool.GetWorkerCount() + 1;
+
+    m_nodes.clear();
+    m_jobs.clear();
+    m_primitives.resize(count);
+    m_references.resize(count);
+    m_primitiveBounds.resize(count);
+    m_workerBins.resize(threadCount);
+    if (0 == count)
+    {
+        return;
+    }
+
+    Task root{0, 0, count, 0, {}, {}};
+    std::vector<Task> rootBounds(threadCount, root);
+    m_pool.Dispatch([this, &bounds, count, threadCount,
+                    &rootBounds](uint32_t worker)
+    {
+        uint32_t chunk = (count + threadCount - 1) / threadCount;
+        uint32_t last = std::min(count, (worker + 1) * chunk);
+        for (uint32_t i = worker * chunk; i < last; ++i)
+        {
+            const Bounds& box = bounds[i];
+            m_references[i] = {box, (box.m_min + box.m_max) * 0.5f, i};
+            Grow(rootBounds[worker].m_bounds, box);
+            Grow(rootBounds[worker].m_centroids, m_references[i].m_centroid);
+        }
+    });
+    for (const Task& task : rootBounds)
+    {
+        Grow(root.m_bounds, task.m_bounds);
+        Grow(root.m_centroids, task.m_centroids);
+    }
+    m_nodes.push_back({root.m_bounds.m_min, 0, root.m_bounds.m_max, 0});
+
+    uint32_t jobSize = std::max(MIN_JOB, count / (4 * threadCount));
+    std::vector<Task> pending{root};
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        Task task = pending[i];
+        if (task.m_end - task.m_begin <= jobSize)
+        {
+            m_jobs.push_back(task);
+            continue;
+        }
+
+        if (MakeLeaf(task, m_nodes[task.m_node]))
+        {
+            continue;
+        }
+
+        Bins bins;
+        Split split = FindSplit(task, bins,
+                                task.m_end - task.m_begin >= PARALLEL_MIN);
+        if (!split.m_valid)
+        {
+            split.m_leftCount = (task.m_end - task.m_begin) / 2;
+        }
+
+        uint32_t firstChild = static_cast<uint32_t>(m_nodes.size());
+        m_nodes[task.m_node].m_offset = firstChild;
+        m_nodes.resize(m_nodes.size() + 2);
+        Task left{};
+        Task right{};
+        SplitTask(task, split, firstChild, left, right);
+        pending.push_back(left);
+        pending.push_back(right);
+    }
+
+    m_jobNodes.resize(m_jobs.size());
+    std::atomic<uint32_t> nextJob{0};
+    m_pool.Dispatch([this, &nextJob](uint32_t)
+    {
+        PROFILE_ZONE("bvh subtrees");
+        uint32_t jobCount = static_cast<uint32_t>(m_jobs.size());
+        for (uint32_t job = nextJob.fetch_add(1); job < jobCount;
+            job = nextJob.fetch_add(1))
+        {
+            BuildSubtree(m_jobs[job], m_jobNodes[job]);
+        }
+    });
+
+    for (std::size_t job = 0; job < m_jobs.size(); ++job)
+    {
+        // the subtree root takes the slot its parent reserved, the rest is
+        // appended so local index 1 lands on base
+        std::vector<Node>& nodes = m_jobNodes[job];
+        uint32_t base = static_cast<uint32_t>(m_nodes.size());
+        for (Node& node : nodes)
+        {
+            if (0 == node.m_count)
+            {
+                node.m_offset += base - 1;
+            }
+        }
+        m_nodes[m_jobs[job].m_node] = nodes[0];
+        m_nodes.insert(m_nodes.end(), nodes.begin() + 1, nodes.end());
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_primitives[i] = m_references[i].m_primitive;
+        m_primitiveBounds[i] = m_references[i].m_bounds;
+    }
+}
+
+// children follow their parent, so one backward pass sees them first
+inline void Bvh::Refit(const std::vector<Bounds>& bounds)
+{
+    PROFILE_ZONE("bvh refit");
+    for (std::size_t i = 0; i < m_primitives.size(); ++i)
+    {
+        m_primitiveBounds[i] = bounds[m_primitives[i]];
+    }
+
+    for (std::size_t i = m_nodes.size(); i-- > 0;)
+    {
+        Node& node = m_nodes[i];
+        Bounds box;
+        if (0 == node.m_count)
+        {
+            const Node& left = m_nodes[node.m_offset];
+            const Node& right = m_nodes[node.m_offset + 1];
+            box.m_min = glm::min(left.m_min, right.m_min);
+            box.m_max = glm::max(left.m_max, right.m_max);
+        }
+        else
+        {
+            for (uint32_t j = 0; j < node.m_count; ++j)
+            {
+                Grow(box, m_primitiveBounds[node.m_offset + j]);
+            }
+        }
+        node.m_min = box.m_min;
+        node.m_max = box.m_max;
+    }
+}
+
+inline void Bvh::Cull(const glm::vec4 (&planes)[6],
+                        std::vector<uint32_t>& visible) const
+{
+    PROFILE_ZONE("bvh cull");
+    visible.clear();
+    if (m_nodes.empty())
+    {
+        return;
+    }
+
+    Planes soa = MakePlanes(planes);
+    switch (m_isa)
+    {
+#ifdef BVH_X86
+    case Isa::AVX2:
+        CullNodes<&Bvh::TestAvx2>(soa, visible);
+        break;
+    case Isa::SSE:
+        CullNodes<&Bvh::TestSse>(soa, visible);
+        break;
+#endif
+    default:
+        CullNodes<&Bvh::TestScalar>(soa, visible);
+        break;
+    }
+}
+
+inline Bvh::Hit Bvh::Raycast(const glm::vec3& origin,
+                            const glm::vec3& direction, float maxDistance) const
+{
+    glm::vec3 inverseDirection = 1.0f / direction;
+    return Traverse(origin, direction, maxDistance,
+                    [this, &origin, &inverseDirection](uint32_t slot,
+                                                        float distance)
+                    {
+                        const Bounds& box = m_primitiveBounds[slot];
+                        return IntersectBox(origin, inverseDirection,
+                                        box.m_min, box.m_max, distance);
+                    });
+}
+
+template <typename Intersect>
+inline Bvh::Hit Bvh::Raycast(const glm::vec3& origin,
+                            const glm::vec3& direction, float maxDistance,
+                            Intersect intersect) const
+{
+    return Traverse(origin, direction, maxDistance,
+                    [this, &intersect](uint32_t slot, float distance)
+                    {
+                        return intersect(m_primitives[slot], distance);
+                    });
+}
+
+inline uint32_t Bvh::GetNodeCount() const
+{
+    return static_cast<uint32_t>(m_nodes.size());
+}
+
+inline uint32_t Bvh::GetPrimitiveCount() const
+{
+    return static_cast<uint32_t>(m_primitives.size());
+}
+
+inline uint32_t Bvh::GetWorkerCount() const
+{
+    return m_pool.GetWorkerCount();
+}
+
+inline void Bvh::SetIsa(Isa isa)
+{
+    m_isa = isa;
+}
+
+inline Bvh::Isa Bvh::GetIsa() const
+{
+    return m_isa;
+}
+
+inline Bvh::Isa Bvh::DetectIsa()
+{
+#ifdef BVH_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return Isa::AVX2;
+    }
+    return Isa::SSE;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+inline const char *Bvh::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::SSE:
+        return "SSE";
+    case Isa::AVX2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+// axes without extent keep every centroid in bin 0 and never split
+inline void Bvh::BinRange(uint32_t begin, uint32_t end, const Bounds& centroids,
+                            Bins& bins) const
+{
+    bins.fill(Bin{{}, {}, 0});
+    glm::vec3 scale(GetBinScale(centroids, 0), GetBinScale(centroids, 1),
+                    GetBinScale(centroids, 2));
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const Reference& reference = m_references[i];
+        const glm::vec3& centroid = reference.m_centroid;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            uint32_t bin = GetBin(centroid[axis], centroids.m_min[axis],
+                                    scale[axis]);
+            Bin& target = bins[axis * BINS + bin];
+            Grow(target.m_bounds, reference.m_bounds);
+            Grow(target.m_centroids, centroid);
+            ++target.m_count;
+        }
+    }
+}
+
+// sweeps the bins of every axis from both ends, a split between bin k - 1 and
+// bin k costs the area weighted primitive counts of both sides
+inline Bvh::Split Bvh::FindSplit(const Task& task, Bins& bins, bool parallel)
+{
+    if (parallel && 0 != m_pool.GetWorkerCount())
+    {
+        uint32_t threadCount = m_pool.GetWorkerCount() + 1;
+        m_pool.Dispatch([this, &task, threadCount](uint32_t worker)
+        {
+            uint32_t count = task.m_end - task.m_begin;
+            uint32_t chunk = (count + threadCount - 1) / threadCount;
+            uint32_t first = task.m_begin + std::min(count, worker * chunk);
+            uint32_t last = task.m_begin + std::min(count, (worker + 1) * chunk);
+            BinRange(first, last, task.m_centroids, m_workerBins[worker]);
+        });
+
+        bins = m_workerBins[0];
+        for (uint32_t worker = 1; worker < threadCount; ++worker)
+        {
+            for (uint32_t i = 0; i < 3 * BINS; ++i)
+            {
+                Bin& bin = bins[i];
+                const Bin& other = m_workerBins[worker][i];
+                Grow(bin.m_bounds, other.m_bounds);
+                Grow(bin.m_centroids, other.m_centroids);
+                bin.m_count += other.m_count;
+            }
+        }
+    }
+    else
+    {
+        BinRange(task.m_begin, task.m_end, task.m_centroids, bins);
+    }
+
+    Split best{};
+    best.m_cost = std::numeric_limits<float>::max();
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        const Bin *axisBins = &bins[axis * BINS];
+        std::array<Bounds, BINS> rightBounds{};
+        std::array<Bounds, BINS> rightCentroids{};
+        std::array<uint32_t, BINS> rightCount{};
+        Bounds box;
+        Bounds centroids;
+        uint32_t count = 0;
+        for (uint32_t bin = BINS; bin-- > 1;)
+        {
+            Grow(box, axisBins[bin].m_bounds);
+            Grow(centroids, axisBins[bin].m_centroids);
+            count += axisBins[bin].m_count;
+            rightBounds[bin] = box;
+            rightCentroids[bin] = centroids;
+            rightCount[bin] = count;
+        }
+
+        box = {};
+        centroids = {};
+        count = 0;
+        for (uint32_t bin = 1; bin < BINS; ++bin)
+        {
+            Grow(box, axisBins[bin - 1].m_bounds);
+            Grow(centroids, axisBins[bin - 1].m_centroids);
+            count += axisBins[bin - 1].m_count;
+            if ((0 == count) || (0 == rightCount[bin]))
+            {
+                continue;
+            }
+
+            float cost = GetHalfArea(box) * count +
+                        GetHalfArea(rightBounds[bin]) * rightCount[bin];
+            if (cost < best.m_cost)
+            {
+                best = {true, axis, bin, cost, count, box, centroids,
+                        rightBounds[bin], rightCentroids[bin]};
+            }
+        }
+    }
+
+    return best;
+}
+
+// partitions the range by the split bin and reserves both child nodes
+inline void Bvh::SplitTask(const Task& task, const Split& split,
+                            uint32_t firstChild, Task& left, Task& right)
+{
+    uint32_t middle = task.m_begin + split.m_leftCount;
+    if (split.m_valid)
+    {
+        uint32_t axis = split.m_axis;
+        float minPos = task.m_centroids.m_min[axis];
+        float scale = GetBinScale(task.m_centroids, axis);
+        std::partition(m_references.begin() + task.m_begin,
+                        m_references.begin() + task.m_end,
+                        [axis, minPos, scale, &split](const Reference& reference)
+                        {
+                            return (GetBin(reference.m_centroid[axis],
+                                            minPos, scale) < split.m_bin);
+                        });
+        left = {firstChild, task.m_begin, middle, task.m_depth + 1,
+                split.m_left, split.m_leftCentroids};
+        right = {firstChild + 1, middle, task.m_end, task.m_depth + 1,
+                split.m_right, split.m_rightCentroids};
+        return;
+    }
+
+    // every centroid in one point, the halves are as good as any split
+    left = {firstChild, task.m_begin, middle, task.m_depth + 1, {}, {}};
+    right = {firstChild + 1, middle, task.m_end, task.m_depth + 1, {}, {}};
+    for (Task *child : {&left, &right})
+    {
+        for (uint32_t i = child->m_begin; i < child->m_end; ++i)
+        {
+            Grow(child->m_bounds, m_references[i].m_bounds);
+            Grow(child->m_centroids, m_references[i].m_centroid);
+        }
+    }
+}
+
+// Writes the node's bounds and returns true when it stays a leaf: ranges of
+// up to MAX_LEAF primitives, whose boxes are cheaper to test one by one than
+// to bin, and ranges at the depth limit of the traversal stacks. Otherwise
+// the node becomes inner and the caller adds its children.
+inline bool Bvh::MakeLeaf(const Task& task, Node& node) const
+{
+    uint32_t count = task.m_end - task.m_begin;
+    node.m_min = task.m_bounds.m_min;
+    node.m_max = task.m_bounds.m_max;
+
+    bool leaf = (count <= MAX_LEAF) || (MAX_DEPTH - 1 <= task.m_depth);
+
+    node.m_offset = task.m_begin;
+    node.m_count = leaf ? count : 0;
+    return leaf;
+}
+
+// the subtree root is local node 0 and its descendants follow it
+inline void Bvh::BuildSubtree(const Task& root, std::vector<Node>& nodes)
+{
+    nodes.clear();
+    nodes.push_back({});
+
+    Bins bins;
+    std::vector<Task> stack{root};
+    stack.back().m_node = 0;
+    while (!stack.empty())
+    {
+        Task task = stack.back();
+        stack.pop_back();
+
+        if (MakeLeaf(task, nodes[task.m_node]))
+        {
+            continue;
+        }
+
+        Split split = FindSplit(task, bins, false);
+        if (!split.m_valid)
+        {
+            split.m_leftCount = (task.m_end - task.m_begin) / 2;
+        }
+
+        uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+        nodes[task.m_node].m_offset = firstChild;
+        nodes.resize(nodes.size() + 2);
+        Task left{};
+        Task right{};
+        SplitTask(task, split, firstChild, left, right);
+        stack.push_back(right);
+        stack.push_back(left);
+    }
+}
+
+inline void Bvh::GetPrimitiveRange(uint32_t node, uint32_t& first,
+                                    uint32_t& last) const
+{
+    uint32_t leftmost = node;
+    while (0 == m_nodes[leftmost].m_count)
+    {
+        leftmost = m_nodes[leftmost].m_offset;
+    }
+    uint32_t rightmost = node;
+    while (0 == m_nodes[rightmost].m_count)
+    {
+        rightmost = m_nodes[rightmost].m_offset + 1;
+    }
+
+    first = m_nodes[leftmost].m_offset;
+    last = m_nodes[rightmost].m_offset + m_nodes[rightmost].m_count;
+}
+
+template <Bvh::Containment (*TEST)(const Bvh::Planes&, const Bvh::Node&)>
+inline void Bvh::CullNodes(const Planes& planes,
+                            std::vector<uint32_t>& visible) const
+{
+    uint32_t stack[MAX_DEPTH + 1];
+    uint32_t size = 0;
+    stack[size++] = 0;
+
+    while (0 < size)
+    {
+        const Node& node = m_nodes[stack[--size]];
+        Containment containment = TEST(planes, node);
+        if (Containment::OUTSIDE == containment)
+        {
+            continue;
+        }
+
+        // a partially visible leaf tests its primitives one by one
+        if ((Containment::PARTIAL == containment) && (1 < node.m_count))
+        {
+            for (uint32_t i = node.m_offset; i < node.m_offset + node.m_count;
+                ++i)
+            {
+                const Bounds& box = m_primitiveBounds[i];
+                if (Containment::OUTSIDE != TEST(planes,
+                                            {box.m_min, 0, box.m_max, 1}))
+                {
+                    visible.push_back(m_primitives[i]);
+                }
+            }
+            continue;
+        }
+
+        if ((Containment::INSIDE == containment) || (0 != node.m_count))
+        {
+            uint32_t first = 0;
+            uint32_t last = 0;
+            GetPrimitiveRange(static_cast<uint32_t>(&node - m_nodes.data()),
+                                first, last);
+            visible.insert(visible.end(), m_primitives.begin() + first,
+                            m_primitives.begin() + last);
+            continue;
+        }
+
+        stack[size++] = node.m_offset + 1;
+        stack[size++] = node.m_offset;
+    }
+}
+
+// visits the nearer child first, every node on the stack keeps the distance
+// the ray enters it, so nodes behind a hit found since they were pushed are
+// skipped when popped
+template <typename LeafHit>
+inline Bvh::Hit Bvh::Traverse(const glm::vec3& origin,
+                            const glm::vec3& direction, float maxDistance,
+                            LeafHit leafHit) const
+{
+    Hit hit{NO_HIT, maxDistance};
+    if (m_nodes.empty())
+    {
+        return hit;
+    }
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float rootDistance = IntersectBox(origin, inverseDirection,
+                                    m_nodes[0].m_min, m_nodes[0].m_max,
+                                    hit.m_distance);
+    if (std::numeric_limits<float>::infinity() == rootDistance)
+    {
+        return hit;
+    }
+
+    uint32_t stack[MAX_DEPTH + 1];
+    float distances[MAX_DEPTH + 1];
+    uint32_t size = 0;
+    stack[size] = 0;
+    distances[size++] = rootDistance;
+    while (0 < size)
+    {
+        --size;
+        if (distances[size] >= hit.m_distance)
+        {
+            continue;
+        }
+
+        const Node& node = m_nodes[stack[size]];
+        if (0 != node.m_count)
+        {
+            for (uint32_t i = 0; i < node.m_count; ++i)
+            {
+                float distance = leafHit(node.m_offset + i, hit.m_distance);
+                if (distance < hit.m_distance)
+                {
+                    hit = {m_primitives[node.m_offset + i], distance};
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.m_offset;
+        uint32_t farChild = node.m_offset + 1;
+        float nearDistance = IntersectBox(origin, inverseDirection,
+                                        m_nodes[nearChild].m_min,
+                                        m_nodes[nearChild].m_max,
+                                        hit.m_distance);
+        float farDistance = IntersectBox(origin, inverseDirection,
+                                        m_nodes[farChild].m_min,
+                                        m_nodes[farChild].m_max,
+                                        hit.m_distance);
+        if (farDistance < nearDistance)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+
+        // the far child is pushed first so the near one is popped next
+        if (std::numeric_limits<float>::infinity() != farDistance)
+        {
+            stack[size] = farChild;
+            distances[size++] = farDistance;
+        }
+        if (std::numeric_limits<float>::infinity() != nearDistance)
+        {
+            stack[size] = nearChild;
+            distances[size++] = nearDistance;
+        }
+    }
+
+    return hit;
+}
+
+inline Bvh::Planes Bvh::MakePlanes(const glm::vec4 (&planes)[6])
+{
+    Planes soa{};
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        glm::vec4 plane = (i < 6) ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f,
+                                                            1.0f);
+        soa.m_x[i] = plane.x;
+        soa.m_y[i] = plane.y;
+        soa.m_z[i] = plane.z;
+        soa.m_w[i] = plane.w;
+        soa.m_absX[i] = std::abs(plane.x);
+        soa.m_absY[i] = std::abs(plane.y);
+        soa.m_absZ[i] = std::abs(plane.z);
+    }
+
+    return soa;
+}
+
+// the box center's distance against the box extent projected on the normal
+inline Bvh::Containment Bvh::TestScalar(const Planes& planes, const Node& node)
+{
+    glm::vec3 center = (node.m_min + node.m_max) * 0.5f;
+    glm::vec3 extent = (node.m_max - node.m_min) * 0.5f;
+
+    bool inside = true;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        float distance = planes.m_x[i] * center.x + planes.m_y[i] * center.y +
+                        planes.m_z[i] * center.z + planes.m_w[i];
+        float radius = planes.m_absX[i] * extent.x +
+                        planes.m_absY[i] * extent.y +
+                        planes.m_absZ[i] * extent.z;
+        if (distance < -radius)
+        {
+            return Containment::OUTSIDE;
+        }
+        inside = inside && (distance >= radius);
+    }
+
+    return inside ? Containment::INSIDE : Containment::PARTIAL;
+}
+
+#ifdef BVH_X86
+// four planes per instruction, the last two lanes are padding
+inline Bvh::Containment Bvh::TestSse(const Planes& planes, const Node& node)
+{
+    glm::vec3 center = (node.m_min + node.m_max) * 0.5f;
+    glm::vec3 extent = (node.m_max - node.m_min) * 0.5f;
+    __m128 cx = _mm_set1_ps(center.x);
+    __m128 cy = _mm_set1_ps(center.y);
+    __m128 cz = _mm_set1_ps(center.z);
+    __m128 ex = _mm_set1_ps(extent.x);
+    __m128 ey = _mm_set1_ps(extent.y);
+    __m128 ez = _mm_set1_ps(extent.z);
+
+    __m128 outside = _mm_setzero_ps();
+    __m128 partial = _mm_setzero_ps();
+    for (uint32_t i = 0; i < 8; i += 4)
+    {
+        __m128 distance = _mm_add_ps(_mm_add_ps(
+                            _mm_mul_ps(_mm_load_ps(planes.m_x + i), cx),
+                            _mm_mul_ps(_mm_load_ps(planes.m_y + i), cy)),
+                            _mm_add_ps(
+                            _mm_mul_ps(_mm_load_ps(planes.m_z + i), cz),
+                            _mm_load_ps(planes.m_w + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(
+                            _mm_mul_ps(_mm_load_ps(planes.m_absX + i), ex),
+                            _mm_mul_ps(_mm_load_ps(planes.m_absY + i), ey)),
+                            _mm_mul_ps(_mm_load_ps(planes.m_absZ + i), ez));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance,
+                                            radius), _mm_setzero_ps()));
+        partial = _mm_or_ps(partial, _mm_cmplt_ps(distance, radius));
+    }
+
+    if (0 != _mm_movemask_ps(outside))
+    {
+        return Containment::OUTSIDE;
+    }
+    return (0 != _mm_movemask_ps(partial)) ? Containment::PARTIAL :
+                                            Containment::INSIDE;
+}
+
+// all planes in one register
+__attribute__((target("avx2,fma")))
+inline Bvh::Containment Bvh::TestAvx2(const Planes& planes, const Node& node)
+{
+    __m128 minPos = _mm_loadu_ps(&node.m_min.x);
+    __m128 maxPos = _mm_loadu_ps(&node.m_max.x);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m256 center = _mm256_castps128_ps256(_mm_mul_ps(_mm_add_ps(minPos,
+                                                        maxPos), half));
+    __m256 extent = _mm256_castps128_ps256(_mm_mul_ps(_mm_sub_ps(maxPos,
+                                                        minPos), half));
+    __m256 cx = _mm256_permutevar8x32_ps(center, _mm256_set1_epi32(0));
+    __m256 cy = _mm256_permutevar8x32_ps(center, _mm256_set1_epi32(1));
+    __m256 cz = _mm256_permutevar8x32_ps(center, _mm256_set1_epi32(2));
+    __m256 ex = _mm256_permutevar8x32_ps(extent, _mm256_set1_epi32(0));
+    __m256 ey = _mm256_permutevar8x32_ps(extent, _mm256_set1_epi32(1));
+    __m256 ez = _mm256_permutevar8x32_ps(extent, _mm256_set1_epi32(2));
+
+    __m256 distance = _mm256_fmadd_ps(_mm256_load_ps(planes.m_x), cx,
+                        _mm256_fmadd_ps(_mm256_load_ps(planes.m_y), cy,
+                        _mm256_fmadd_ps(_mm256_load_ps(planes.m_z), cz,
+                        _mm256_load_ps(planes.m_w))));
+    __m256 radius = _mm256_fmadd_ps(_mm256_load_ps(planes.m_absX), ex,
+                        _mm256_fmadd_ps(_mm256_load_ps(planes.m_absY), ey,
+                        _mm256_mul_ps(_mm256_load_ps(planes.m_absZ), ez)));
+
+    __m256 outside = _mm256_cmp_ps(_mm256_add_ps(distance, radius),
+                                    _mm256_setzero_ps(), _CMP_LT_OQ);
+    if (0 != _mm256_movemask_ps(outside))
+    {
+        return Containment::OUTSIDE;
+    }
+    __m256 partial = _mm256_cmp_ps(distance, radius, _CMP_LT_OQ);
+    return (0 != _mm256_movemask_ps(partial)) ? Containment::PARTIAL :
+                                                Containment::INSIDE;
+}
+#endif
+
+// slab test, returns the entry distance or infinity when the ray misses the
+// box or enters it after maxDistance
+inline float Bvh::IntersectBox(const glm::vec3& origin,
+                                const glm::vec3& inverseDirection,
+                                const glm::vec3& minPos,
+                                const glm::vec3& maxPos, float maxDistance)
+{
+    glm::vec3 near = (minPos - origin) * inverseDirection;
+    glm::vec3 far = (maxPos - origin) * inverseDirection;
+    glm::vec3 entry = glm::min(near, far);
+    glm::vec3 exit = glm::max(near, far);
+
+    float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.0f));
+    float leave = std::min(std::min(exit.x, exit.y), exit.z);
+    if ((enter > leave) || (enter >= maxDistance))
+    {
+        return std::numeric_limits<float>::infinity();
+    }
+
+    return enter;
+}
+
+// binning and partitioning share these, so both put a centroid in the same bin
+inline float Bvh::GetBinScale(const Bounds& centroids, uint32_t axis)
+{
+    float extent = centroids.m_max[axis] - centroids.m_min[axis];
+    return (0.0f < extent) ? static_cast<float>(BINS) / extent : 0.0f;
+}
+
+inline uint32_t Bvh::GetBin(float centroid, float minPos, float scale)
+{
+    return std::min(BINS - 1,
+                    static_cast<uint32_t>((centroid - minPos) * scale));
+}
+
+inline void Bvh::Grow(Bounds& bounds, const Bounds& other)
+{
+    bounds.m_min = glm::min(bounds.m_min, other.m_min);
+    bounds.m_max = glm::max(bounds.m_max, other.m_max);
+}
+
+inline void Bvh::Grow(Bounds& bounds, const glm::vec3& point)
+{
+    bounds.m_min = glm::min(bounds.m_min, point);
+    bounds.m_max = glm::max(bounds.m_max, point);
+}
+
+// empty bounds have no area
+inline float Bvh::GetHalfArea(const Bounds& bounds)
+{
+    glm::vec3 extent = glm::max(bounds.m_max - bounds.m_min, glm::vec3(0.0f));
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+#endif // BVH_HPP
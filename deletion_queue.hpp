@@ -0,0 +1,301 @@
+#ifndef DELETION_QUEUE_HPP
+#define DELETION_QUEUE_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <deque> // std::deque
+#include <functional> // std::function
+#include <utility> // std::move
+#include <cstdint> // uint64_t
+#include <cstddef> // std::size_t
+
+// Defers destruction of Vulkan objects until the GPU work that last used them
+// has completed. Every object is tagged with a monotonically increasing value
+// (frame number or timeline semaphore value) and destroyed by Collect() once
+// the caller reports that value as completed.
+class DeletionQueue
+{
+public:
+    using FreeMemoryFunction = std::function<void(VkDeviceMemory memory)>;
+
+    void SetDevice(VkDevice device);
+    void SetAllocator(const VkAllocationCallbacks *allocator);
+    void SetFreeMemory(FreeMemoryFunction freeMemory);
+
+    void Retire(VkBuffer buffer, uint64_t lastUse);
+    void Retire(VkImage image, uint64_t lastUse);
+    void Retire(VkImageView imageView, uint64_t lastUse);
+    void Retire(VkFramebuffer framebuffer, uint64_t lastUse);
+    void Retire(VkRenderPass renderPass, uint64_t lastUse);
+    void Retire(VkPipeline pipeline, uint64_t lastUse);
+    void Retire(VkPipelineLayout pipelineLayout, uint64_t lastUse);
+    void Retire(VkSampler sampler, uint64_t lastUse);
+    void Retire(VkDeviceMemory memory, uint64_t lastUse);
+    void Retire(VkSwapchainKHR swapChain, uint64_t lastUse);
+
+    void Collect(uint64_t completed);
+    void Flush();
+    std::size_t Size() const;
+
+private:
+    enum class Kind
+    {
+        BUFFER,
+        IMAGE,
+        IMAGE_VIEW,
+        FRAMEBUFFER,
+        RENDER_PASS,
+        PIPELINE,
+        PIPELINE_LAYOUT,
+        SAMPLER,
+        MEMORY,
+        SWAPCHAIN
+    };
+
+    union Handle
+    {
+        VkBuffer m_buffer;
+        VkImage m_image;
+        VkImageView m_imageView;
+        VkFramebuffer m_framebuffer;
+        VkRenderPass m_renderPass;
+        VkPipeline m_pipeline;
+        VkPipelineLayout m_pipelineLayout;
+        VkSampler m_sampler;
+        VkDeviceMemory m_memory;
+        VkSwapchainKHR m_swapChain;
+    };
+
+    struct Entry
+    {
+        uint64_t m_lastUse;
+        Kind m_kind;
+        Handle m_handle;
+    };
+
+    void Push(Kind kind, Handle handle, uint64_t lastUse);
+    void Destroy(const Entry& entry);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    const VkAllocationCallbacks *m_allocator{nullptr};
+    FreeMemoryFunction m_freeMemory;
+    std::deque<Entry> m_entries;
+};
+
+inline void DeletionQueue::SetDevice(VkDevice device)
+{
+    m_device = device;
+}
+
+// must match the callbacks the retired objects were created with
+inline void DeletionQueue::SetAllocator(const VkAllocationCallbacks *allocator)
+{
+    m_allocator = allocator;
+}
+
+// lets the owner of the allocations account for retired memory
+inline void DeletionQueue::SetFreeMemory(FreeMemoryFunction freeMemory)
+{
+    m_freeMemory = std::move(freeMemory);
+}
+
+inline void DeletionQueue::Retire(VkBuffer buffer, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == buffer)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_buffer = buffer;
+    Push(Kind::BUFFER, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkImage image, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == image)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_image = image;
+    Push(Kind::IMAGE, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkImageView imageView, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == imageView)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_imageView = imageView;
+    Push(Kind::IMAGE_VIEW, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkFramebuffer framebuffer, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == framebuffer)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_framebuffer = framebuffer;
+    Push(Kind::FRAMEBUFFER, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkRenderPass renderPass, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == renderPass)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_renderPass = renderPass;
+    Push(Kind::RENDER_PASS, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkPipeline pipeline, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == pipeline)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_pipeline = pipeline;
+    Push(Kind::PIPELINE, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkPipelineLayout pipelineLayout,
+                                    uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == pipelineLayout)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_pipelineLayout = pipelineLayout;
+    Push(Kind::PIPELINE_LAYOUT, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkSampler sampler, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == sampler)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_sampler = sampler;
+    Push(Kind::SAMPLER, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkDeviceMemory memory, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == memory)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_memory = memory;
+    Push(Kind::MEMORY, handle, lastUse);
+}
+
+inline void DeletionQueue::Retire(VkSwapchainKHR swapChain, uint64_t lastUse)
+{
+    if (VK_NULL_HANDLE == swapChain)
+    {
+        return;
+    }
+
+    Handle handle{};
+    handle.m_swapChain = swapChain;
+    Push(Kind::SWAPCHAIN, handle, lastUse);
+}
+
+// entries are expected in non-decreasing lastUse order, an out of order entry
+// only delays the ones queued after it
+inline void DeletionQueue::Collect(uint64_t completed)
+{
+    while (!m_entries.empty() && (m_entries.front().m_lastUse <= completed))
+    {
+        Destroy(m_entries.front());
+        m_entries.pop_front();
+    }
+}
+
+// caller must guarantee the device is idle
+inline void DeletionQueue::Flush()
+{
+    for (const auto& entry : m_entries)
+    {
+        Destroy(entry);
+    }
+
+    m_entries.clear();
+}
+
+inline std::size_t DeletionQueue::Size() const
+{
+    return m_entries.size();
+}
+
+inline void DeletionQueue::Push(Kind kind, Handle handle, uint64_t lastUse)
+{
+    m_entries.push_back(Entry{lastUse, kind, handle});
+}
+
+inline void DeletionQueue::Destroy(const Entry& entry)
+{
+    const Handle& handle = entry.m_handle;
+
+    switch (entry.m_kind)
+    {
+    case Kind::BUFFER:
+        vkDestroyBuffer(m_device, handle.m_buffer, m_allocator);
+        break;
+    case Kind::IMAGE:
+        vkDestroyImage(m_device, handle.m_image, m_allocator);
+        break;
+    case Kind::IMAGE_VIEW:
+        vkDestroyImageView(m_device, handle.m_imageView, m_allocator);
+        break;
+    case Kind::FRAMEBUFFER:
+        vkDestroyFramebuffer(m_device, handle.m_framebuffer, m_allocator);
+        break;
+    case Kind::RENDER_PASS:
+        vkDestroyRenderPass(m_device, handle.m_renderPass, m_allocator);
+        break;
+    case Kind::PIPELINE:
+        vkDestroyPipeline(m_device, handle.m_pipeline, m_allocator);
+        break;
+    case Kind::PIPELINE_LAYOUT:
+        vkDestroyPipelineLayout(m_device, handle.m_pipelineLayout, m_allocator);
+        break;
+    case Kind::SAMPLER:
+        vkDestroySampler(m_device, handle.m_sampler, m_allocator);
+        break;
+    case Kind::MEMORY:
+        if (m_freeMemory)
+        {
+            m_freeMemory(handle.m_memory);
+        }
+        else
+        {
+            vkFreeMemory(m_device, handle.m_memory, m_allocator);
+        }
+        break;
+    case Kind::SWAPCHAIN:
+        vkDestroySwapchainKHR(m_device, handle.m_swapChain, m_allocator);
+        break;
+    }
+}
+
+#endif // DELETION_QUEUE_HPP
@@ -0,0 +1,176 @@
+#ifndef GEOMETRY_POOL_HPP
+#define GEOMETRY_POOL_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <functional> // std::function
+#include <stdexcept> // std::runtime_error
+#include <cstdint> // uint32_t
+
+// One device-local vertex buffer and one index buffer shared by every mesh.
+// Meshes are sub-allocated linearly and addressed by vertexOffset/firstIndex,
+// so the whole scene is drawn with a single bind and indirect draws. A second,
+// position-only stream mirrors the vertex buffer for depth-only passes.
+class GeometryPool
+{
+public:
+    static constexpr VkDeviceSize POSITION_STRIDE = 3 * sizeof(float);
+
+    using CreateBufferFunction = std::function<void(VkDeviceSize size,
+                        VkBufferUsageFlags usage, VkBuffer& buffer,
+                        VkDeviceMemory& memory)>;
+    using FreeMemoryFunction = std::function<void(VkDeviceMemory memory)>;
+
+    struct Range
+    {
+        int32_t m_vertexOffset;
+        uint32_t m_firstIndex;
+    };
+
+    void Create(VkDevice device, VkDeviceSize vertexStride,
+                uint32_t vertexCapacity, uint32_t indexCapacity,
+                const CreateBufferFunction& createBuffer,
+                const VkAllocationCallbacks *allocator);
+    void Destroy(const FreeMemoryFunction& freeMemory);
+
+    Range Allocate(uint32_t vertexCount, uint32_t indexCount);
+    VkDeviceSize GetVertexByteOffset(const Range& range) const;
+    VkDeviceSize GetIndexByteOffset(const Range& range) const;
+    VkDeviceSize GetPositionByteOffset(const Range& range) const;
+    void Bind(VkCommandBuffer commandBuffer) const;
+    void BindPositions(VkCommandBuffer commandBuffer) const;
+
+    VkBuffer GetVertexBuffer() const;
+    VkBuffer GetPositionBuffer() const;
+    VkBuffer GetIndexBuffer() const;
+    uint32_t GetVertexCount() const;
+    uint32_t GetIndexCount() const;
+
+private:
+    VkDevice m_device{VK_NULL_HANDLE};
+    const VkAllocationCallbacks *m_allocator{nullptr};
+    VkBuffer m_vertexBuffer{VK_NULL_HANDLE};
+    VkDeviceMemory m_vertexMemory{VK_NULL_HANDLE};
+    VkBuffer m_indexBuffer{VK_NULL_HANDLE};
+    VkDeviceMemory m_indexMemory{VK_NULL_HANDLE};
+    VkBuffer m_positionBuffer{VK_NULL_HANDLE};
+    VkDeviceMemory m_positionMemory{VK_NULL_HANDLE};
+    VkDeviceSize m_vertexStride{0};
+    uint32_t m_vertexCapacity{0};
+    uint32_t m_indexCapacity{0};
+    uint32_t m_vertexCount{0};
+    uint32_t m_indexCount{0};
+};
+
+inline void GeometryPool::Create(VkDevice device, VkDeviceSize vertexStride,
+                                uint32_t vertexCapacity, uint32_t indexCapacity,
+                                const CreateBufferFunction& createBuffer,
+                                const VkAllocationCallbacks *allocator)
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_vertexStride = vertexStride;
+    m_vertexCapacity = vertexCapacity;
+    m_indexCapacity = indexCapacity;
+    m_vertexCount = 0;
+    m_indexCount = 0;
+
+    createBuffer(vertexStride * vertexCapacity,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                m_vertexBuffer, m_vertexMemory);
+    createBuffer(sizeof(uint32_t) * indexCapacity,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                m_indexBuffer, m_indexMemory);
+    createBuffer(POSITION_STRIDE * vertexCapacity,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                m_positionBuffer, m_positionMemory);
+}
+
+inline void GeometryPool::Destroy(const FreeMemoryFunction& freeMemory)
+{
+    vkDestroyBuffer(m_device, m_positionBuffer, m_allocator);
+    freeMemory(m_positionMemory);
+    vkDestroyBuffer(m_device, m_indexBuffer, m_allocator);
+    freeMemory(m_indexMemory);
+    vkDestroyBuffer(m_device, m_vertexBuffer, m_allocator);
+    freeMemory(m_vertexMemory);
+
+    m_positionBuffer = VK_NULL_HANDLE;
+    m_positionMemory = VK_NULL_HANDLE;
+    m_indexBuffer = VK_NULL_HANDLE;
+    m_indexMemory = VK_NULL_HANDLE;
+    m_vertexBuffer = VK_NULL_HANDLE;
+    m_vertexMemory = VK_NULL_HANDLE;
+}
+
+inline GeometryPool::Range GeometryPool::Allocate(uint32_t vertexCount,
+                                                    uint32_t indexCount)
+{
+    if ((m_vertexCapacity - m_vertexCount < vertexCount) ||
+        (m_indexCapacity - m_indexCount < indexCount))
+    {
+        throw std::runtime_error("geometry pool is full");
+    }
+
+    Range range{static_cast<int32_t>(m_vertexCount), m_indexCount};
+    m_vertexCount += vertexCount;
+    m_indexCount += indexCount;
+
+    return range;
+}
+
+inline VkDeviceSize GeometryPool::GetVertexByteOffset(const Range& range) const
+{
+    return m_vertexStride * static_cast<VkDeviceSize>(range.m_vertexOffset);
+}
+
+inline VkDeviceSize GeometryPool::GetIndexByteOffset(const Range& range) const
+{
+    return sizeof(uint32_t) * static_cast<VkDeviceSize>(range.m_firstIndex);
+}
+
+inline VkDeviceSize GeometryPool::GetPositionByteOffset(const Range& range) const
+{
+    return POSITION_STRIDE * static_cast<VkDeviceSize>(range.m_vertexOffset);
+}
+
+inline void GeometryPool::Bind(VkCommandBuffer commandBuffer) const
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+inline void GeometryPool::BindPositions(VkCommandBuffer commandBuffer) const
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_positionBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+inline VkBuffer GeometryPool::GetVertexBuffer() const
+{
+    return m_vertexBuffer;
+}
+
+inline VkBuffer GeometryPool::GetPositionBuffer() const
+{
+    return m_positionBuffer;
+}
+
+inline VkBuffer GeometryPool::GetIndexBuffer() const
+{
+    return m_indexBuffer;
+}
+
+inline uint32_t GeometryPool::GetVertexCount() const
+{
+    return m_vertexCount;
+}
+
+inline uint32_t GeometryPool::GetIndexCount() const
+{
+    return m_indexCount;
+}
+
+#endif // GEOMETRY_POOL_HPP
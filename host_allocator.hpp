@@ -0,0 +1,489 @@
+#ifndef HOST_ALLOCATOR_HPP
+#define HOST_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <array> // std::array
+#include <vector> // std::vector
+#include <mutex> // std::mutex
+#include <new> // std::bad_alloc
+#include <atomic> // std::atomic
+#include <ostream> // std::ostream
+#include <algorithm> // std::max
+#include <type_traits> // std::is_trivially_destructible
+#include <cstdlib> // std::malloc, std::free, std::aligned_alloc
+#include <cstring> // std::memcpy
+#include <cstddef> // std::max_align_t
+#include <cstdint> // uint64_t, uintptr_t
+
+// Host memory of the Vulkan driver, handed over through VkAllocationCallbacks.
+// Blocks of up to MAX_POOLED_SIZE bytes are carved from large chunks and
+// recycled through a free list per power of two size class, so a driver that
+// allocates and frees the same sizes every frame stops reaching the system
+// heap once the pools are warm. Larger or more strictly aligned blocks go to
+// the heap directly. Live and peak bytes are tracked per allocation scope.
+class HostAllocator
+{
+public:
+    struct ScopeStats
+    {
+        uint64_t m_liveBytes;
+        uint64_t m_peakBytes;
+        uint64_t m_allocations;
+        uint64_t m_internalBytes;
+    };
+
+    HostAllocator();
+    ~HostAllocator();
+    HostAllocator(const HostAllocator&) = delete;
+    HostAllocator& operator=(const HostAllocator&) = delete;
+
+    const VkAllocationCallbacks *GetCallbacks() const;
+
+    // pool chunks and large blocks taken from the system heap so far
+    uint64_t GetHeapAllocations() const;
+    ScopeStats GetScopeStats(VkSystemAllocationScope scope) const;
+    void Report(std::ostream& os) const;
+
+private:
+    static constexpr std::size_t MIN_BLOCK_SIZE = 64;
+    static constexpr std::size_t CLASS_COUNT = 11;
+    static constexpr std::size_t MAX_POOLED_SIZE =
+                                    MIN_BLOCK_SIZE << (CLASS_COUNT - 1);
+    static constexpr std::size_t CHUNK_SIZE = 4 * MAX_POOLED_SIZE;
+    // every pooled block starts at a multiple of its size
+    static constexpr std::size_t BLOCK_ALIGNMENT = MIN_BLOCK_SIZE;
+    static constexpr uint32_t LARGE_CLASS = UINT32_MAX;
+    static constexpr std::size_t SCOPE_COUNT =
+                                VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    // sits right before every pointer handed to the driver
+    struct Header
+    {
+        void *m_block;
+        uint64_t m_size;
+        uint32_t m_class;
+        uint32_t m_scope;
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock *m_next;
+    };
+
+    static VKAPI_ATTR void* VKAPI_CALL Allocation(void *userData,
+                std::size_t size, std::size_t alignment,
+                VkSystemAllocationScope scope);
+    static VKAPI_ATTR void* VKAPI_CALL Reallocation(void *userData,
+                void *original, std::size_t size, std::size_t alignment,
+                VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL Free(void *userData, void *memory);
+    static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void *userData,
+                std::size_t size, VkInternalAllocationType type,
+                VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL InternalFree(void *userData,
+                std::size_t size, VkInternalAllocationType type,
+                VkSystemAllocationScope scope);
+
+    void *Allocate(std::size_t size, std::size_t alignment,
+                    VkSystemAllocationScope scope);
+    void Release(void *memory);
+    static Header *GetHeader(void *memory);
+    static std::size_t GetBlockSize(uint32_t sizeClass);
+    static uint32_t GetSizeClass(std::size_t blockSize);
+    void *TakeBlock(uint32_t sizeClass);
+    void Track(uint32_t scope, int64_t bytes);
+
+    VkAllocationCallbacks m_callbacks{};
+    mutable std::mutex m_mutex;
+    std::array<FreeBlock*, CLASS_COUNT> m_freeLists{};
+    std::vector<void*> m_chunks;
+    char *m_chunkCursor{nullptr};
+    char *m_chunkEnd{nullptr};
+    std::array<ScopeStats, SCOPE_COUNT> m_scopes{};
+    std::atomic<uint64_t> m_heapAllocations{0};
+};
+
+// Linear allocator for CPU data that only lives until the next frame begins.
+// Reset() rewinds it; a frame that overflowed the block gets the overflow
+// from the heap and the block grows to that frame's high water mark on the
+// next Reset(), so a steady frame loop settles at zero heap allocations.
+class FrameArena
+{
+public:
+    explicit FrameArena(std::size_t capacity = DEFAULT_CAPACITY);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void *Allocate(std::size_t size,
+                    std::size_t alignment = alignof(std::max_align_t));
+    template <typename T>
+    T *AllocateArray(std::size_t count);
+    void Reset();
+
+    std::size_t GetCapacity() const;
+    std::size_t GetHighWater() const;
+
+private:
+    static constexpr std::size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    std::vector<unsigned char> m_block;
+    std::vector<void*> m_overflow;
+    std::size_t m_used{0};
+    std::size_t m_highWater{0};
+};
+
+inline HostAllocator::HostAllocator()
+{
+    m_callbacks.pUserData = this;
+    m_callbacks.pfnAllocation = &HostAllocator::Allocation;
+    m_callbacks.pfnReallocation = &HostAllocator::Reallocation;
+    m_callbacks.pfnFree = &HostAllocator::Free;
+    m_callbacks.pfnInternalAllocation = &HostAllocator::InternalAllocation;
+    m_callbacks.pfnInternalFree = &HostAllocator::InternalFree;
+    m_chunks.reserve(64);
+}
+
+// the driver has released everything by now, live blocks of a leaking
+// driver go down with their chunks
+inline HostAllocator::~HostAllocator()
+{
+    for (void *chunk : m_chunks)
+    {
+        std::free(chunk);
+    }
+}
+
+inline const VkAllocationCallbacks *HostAllocator::GetCallbacks() const
+{
+    return &m_callbacks;
+}
+
+inline uint64_t HostAllocator::GetHeapAllocations() const
+{
+    return m_heapAllocations.load(std::memory_order_relaxed);
+}
+
+inline HostAllocator::ScopeStats HostAllocator::GetScopeStats(
+                                    VkSystemAllocationScope scope) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_scopes[static_cast<std::size_t>(scope)];
+}
+
+inline void HostAllocator::Report(std::ostream& os) const
+{
+    static const char *names[SCOPE_COUNT] =
+    {"command", "object", "cache", "device", "instance"};
+    constexpr double KB = 1024.0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    os << "host memory: " << m_chunks.size() << " pool chunks of " <<
+    CHUNK_SIZE / KB << " KB, " << GetHeapAllocations() <<
+    " heap allocations" << std::endl;
+
+    for (std::size_t i = 0; i < SCOPE_COUNT; ++i)
+    {
+        const ScopeStats& stats = m_scopes[i];
+        if (0 == stats.m_allocations)
+        {
+            continue;
+        }
+
+        os << "  " << names[i] << ": live " << stats.m_liveBytes / KB <<
+        " KB, peak " << stats.m_peakBytes / KB << " KB in " <<
+        stats.m_allocations << " allocations";
+        if (0 != stats.m_internalBytes)
+        {
+            os << ", internal " << stats.m_internalBytes / KB << " KB";
+        }
+        os << std::endl;
+    }
+}
+
+inline void* HostAllocator::Allocation(void *userData, std::size_t size,
+                    std::size_t alignment, VkSystemAllocationScope scope)
+{
+    return static_cast<HostAllocator*>(userData)->Allocate(size, alignment,
+                                                            scope);
+}
+
+// a block that already has room for the new size is kept in place
+inline void* HostAllocator::Reallocation(void *userData, void *original,
+                std::size_t size, std::size_t alignment,
+                VkSystemAllocationScope scope)
+{
+    auto *allocator = static_cast<HostAllocator*>(userData);
+    if (nullptr == original)
+    {
+        return allocator->Allocate(size, alignment, scope);
+    }
+    if (0 == size)
+    {
+        allocator->Release(original);
+        return nullptr;
+    }
+
+    Header *header = GetHeader(original);
+    uintptr_t address = reinterpret_cast<uintptr_t>(original);
+    if ((LARGE_CLASS != header->m_class) && (0 == address % alignment))
+    {
+        std::size_t offset = static_cast<std::size_t>(
+                address - reinterpret_cast<uintptr_t>(header->m_block));
+        if (offset + size <= GetBlockSize(header->m_class))
+        {
+            std::lock_guard<std::mutex> lock(allocator->m_mutex);
+            allocator->Track(header->m_scope, -static_cast<int64_t>(
+                                                        header->m_size));
+            allocator->Track(header->m_scope, static_cast<int64_t>(size));
+            header->m_size = size;
+            return original;
+        }
+    }
+
+    void *memory = allocator->Allocate(size, alignment, scope);
+    if (nullptr == memory)
+    {
+        return nullptr;
+    }
+
+    std::memcpy(memory, original,
+                std::min(size, static_cast<std::size_t>(header->m_size)));
+    allocator->Release(original);
+
+    return memory;
+}
+
+inline void HostAllocator::Free(void *userData, void *memory)
+{
+    static_cast<HostAllocator*>(userData)->Release(memory);
+}
+
+inline void HostAllocator::InternalAllocation(void *userData, std::size_t size,
+                VkInternalAllocationType, VkSystemAllocationScope scope)
+{
+    auto *allocator = static_cast<HostAllocator*>(userData);
+    std::lock_guard<std::mutex> lock(allocator->m_mutex);
+    allocator->m_scopes[static_cast<std::size_t>(scope)].m_internalBytes +=
+                                                                        size;
+}
+
+inline void HostAllocator::InternalFree(void *userData, std::size_t size,
+                VkInternalAllocationType, VkSystemAllocationScope scope)
+{
+    auto *allocator = static_cast<HostAllocator*>(userData);
+    std::lock_guard<std::mutex> lock(allocator->m_mutex);
+    allocator->m_scopes[static_cast<std::size_t>(scope)].m_internalBytes -=
+                                                                        size;
+}
+
+inline void *HostAllocator::Allocate(std::size_t size, std::size_t alignment,
+                                    VkSystemAllocationScope scope)
+{
+    if (0 == size)
+    {
+        return nullptr;
+    }
+
+    alignment = std::max(alignment, alignof(Header));
+    uint32_t scopeIndex = static_cast<uint32_t>(scope);
+
+    // a block aligned at least as strictly as the request only needs the
+    // header rounded up in front of the memory
+    std::size_t offset = (sizeof(Header) + alignment - 1) & ~(alignment - 1);
+    if ((alignment <= BLOCK_ALIGNMENT) && (offset + size <= MAX_POOLED_SIZE))
+    {
+        uint32_t sizeClass = GetSizeClass(offset + size);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        void *block = TakeBlock(sizeClass);
+        if (nullptr == block)
+        {
+            return nullptr;
+        }
+
+        void *memory = static_cast<char*>(block) + offset;
+        *GetHeader(memory) = Header{block, size, sizeClass, scopeIndex};
+        Track(scopeIndex, static_cast<int64_t>(size));
+
+        return memory;
+    }
+
+    void *block = std::malloc(sizeof(Header) + alignment - 1 + size);
+    if (nullptr == block)
+    {
+        return nullptr;
+    }
+    m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(block) + sizeof(Header);
+    address = (address + alignment - 1) & ~static_cast<uintptr_t>(
+                                                            alignment - 1);
+    void *memory = reinterpret_cast<void*>(address);
+    *GetHeader(memory) = Header{block, size, LARGE_CLASS, scopeIndex};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Track(scopeIndex, static_cast<int64_t>(size));
+
+    return memory;
+}
+
+inline void HostAllocator::Release(void *memory)
+{
+    if (nullptr == memory)
+    {
+        return;
+    }
+
+    Header header = *GetHeader(memory);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Track(header.m_scope, -static_cast<int64_t>(header.m_size));
+
+    if (LARGE_CLASS == header.m_class)
+    {
+        std::free(header.m_block);
+        return;
+    }
+
+    auto *block = static_cast<FreeBlock*>(header.m_block);
+    block->m_next = m_freeLists[header.m_class];
+    m_freeLists[header.m_class] = block;
+}
+
+inline HostAllocator::Header *HostAllocator::GetHeader(void *memory)
+{
+    return reinterpret_cast<Header*>(static_cast<char*>(memory) -
+                                    sizeof(Header));
+}
+
+inline std::size_t HostAllocator::GetBlockSize(uint32_t sizeClass)
+{
+    return MIN_BLOCK_SIZE << sizeClass;
+}
+
+inline uint32_t HostAllocator::GetSizeClass(std::size_t blockSize)
+{
+    uint32_t sizeClass = 0;
+    while (GetBlockSize(sizeClass) < blockSize)
+    {
+        ++sizeClass;
+    }
+
+    return sizeClass;
+}
+
+// Blocks are carved from the current chunk with the cursor rounded up to the
+// block size, the bytes skipped by the rounding are never used.
+inline void *HostAllocator::TakeBlock(uint32_t sizeClass)
+{
+    if (nullptr != m_freeLists[sizeClass])
+    {
+        FreeBlock *block = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = block->m_next;
+        return block;
+    }
+
+    std::size_t blockSize = GetBlockSize(sizeClass);
+    uintptr_t cursor = reinterpret_cast<uintptr_t>(m_chunkCursor);
+    cursor = (cursor + blockSize - 1) & ~static_cast<uintptr_t>(blockSize - 1);
+    if ((nullptr == m_chunkCursor) ||
+        (cursor + blockSize > reinterpret_cast<uintptr_t>(m_chunkEnd)))
+    {
+        void *chunk = std::aligned_alloc(MAX_POOLED_SIZE, CHUNK_SIZE);
+        if (nullptr == chunk)
+        {
+            return nullptr;
+        }
+        m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+        m_chunks.push_back(chunk);
+        m_chunkCursor = static_cast<char*>(chunk);
+        m_chunkEnd = m_chunkCursor + CHUNK_SIZE;
+        cursor = reinterpret_cast<uintptr_t>(m_chunkCursor);
+    }
+
+    m_chunkCursor = reinterpret_cast<char*>(cursor + blockSize);
+    return reinterpret_cast<void*>(cursor);
+}
+
+// caller holds m_mutex
+inline void HostAllocator::Track(uint32_t scope, int64_t bytes)
+{
+    ScopeStats& stats = m_scopes[scope];
+    stats.m_liveBytes += bytes;
+    if (0 < bytes)
+    {
+        ++stats.m_allocations;
+        stats.m_peakBytes = std::max(stats.m_peakBytes, stats.m_liveBytes);
+    }
+}
+
+inline FrameArena::FrameArena(std::size_t capacity) : m_block(capacity)
+{}
+
+inline FrameArena::~FrameArena()
+{
+    Reset();
+}
+
+inline void *FrameArena::Allocate(std::size_t size, std::size_t alignment)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_block.data());
+    uintptr_t address = (base + m_used + alignment - 1) &
+                        ~static_cast<uintptr_t>(alignment - 1);
+    std::size_t offset = static_cast<std::size_t>(address - base);
+    m_used = offset + size;
+    m_highWater = std::max(m_highWater, m_used);
+
+    if (m_used <= m_block.size())
+    {
+        return m_block.data() + offset;
+    }
+
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void *memory = std::aligned_alloc(alignment,
+                            (size + alignment - 1) & ~(alignment - 1));
+    if (nullptr == memory)
+    {
+        throw std::bad_alloc();
+    }
+    m_overflow.push_back(memory);
+
+    return memory;
+}
+
+template <typename T>
+inline T *FrameArena::AllocateArray(std::size_t count)
+{
+    static_assert(std::is_trivially_destructible<T>::value,
+                "frame arena memory is never destroyed");
+    return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+}
+
+inline void FrameArena::Reset()
+{
+    for (void *memory : m_overflow)
+    {
+        std::free(memory);
+    }
+    m_overflow.clear();
+
+    if (m_highWater > m_block.size())
+    {
+        m_block.resize(m_highWater);
+    }
+    m_used = 0;
+}
+
+inline std::size_t FrameArena::GetCapacity() const
+{
+    return m_block.size();
+}
+
+inline std::size_t FrameArena::GetHighWater() const
+{
+    return m_highWater;
+}
+
+#endif // HOST_ALLOCATOR_HPP
@@ -13,6 +13,8 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h> // image loading
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h> // frame capture
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h> // obj loader
@@ -31,12 +33,72 @@
 #include <fstream> // std::ifstream
 #include <array> // std::array
 #include <chrono> // std::chrono
+#include <memory> // std::unique_ptr
 #include <unordered_map> // std::unordered_map
+#include <random> // std::mt19937
+#include <thread> // std::thread
+#include <functional> // std::function
+#include <atomic> // std::atomic
+#include <cstdio> // std::snprintf
+#include <new> // std::bad_alloc, std::align_val_t
+#include <cmath> // std::cbrt
+#include <string_view> // std::string_view
+
+#include "deletion_queue.hpp" // DeletionQueue
+#include "render_graph.hpp" // RenderGraph
+#include "bindless.hpp" // BindlessTable
+#include "geometry_pool.hpp" // GeometryPool
+#include "meshlet.hpp" // MeshletBuilder
+#include "occlusion_culling.hpp" // OcclusionCuller
+#include "memory_tracker.hpp" // MemoryTracker
+#include "texture_residency.hpp" // TextureResidency
+#include "profiler.hpp" // Profiler
+#include "task_graph.hpp" // TaskGraph
+#include "mip_generator.hpp" // MipGenerator
+#include "readback.hpp" // ReadbackRing
+#include "host_allocator.hpp" // HostAllocator, FrameArena
+#include "triple_buffer.hpp" // TripleBuffer
+#include "transform_system.hpp" // TransformSystem
+#include "scene_graph.hpp" // SceneGraph
+#include "bvh.hpp" // Bvh
+#include "texture_streamer.hpp" // TextureStreamer
 
 class TriangleApp
 {
 public:
+    struct Options
+    {
+        uint32_t m_resizeBenchmarkFrames{0};
+        VkSampleCountFlagBits m_msaaSamples{VK_SAMPLE_COUNT_4_BIT};
+        double m_targetFrameMs{0.0};
+        bool m_depthPrepass{false};
+        bool m_cpuCulling{false};
+        bool m_occlusionCulling{false};
+        bool m_occlusionBenchmark{false};
+        bool m_transformBenchmark{false};
+        bool m_sceneBenchmark{false};
+        bool m_bvhBenchmark{false};
+        uint32_t m_textureBudgetMb{0};
+        std::string m_tracePath;
+        bool m_asyncCompute{true};
+        bool m_commandReuse{true};
+        bool m_mipBenchmark{false};
+        std::string m_capturePath;
+        ReadbackRing::Format m_captureFormat{ReadbackRing::Format::PNG};
+        uint32_t m_allocTestFrames{0};
+        uint32_t m_reuseTestFrames{0};
+        double m_tickRate{60.0};
+        double m_simulationLoadMs{0.0};
+    };
+
+    explicit TriangleApp(const Options& options);
+    ~TriangleApp();
     void Run();
+    static Options ParseOptions(int argc, char **argv);
+    static void BenchmarkOcclusion();
+    static void BenchmarkTransforms();
+    static void BenchmarkScene();
+    static void BenchmarkBvh();
 
     struct Vertex
     {
@@ -56,6 +118,10 @@ public:
     };
 
 private:
+    // declared first so it outlives everything created with its callbacks
+    HostAllocator m_hostAllocator;
+    const VkAllocationCallbacks *m_allocator{m_hostAllocator.GetCallbacks()};
+    FrameArena m_frameArena;
     GLFWwindow *m_window{nullptr};
     VkInstance m_instance{VK_NULL_HANDLE};
     VkDebugUtilsMessengerEXT m_debugMessenger{VK_NULL_HANDLE};
@@ -63,6 +129,17 @@ private:
     VkPhysicalDevice m_physicalDevice{VK_NULL_HANDLE};
     VkDevice m_device{VK_NULL_HANDLE};
     VkQueue m_graphicsQueue{VK_NULL_HANDLE};
+    bool m_asyncCompute{false};
+    VkQueue m_computeQueue{VK_NULL_HANDLE};
+    std::vector<uint32_t> m_bufferQueueFamilies;
+    VkCommandPool m_computeCommandPool{VK_NULL_HANDLE};
+    std::vector<VkCommandBuffer> m_computeCommandBuffers;
+    VkSemaphore m_computeTimeline{VK_NULL_HANDLE};
+    uint64_t m_computeTimelineValue{0};
+    VkQueryPool m_computeTimestampPool{VK_NULL_HANDLE};
+    // host clock nanoseconds of the graphics frame before the last dispatch
+    std::array<uint64_t, 2> m_lastGraphicsTimestamps{};
+    double m_computeOverlap{0.0};
     VkQueue m_presentQueue{VK_NULL_HANDLE};
     VkSwapchainKHR m_swapChain{VK_NULL_HANDLE};
     std::vector<VkImage> m_swapChainImages;
@@ -75,36 +152,136 @@ private:
     VkPipeline m_graphicsPipeline{VK_NULL_HANDLE};
     std::vector<VkFramebuffer> m_swapChainFramebuffers;
     VkCommandPool m_commandPool{VK_NULL_HANDLE};
-    std::vector<VkCommandBuffer> m_commandBuffers;
     std::vector<VkSemaphore> m_imageAvailableSemaphores;
     std::vector<VkSemaphore> m_renderFinishedSemaphores;
-    std::vector<VkFence> m_inFlightFences;
+    VkSemaphore m_timeline{VK_NULL_HANDLE};
+    uint64_t m_timelineValue{0};
+    std::vector<uint64_t> m_frameTimelineValues;
+    std::vector<uint64_t> m_frameSubmitTimes;
+    uint32_t m_overBudgetWaits{0};
     bool m_framebufferResized{false};
     uint32_t m_currentFrame{0};
+    uint64_t m_frameNumber{0};
+    Options m_options;
+    std::chrono::steady_clock::time_point m_startTime;
+    VkPipelineCache m_pipelineCache{VK_NULL_HANDLE};
+    bool m_warmPipelineCache{false};
     
     std::vector<Vertex> m_vertices;
     std::vector<uint32_t> m_indices;
-    VkBuffer m_vertexBuffer{VK_NULL_HANDLE};
-    VkDeviceMemory m_vertexBufferMemory{VK_NULL_HANDLE};
-    VkBuffer m_indexBuffer{VK_NULL_HANDLE};
-    VkDeviceMemory m_indexBufferMemory{VK_NULL_HANDLE};
+    struct Mesh;
+    std::vector<Mesh> m_meshes;
+    std::vector<tinyobj::material_t> m_objMaterials;
+    std::vector<uint32_t> m_objMaterialTextures;
+    struct Draw;
+    std::vector<Draw> m_draws;
+    glm::mat4 m_modelView{1.0f};
+    glm::mat4 m_modelViewProj{1.0f};
+    std::vector<glm::vec3> m_positions;
+    std::vector<Meshlet> m_meshlets;
+    VkBuffer m_meshletBuffer{VK_NULL_HANDLE};
+    VkDeviceMemory m_meshletBufferMemory{VK_NULL_HANDLE};
+    bool m_gpuCulling{false};
+    uint32_t m_visibleMeshlets{0};
+    VkDescriptorSetLayout m_cullSetLayout{VK_NULL_HANDLE};
+    VkPipelineLayout m_cullPipelineLayout{VK_NULL_HANDLE};
+    VkPipeline m_cullPipeline{VK_NULL_HANDLE};
+    VkDescriptorPool m_cullDescriptorPool{VK_NULL_HANDLE};
+    std::vector<VkDescriptorSet> m_cullDescriptorSets;
+    OcclusionCuller m_occlusion;
+    MemoryTracker m_memory;
+    bool m_memoryBudget{false};
+    bool m_memoryReportRequested{false};
+    bool m_pickRequested{false};
+    double m_pickX{0.0};
+    double m_pickY{0.0};
+    uint32_t m_occludedMeshlets{0};
+    GeometryPool m_geometryPool;
+    bool m_multiDrawIndirect{false};
+    std::vector<VkBuffer> m_indirectBuffers;
+    std::vector<VkDeviceMemory> m_indirectBuffersMemory;
+    std::vector<void*> m_indirectBuffersMapped;
+    std::vector<VkBuffer> m_drawDataBuffers;
+    std::vector<VkDeviceMemory> m_drawDataBuffersMemory;
+    std::vector<void*> m_drawDataBuffersMapped;
+    std::vector<VkBuffer> m_drawCountBuffers;
+    std::vector<VkDeviceMemory> m_drawCountBuffersMemory;
+    std::vector<void*> m_drawCountBuffersMapped;
+    std::vector<VkBuffer> m_cullConstantBuffers;
+    std::vector<VkDeviceMemory> m_cullConstantBuffersMemory;
+    std::vector<void*> m_cullConstantBuffersMapped;
     std::vector<VkBuffer> m_uniformBuffers;
     std::vector<VkDeviceMemory> m_uniformBuffersMemory;
     std::vector<void*> m_uniformBuffersMapped;
     VkDescriptorPool m_descriptorPool{VK_NULL_HANDLE};
     std::vector<VkDescriptorSet> m_descriptorSets;
-    uint32_t m_mipLevels;
-    VkImage m_textureImage{VK_NULL_HANDLE};
-    VkDeviceMemory m_textureImageMemory{VK_NULL_HANDLE};
-    VkImageView m_textureImageView{VK_NULL_HANDLE};
+    uint32_t m_mipLevels{1};
+    struct Texture;
+    std::vector<Texture> m_textures;
+    std::vector<std::string> m_texturePaths;
+    struct DecodedImage;
+    std::vector<DecodedImage> m_decodedImages;
     VkSampler m_textureSampler{VK_NULL_HANDLE};
-    VkImage m_depthImage{VK_NULL_HANDLE};
-    VkDeviceMemory m_depthImageMemory{VK_NULL_HANDLE};
-    VkImageView m_depthImageView{VK_NULL_HANDLE};
+    MipGenerator m_mipGenerator;
+    bool m_computeMips{false};
+    TextureResidency m_residency;
+    TextureStreamer m_streamer;
+    std::vector<TextureStreamer::Levels> m_streamedLevels;
+    std::vector<VkCommandBuffer> m_streamCommandBuffers;
+    bool m_streamRecording{false};
+    std::vector<uint32_t> m_swappedTextures;
+    std::vector<uint32_t> m_materialTextures;
+    BindlessTable m_bindless;
+    VkBuffer m_materialBuffer{VK_NULL_HANDLE};
+    VkDeviceMemory m_materialBufferMemory{VK_NULL_HANDLE};
+    void *m_materialBufferMapped{nullptr};
+    uint32_t m_materialCount{0};
+    uint32_t m_defaultMaterial{0};
     VkSampleCountFlagBits m_msaaSamples{VK_SAMPLE_COUNT_1_BIT};
-    VkImage m_colorImage{VK_NULL_HANDLE};
-    VkDeviceMemory m_colorImageMemory{VK_NULL_HANDLE};
-    VkImageView m_colorImageView{VK_NULL_HANDLE};
+    VkSampleCountFlagBits m_requestedSamples{VK_SAMPLE_COUNT_1_BIT};
+    bool m_dynamicResolution{false};
+    bool m_requestedDynamicResolution{false};
+    float m_renderScale{1.0f};
+    double m_gpuFrameMs{0.0};
+    float m_timestampPeriod{0.0f};
+    // the bits the graphics queue writes, differences wrap within them
+    uint64_t m_timestampMask{~uint64_t{0}};
+    VkQueryPool m_timestampPool{VK_NULL_HANDLE};
+    bool m_calibratedTimestamps{false};
+    PFN_vkGetCalibratedTimestampsEXT m_getCalibratedTimestamps{nullptr};
+    bool m_depthPrepass{false};
+    bool m_requestedDepthPrepass{false};
+    VkPipeline m_prepassPipeline{VK_NULL_HANDLE};
+    bool m_pipelineStatistics{false};
+    VkQueryPool m_statisticsPool{VK_NULL_HANDLE};
+    uint64_t m_vertexInvocations{0};
+    uint64_t m_fragmentInvocations{0};
+    VkRenderPass m_upscaleRenderPass{VK_NULL_HANDLE};
+    VkDescriptorSetLayout m_upscaleSetLayout{VK_NULL_HANDLE};
+    VkPipelineLayout m_upscalePipelineLayout{VK_NULL_HANDLE};
+    VkPipeline m_upscalePipeline{VK_NULL_HANDLE};
+    VkSampler m_upscaleSampler{VK_NULL_HANDLE};
+    VkDescriptorPool m_upscaleDescriptorPool{VK_NULL_HANDLE};
+    std::vector<VkDescriptorSet> m_upscaleDescriptorSets;
+    std::vector<uint32_t> m_upscaleSetGenerations;
+    std::vector<VkFramebuffer> m_upscaleFramebuffers;
+    uint32_t m_renderTargetGeneration{0};
+    DeletionQueue m_deletionQueue;
+    RenderGraph m_renderGraph;
+    RenderGraph::Resource m_graphColor{0};
+    RenderGraph::Resource m_graphDepth{0};
+    RenderGraph::Resource m_graphBackBuffer{0};
+    RenderGraph::Resource m_graphSceneColor{0};
+    RenderGraph::Resource m_graphIndirect{0};
+    RenderGraph::Resource m_graphDrawData{0};
+    RenderGraph::Resource m_graphDrawCount{0};
+    RenderGraph::Resource m_graphReadback{0};
+    ReadbackRing m_readback;
+    bool m_capture{false};
+    uint32_t m_captureSlot{ReadbackRing::NO_SLOT};
+    uint32_t m_imageIndex{0};
+    struct ResizeBenchmark;
+    std::unique_ptr<ResizeBenchmark> m_resizeBenchmark;
     
 
     void InitWindow();
@@ -114,30 +291,66 @@ private:
     void CreateSurface();
     void PickPhysicalDevice();
     void CreateLogicalDevice();
-    void CreateSwapChain();
+    void CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
     void RecreateSwapChain();
-    void CleanupSwapChain();
+    void RetireSwapChain();
     void CreateImageViews();
     void CreateRenderPass();
     void CreateDescriptorSetLayout();
     void CreateGraphicsPipeline();
+    void CreateUpscalePass();
+    void CreateUpscaleDescriptors();
     void CreateFramebuffers();
     void CreateCommandPool();
-    void CreateColorResources();
-    void CreateDepthResources();
-    void CreateTextureImage();
-    void CreateTextureImageView();
+    void CreateMipGenerator();
+    void CreateReadback();
+    void CreateQueryPool();
+    void CreatePipelineCache();
+    void SavePipelineCache();
+    void CreateRenderGraph();
+    struct Texture;
+    void CreateTextureImage(const DecodedImage& image, const std::string& path,
+                            Texture& texture);
+    static DecodedImage DecodeImage(const std::string& path);
+    void CollectTexturePaths();
+    void CreateTextures();
     void CreateTextureSampler();
+    void RequestTextureMips();
+    VkCommandBuffer UpdateResidency();
+    void StepTexture(uint32_t index);
+    void SetTextureBaseMip(uint32_t index, uint32_t baseMip,
+                            const std::vector<uint8_t>& pixels);
+    VkCommandBuffer GetStreamCommands();
+    void CreateBindlessTable();
+    void CreateMaterials();
     void LoadModel();
-    void CreateVertexBuffer();
-    void CreateIndexBuffer();
+    void CreateOcclusionCuller();
+    void CreateScene();
+    void CreateGeometryPool();
+    void UploadModel();
+    void CreateDrawBuffers();
+    void CreateCullPipeline();
     void CreateUniformBuffers();
     void CreateDescriptorPool();
     void CreateDescriptorSets();
     void CreateCommandBuffers();
+    void AllocateRecordedCommands();
     void CreateSyncObjects();
     void MainLoop();
     void DrawFrame();
+    void WaitForTimeline(uint64_t value, uint64_t budget = FRAME_BUDGET_NS);
+    void ApplyQuality();
+    void UpdateRenderScale();
+    void ReadPipelineStatistics();
+    void TraceGpuFrame();
+    uint64_t GetFrameTicks(const uint64_t (&timestamps)[2]) const;
+    bool CalibrateTimestamps(uint64_t (&now)[2]) const;
+    uint64_t ToHostTime(uint64_t timestamp, const uint64_t (&now)[2]) const;
+    uint64_t SubmitCompute();
+    void MeasureComputeOverlap();
+    void WriteTrace();
+    VkExtent2D GetRenderExtent() const;
+    uint64_t NextTimelineValue() const;
     void Cleanup();
 
     static bool CheckExstensions(const char **glfwExtensions, 
@@ -155,6 +368,8 @@ private:
                 VkDebugUtilsMessengerCreateInfoEXT& createInfo);
     bool IsDeviceSuitable(VkPhysicalDevice device);
     static bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+    static bool HasDeviceExtension(VkPhysicalDevice device, const char *name);
+    bool SupportsCalibratedTimestamps(VkPhysicalDevice device) const;
     int RateDevice(VkPhysicalDevice device);
     
     struct QueueFamilyIndices;
@@ -168,21 +383,57 @@ private:
     VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
     static std::vector<char> ReadFile(const std::string& filename);
     VkShaderModule CreateShaderModule(const std::vector<char>& code);
+    VkCommandBuffer GetFrameCommands(uint32_t imageIndex);
     void RecordCommandBuffer(VkCommandBuffer commandBuffer, 
                                     uint32_t imageIndex);
+    void RecordScenePass(VkCommandBuffer commandBuffer);
+    void PrepareCulling();
+    void RecordCullPass(VkCommandBuffer commandBuffer);
+    void SortDraws();
+    uint32_t CullMeshlets();
+    void DrawCommands(VkCommandBuffer commandBuffer, uint32_t first, 
+                        uint32_t count);
+    struct CullConstants;
+    CullConstants MakeCullConstants() const;
+    static void MakeFrustumPlanes(const glm::mat4& viewProj, 
+                                    glm::vec4 (&planes)[6]);
+    void UpdateMeshBounds();
+    void PickMesh();
+    static uint64_t MakeSortKey(uint32_t pipeline, uint32_t material, 
+                                uint32_t mesh, float depth);
+    void RecordUpscalePass(VkCommandBuffer commandBuffer);
+    void RecordCapturePass(VkCommandBuffer commandBuffer);
     static void FramebufferResizeCallback(GLFWwindow *window, 
                                         int width, int height);
+    static void KeyCallback(GLFWwindow *window, int key, int scancode, 
+                            int action, int mods);
+    static void MouseButtonCallback(GLFWwindow *window, int button, 
+                                    int action, int mods);
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    bool HasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    VkBufferCreateInfo MakeBufferInfo(VkDeviceSize size, 
+                        VkBufferUsageFlags usage, bool shared = false) const;
+    uint32_t GetBufferMemoryTypes(VkDeviceSize size, 
+                                    VkBufferUsageFlags usage) const;
     void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, 
                         VkMemoryPropertyFlags properties, VkBuffer& buffer,
-                        VkDeviceMemory& bufferMemory);
-    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+                        VkDeviceMemory& bufferMemory, 
+                        MemoryTracker::Category category, bool shared = false);
+    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+                    VkDeviceSize dstOffset = 0);
+    void UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, 
+                        const void *data, VkDeviceSize size);
+    void UpdateCamera();
     void UpdateUniformBuffer(uint32_t currentImage);
+    struct Material;
+    uint32_t AddMaterial(const Material& material);
     void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels,
                     VkSampleCountFlagBits numSamples, 
                     VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
                     VkMemoryPropertyFlags properties, VkImage& image, 
-                    VkDeviceMemory& imageMemory);
+                    VkDeviceMemory& imageMemory, 
+                    MemoryTracker::Category category, 
+                    VkImageCreateFlags flags = 0);
     VkCommandBuffer BeginSingleTimeCommands();
     void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
     void TransitionImageLayout(VkImage image, VkFormat format, 
@@ -197,20 +448,52 @@ private:
                         VkImageTiling tiling, VkFormatFeatureFlags features);
     VkFormat FindDepthFormat();
     static bool HasStencilComponent(VkFormat format);
+    bool UseComputeMips(VkFormat format, uint32_t width, uint32_t height,
+                        uint32_t mipLevels) const;
     void GenerateMipmaps(VkImage image, VkFormat imageFormat, 
                          int32_t texWidth, int32_t texHeight,
                          uint32_t mipLevels);
-    VkSampleCountFlagBits GetMaxUsableSampleCount();
+    void RecordBlitMips(VkCommandBuffer commandBuffer, VkImage image, 
+                        VkFormat imageFormat, int32_t texWidth, 
+                        int32_t texHeight, uint32_t mipLevels);
+    void BenchmarkMips();
+    VkSampleCountFlagBits ChooseSampleCount(VkSampleCountFlagBits requested);
 
     void ShowFPS();
+    void StepResizeBenchmark();
+    void ReportResizeBenchmark();
+    uint64_t CountHeapAllocations() const;
+    void StepAllocTest(uint64_t allocations);
+    void ReportAllocTest();
+    void StepReuseTest(bool recorded);
+    void ReportReuseTest();
 
     static constexpr uint32_t WIDTH = 800;
     static constexpr uint32_t HEIGHT = 600;
     static const std::vector<const char*> s_validationLayers;
     static const std::vector<const char*> s_deviceExtensions;
     static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint64_t FRAME_BUDGET_NS = 1000000000 / 60;
+    static constexpr uint64_t GPU_HANG_TIMEOUT_NS = 5000000000;
+    static constexpr float NEAR_PLANE = 0.1f;
+    static constexpr float FAR_PLANE = 10.0f;
+    static constexpr float DEPTH_RELATIVE_PRECISION = 1.0f / 500.0f;
+    static constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+    static constexpr uint32_t MAX_MATERIALS = 1024;
+    static constexpr uint32_t MAX_DRAWS = 1 << 16;
+    static constexpr uint32_t GEOMETRY_POOL_VERTICES = 1 << 20;
+    static constexpr uint32_t GEOMETRY_POOL_INDICES = 1 << 22;
+    static constexpr uint32_t OCCLUDER_TRIANGLES = 256;
+    static constexpr uint64_t RESIDENCY_INTERVAL = 30;
+    static constexpr float MIN_RENDER_SCALE = 0.5f;
+    static constexpr float MAX_RENDER_SCALE_STEP = 0.05f;
+    static constexpr float RENDER_SCALE_QUANTUM = 1.0f / 64.0f;
+    static constexpr double GPU_TIME_SMOOTHING = 0.1;
+    static constexpr float UPSCALE_SHARPNESS = 0.2f;
     static constexpr std::string_view MODEL_PATH = "models/viking_room.obj";
+    static constexpr std::string_view MODEL_DIR = "models/";
     static constexpr std::string_view TEXTURE_PATH = "textures/viking_room.png";
+    static constexpr std::string_view PIPELINE_CACHE_PATH = "pipeline_cache.bin";
 
     #ifdef NDEBUG
         static constexpr bool s_enableValidationLayers = false;
@@ -222,6 +505,7 @@ private:
     {
         std::optional<uint32_t>  m_graphicsFamily;
         std::optional<uint32_t>  m_presentFamily;
+        std::optional<uint32_t>  m_computeFamily;
 
         bool IsComplete()
         {
@@ -238,12 +522,192 @@ private:
     };
 
 
-    struct UniformBufferObject
+    // the shaders only get the composed matrices of m_transforms
+    struct Camera
+    {
+        glm::mat4 m_model;
+        glm::mat4 m_view;
+        glm::mat4 m_proj;
+    };
+
+    Camera m_camera{};
+    TransformSystem m_transforms;
+    uint32_t m_modelTransform{0};
+    // the model and one child node per mesh
+    SceneGraph m_scene;
+    SceneGraph::NodeId m_modelNode{0};
+    SceneGraph::NodeId m_firstMeshNode{0};
+    // world bounds of the mesh nodes, in mesh order
+    Bvh m_meshBvh;
+    std::vector<Bvh::Bounds> m_meshBounds;
+    std::vector<uint32_t> m_visibleMeshes;
+
+    // advanced by the simulation thread once per tick
+    struct SimulationState
+    {
+        double m_angle;
+    };
+
+    // the two latest ticks, rendering interpolates from the previous one to
+    // the current one over the tick that follows m_tickTime
+    struct SimulationFrame
+    {
+        SimulationState m_previous;
+        SimulationState m_current;
+        std::chrono::steady_clock::time_point m_tickTime;
+        uint64_t m_lateTicks;
+    };
+
+    TripleBuffer<SimulationFrame> m_simulation;
+    std::thread m_simulationThread;
+    std::atomic<bool> m_simulationRunning{false};
+    uint64_t m_lateTicks{0};
+    static constexpr uint32_t MAX_CATCH_UP_TICKS = 5;
+
+    void StartSimulation();
+    void StopSimulation();
+    void SimulationLoop();
+    void StepSimulation(SimulationState& state, double dt) const;
+
+    // matches the std430 Material in shader.frag
+    struct Material
+    {
+        alignas(16) glm::vec4 m_baseColor;
+        uint32_t m_albedoTexture;
+        uint32_t m_padding[3];
+    };
+
+    // m_mipLevels counts the full chain, the image holds the levels from
+    // m_baseMip on and moves towards m_targetMip, m_streaming while the
+    // streamer decodes the missing levels
+    struct Texture
+    {
+        VkImage m_image{VK_NULL_HANDLE};
+        VkDeviceMemory m_memory{VK_NULL_HANDLE};
+        VkImageView m_view{VK_NULL_HANDLE};
+        uint32_t m_mipLevels{1};
+        uint32_t m_bindlessIndex{0};
+        std::string m_path;
+        uint32_t m_width{0};
+        uint32_t m_height{0};
+        uint32_t m_baseMip{0};
+        uint32_t m_targetMip{0};
+        bool m_streaming{false};
+    };
+
+    // RGBA8 pixels decoded on a worker, uploaded on the main thread
+    struct DecodedImage
+    {
+        std::unique_ptr<stbi_uc, void (*)(void*)> m_pixels{nullptr, 
+                                                        &stbi_image_free};
+        uint32_t m_width{0};
+        uint32_t m_height{0};
+    };
+
+    // a range of the index buffer drawn with one material
+    struct Mesh
+    {
+        uint32_t m_firstIndex;
+        uint32_t m_indexCount;
+        int32_t m_vertexOffset;
+        int m_objMaterial;
+        uint32_t m_material;
+        glm::vec3 m_center;
+        float m_radius;
+        float m_uvDensity; // texture coordinate units per model unit
+        uint32_t m_firstMeshlet;
+        uint32_t m_meshletCount;
+    };
+
+    struct Draw
+    {
+        uint64_t m_key;
+        uint32_t m_mesh;
+        uint32_t m_firstCommand;
+        uint32_t m_commandCount;
+    };
+
+    // matches the constants buffer in cull.comp, frustum planes and camera
+    // are in model space
+    struct CullConstants
+    {
+        glm::vec4 m_planes[6];
+        glm::vec4 m_cameraPosition;
+        uint32_t m_meshletCount;
+        uint32_t m_maxDraws;
+        uint32_t m_padding[2];
+    };
+
+    struct DrawStats
+    {
+        uint32_t m_draws;
+        uint32_t m_pipelineBinds;
+        uint32_t m_descriptorBinds;
+        uint32_t m_vertexBufferBinds;
+        uint32_t m_indirectCalls;
+    };
+    DrawStats m_drawStats{};
+
+    // one per swapchain image and frame slot, submitted again while its
+    // generation is the current one
+    struct RecordedCommands
+    {
+        VkCommandBuffer m_commandBuffer;
+        uint64_t m_generation;
+        DrawStats m_drawStats;
+    };
+    std::vector<RecordedCommands> m_recordedCommands;
+    uint64_t m_commandGeneration{0};
+    uint32_t m_recordedFrames{0};
+
+    // matches the std430 DrawData in shader.vert, indexed by gl_InstanceIndex
+    struct DrawData
+    {
+        uint32_t m_materialIndex;
+    };
+
+    struct UpscaleConstants
+    {
+        glm::vec2 m_uvScale;
+        glm::vec2 m_uvMax;
+        glm::vec2 m_texelSize;
+        float m_sharpness;
+    };
+
+    struct ResizeBenchmark
+    {
+        std::vector<double> m_frameTimes;
+        std::chrono::steady_clock::time_point m_lastFrame;
+        double m_recreateTime{0.0};
+        uint32_t m_recreateCount{0};
+        bool m_large{false};
+    };
+
+    static constexpr uint32_t RESIZE_BENCHMARK_PERIOD = 4;
+
+    struct AllocTest
     {
-        alignas(16) glm::mat4 m_model;
-        alignas(16) glm::mat4 m_view;
-        alignas(16) glm::mat4 m_proj;
+        uint64_t m_frames{0};
+        uint64_t m_allocatingFrames{0};
+        uint64_t m_allocations{0};
+        uint64_t m_worstFrame{0};
     };
+    AllocTest m_allocTest;
+
+    struct ReuseTest
+    {
+        uint64_t m_frames{0};
+        uint64_t m_recordedFrames{0};
+    };
+    ReuseTest m_reuseTest;
+
+    // a steady frame records only when the render scale or the swapchain
+    // changes, the test tolerates one frame in this many
+    static constexpr uint64_t REUSE_TEST_RECORDED_SHARE = 10;
+
+    // enough frames to fill the pools, the arena and every reused vector
+    static constexpr uint64_t ALLOC_TEST_WARMUP = 240;
+    static constexpr std::size_t TITLE_SIZE = 512;
 };
 
 namespace std
@@ -268,12 +732,81 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
         const VkAllocationCallbacks *pAllocator);
 
 
-int main()
+// Every C++ heap allocation of the process is counted for --alloc-test. C
+// allocations of GLFW and of drivers that bypass the callbacks are not seen.
+static std::atomic<uint64_t> s_heapAllocations{0};
+
+void *operator new(std::size_t size)
+{
+    s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc((0 == size) ? 1 : size))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = (((0 == size) ? 1 : size) + align - 1) & ~(align - 1);
+    if (void *memory = std::aligned_alloc(align, rounded))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
 {
-    TriangleApp app;
+    std::free(memory);
+}
 
+int main(int argc, char **argv)
+{
     try
     {
+        TriangleApp::Options options = TriangleApp::ParseOptions(argc, argv);
+        if (options.m_occlusionBenchmark)
+        {
+            TriangleApp::BenchmarkOcclusion();
+            return EXIT_SUCCESS;
+        }
+        if (options.m_transformBenchmark)
+        {
+            TriangleApp::BenchmarkTransforms();
+            return EXIT_SUCCESS;
+        }
+        if (options.m_sceneBenchmark)
+        {
+            TriangleApp::BenchmarkScene();
+            return EXIT_SUCCESS;
+        }
+        if (options.m_bvhBenchmark)
+        {
+            TriangleApp::BenchmarkBvh();
+            return EXIT_SUCCESS;
+        }
+
+        TriangleApp app(options);
         app.Run();
     } catch (const std::exception& e)
     {
@@ -290,171 +823,768 @@ const std::vector<const char*> TriangleApp::s_validationLayers =
 const std::vector<const char*> TriangleApp::s_deviceExtensions =
                                 {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-inline void TriangleApp::Run()
+TriangleApp::TriangleApp(const Options& options) : 
+    m_options(options),
+    m_requestedSamples(options.m_msaaSamples),
+    m_requestedDynamicResolution(0.0 < options.m_targetFrameMs),
+    m_requestedDepthPrepass(options.m_depthPrepass)
 {
-    InitWindow();
-    InitVulkan();
-    MainLoop();
-    Cleanup();
+    if (0 != m_options.m_resizeBenchmarkFrames)
+    {
+        m_resizeBenchmark = std::make_unique<ResizeBenchmark>();
+        m_resizeBenchmark->m_frameTimes.reserve(m_options.m_resizeBenchmarkFrames);
+    }
 }
 
-void TriangleApp::InitWindow()
+// a loop that threw never reached StopSimulation
+TriangleApp::~TriangleApp()
 {
-    glfwInit();
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-
-    m_window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-    glfwSetWindowUserPointer(m_window, this);
-    glfwSetFramebufferSizeCallback(m_window, &FramebufferResizeCallback);
+    StopSimulation();
 }
 
-void TriangleApp::InitVulkan()
+TriangleApp::Options TriangleApp::ParseOptions(int argc, char **argv)
 {
-    CreateInstance();
-    SetUpDebugMessenger();
-    CreateSurface();
-    PickPhysicalDevice();
-    CreateLogicalDevice();
-    CreateSwapChain();
-    CreateImageViews();
-    CreateRenderPass();
-    CreateDescriptorSetLayout();
-    CreateGraphicsPipeline();
-    CreateCommandPool();
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
-    CreateTextureImage();
-    CreateTextureImageView();
-    CreateTextureSampler();
-    LoadModel();
-    CreateVertexBuffer();
-    CreateIndexBuffer();
-    CreateUniformBuffers();
-    CreateDescriptorPool();
-    CreateDescriptorSets();
-    CreateCommandBuffers();
-    CreateSyncObjects();
-
-}
+    Options options;
 
-void TriangleApp::SetUpDebugMessenger()
-{
-    if (s_enableValidationLayers)
+    for (int i = 1; i < argc; ++i)
     {
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        PopulateDebugMessengerCreateInfo(createInfo);
+        std::string_view arg = argv[i];
 
-        if (CreateDebugUtilsMessengerEXT(m_instance, &createInfo, 
-            nullptr, &m_debugMessenger) != VK_SUCCESS)
+        if (("--bench-resize" == arg) && (i + 1 < argc))
         {
-            throw std::runtime_error("failed to set up debug messenger");
+            options.m_resizeBenchmarkFrames = 
+                        static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (("--msaa" == arg) && (i + 1 < argc))
+        {
+            unsigned long samples = std::stoul(argv[++i]);
+            if ((1 != samples) && (2 != samples) && (4 != samples) && 
+                (8 != samples))
+            {
+                throw std::invalid_argument("msaa must be 1, 2, 4 or 8");
+            }
+            options.m_msaaSamples = static_cast<VkSampleCountFlagBits>(samples);
+        }
+        else if (("--dynamic-resolution" == arg) && (i + 1 < argc))
+        {
+            options.m_targetFrameMs = std::stod(argv[++i]);
+        }
+        else if ("--depth-prepass" == arg)
+        {
+            options.m_depthPrepass = true;
+        }
+        else if ("--cpu-cull" == arg)
+        {
+            options.m_cpuCulling = true;
+        }
+        else if ("--occlusion" == arg)
+        {
+            options.m_occlusionCulling = true;
+        }
+        else if ("--bench-occlusion" == arg)
+        {
+            options.m_occlusionBenchmark = true;
+        }
+        else if ("--bench-transforms" == arg)
+        {
+            options.m_transformBenchmark = true;
+        }
+        else if ("--bench-scene" == arg)
+        {
+            options.m_sceneBenchmark = true;
+        }
+        else if ("--bench-bvh" == arg)
+        {
+            options.m_bvhBenchmark = true;
+        }
+        else if (("--texture-budget" == arg) && (i + 1 < argc))
+        {
+            options.m_textureBudgetMb = 
+                        static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if ("--no-async-compute" == arg)
+        {
+            options.m_asyncCompute = false;
+        }
+        else if ("--record-every-frame" == arg)
+        {
+            options.m_commandReuse = false;
+        }
+        else if ("--bench-mips" == arg)
+        {
+            options.m_mipBenchmark = true;
+        }
+        else if (("--capture" == arg) && (i + 1 < argc))
+        {
+            options.m_capturePath = argv[++i];
+        }
+        else if (("--capture-format" == arg) && (i + 1 < argc))
+        {
+            std::string_view format = argv[++i];
+            if ("png" == format)
+            {
+                options.m_captureFormat = ReadbackRing::Format::PNG;
+            }
+            else if ("raw" == format)
+            {
+                options.m_captureFormat = ReadbackRing::Format::RAW;
+            }
+            else if ("y4m" == format)
+            {
+                options.m_captureFormat = ReadbackRing::Format::Y4M;
+            }
+            else
+            {
+                throw std::invalid_argument("capture format must be png, raw "
+                                            "or y4m");
+            }
+        }
+        else if (("--trace" == arg) && (i + 1 < argc))
+        {
+            options.m_tracePath = argv[++i];
+        }
+        else if (("--tick-rate" == arg) && (i + 1 < argc))
+        {
+            options.m_tickRate = std::stod(argv[++i]);
+            if (!(0.0 < options.m_tickRate))
+            {
+                throw std::invalid_argument("tick rate must be positive");
+            }
+        }
+        else if (("--sim-load" == arg) && (i + 1 < argc))
+        {
+            options.m_simulationLoadMs = std::stod(argv[++i]);
+        }
+        else if (("--alloc-test" == arg) && (i + 1 < argc))
+        {
+            options.m_allocTestFrames = 
+                        static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (("--reuse-test" == arg) && (i + 1 < argc))
+        {
+            options.m_reuseTestFrames = 
+                        static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else
+        {
+            throw std::invalid_argument("unknown option: " + std::string(arg));
         }
     }
+
+    return options;
 }
 
-void TriangleApp::CreateInstance()
+// Rasterizes random occluder triangles and queries random boxes with every
+// instruction set the CPU has, single threaded and on the workers.
+void TriangleApp::BenchmarkOcclusion()
 {
-    if (s_enableValidationLayers && !CheckValidationLayerSupport())
-    {
-        throw std::runtime_error("validation layers requested, but not available");
-    }
-
-    VkApplicationInfo appInfo{};
-    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.pNext = nullptr;
-    appInfo.pApplicationName = "Vulkan Triangle";
-    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.pEngineName = "No Engine";
-    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
-    
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = 
-    glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    constexpr uint32_t TRIANGLES = 1 << 16;
+    constexpr uint32_t QUERIES = 1 << 20;
+    constexpr uint32_t ITERATIONS = 32;
 
-    auto extensions = GetRequiredExtensions(glfwExtensions, glfwExtensionCount);
-    
-    VkInstanceCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    createInfo.pApplicationInfo = &appInfo;
-    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-    if (s_enableValidationLayers)
-    {
-        createInfo.enabledLayerCount = static_cast<uint32_t>
-                                        (s_validationLayers.size());
-        createInfo.ppEnabledLayerNames = s_validationLayers.data();
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
 
-        PopulateDebugMessengerCreateInfo(debugCreateInfo);
-        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
-    }
-    else
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i < TRIANGLES; ++i)
     {
-        createInfo.enabledLayerCount = 0;
-        createInfo.pNext = nullptr;
+        glm::vec3 center(position(random), position(random), position(random));
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            indices.push_back(static_cast<uint32_t>(positions.size()));
+            positions.push_back(center + glm::vec3(offset(random), 
+                                    offset(random), offset(random)));
+        }
     }
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-    createInfo.ppEnabledExtensionNames = extensions.data();
 
-    if (!CheckExstensions(glfwExtensions, glfwExtensionCount))
+    std::vector<glm::vec3> boxes;
+    for (uint32_t i = 0; i < QUERIES; ++i)
     {
-        throw std::runtime_error("not all extensions are supported");
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extent(std::abs(offset(random)));
+        boxes.push_back(center - extent);
+        boxes.push_back(center + extent);
     }
 
-    if (VK_SUCCESS != vkCreateInstance(&createInfo, nullptr, &m_instance))
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 2.0f, NEAR_PLANE, 
+                                        FAR_PLANE);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -8.0f, 0.0f), 
+                        glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 modelViewProj = proj * view;
+
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    auto best = OcclusionCuller::DetectIsa();
+    for (int isa = 0; isa <= static_cast<int>(best); ++isa)
     {
-        throw std::runtime_error("failed to create instance");
-    }
+        for (uint32_t workers : {0u, threads})
+        {
+            OcclusionCuller culler;
+            culler.Create(workers, static_cast<OcclusionCuller::Isa>(isa));
+            culler.SetOccluders(positions, indices);
 
-}
+            culler.Render(modelViewProj);
+            culler.Wait();
 
-void TriangleApp::CreateSurface()
-{
-    if (VK_SUCCESS != glfwCreateWindowSurface(m_instance, m_window, 
-                                                nullptr, &m_surface))
-    {
-        throw std::runtime_error("failed to create window surface");
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                culler.Render(modelViewProj);
+                culler.Wait();
+            }
+            auto mid = std::chrono::steady_clock::now();
+
+            uint32_t visible = 0;
+            for (uint32_t i = 0; i < QUERIES; ++i)
+            {
+                visible += culler.IsVisible(boxes[2 * i], boxes[2 * i + 1]) ? 
+                            1 : 0;
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            double rasterSeconds = 
+                        std::chrono::duration<double>(mid - start).count();
+            double querySeconds = 
+                        std::chrono::duration<double>(end - mid).count();
+            std::cout << "occlusion " << 
+            OcclusionCuller::GetIsaName(culler.GetIsa()) << " workers " << 
+            workers << ": " << static_cast<double>(TRIANGLES) * ITERATIONS / 
+            rasterSeconds / 1e6 << " Mtri/s, " << QUERIES / querySeconds / 1e6 << 
+            " Mqueries/s, visible " << visible << "/" << QUERIES << std::endl;
+        }
     }
 }
 
-bool TriangleApp::CheckExstensions(const char **glfwExtensions, 
-                                    uint32_t glfwExtensionCount)
+void TriangleApp::BenchmarkTransforms()
 {
-    uint32_t extensionCount = 0;
-    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
-    std::vector<VkExtensionProperties> supportedExtensions(extensionCount);
-    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, 
-                                            supportedExtensions.data());
-    std::cout << "Available extensions " << extensionCount << ":" << std::endl;
+    constexpr uint32_t ITERATIONS = 16;
 
-    for (const auto& extension : supportedExtensions)
-    {
-        std::cout << '\t' << extension.extensionName << '\n';
-    }
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> size(0.5f, 2.0f);
 
-    for (uint32_t i = 0; i < glfwExtensionCount; ++i)
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 2.0f, NEAR_PLANE, 
+                                        FAR_PLANE);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -8.0f, 0.0f), 
+                        glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 viewProj = proj * view;
+
+    for (uint32_t objects : {100000u, 1000000u})
     {
-        if (std::find_if(supportedExtensions.begin(), supportedExtensions.end(),
-            [glfwExtensions, i](const auto& extension)
-            {
-                return (0 == std::strcmp(extension.extensionName, 
-                                        glfwExtensions[i]));
-            })  == supportedExtensions.end())
+        TransformSystem transforms;
+        transforms.Reserve(objects);
+        for (uint32_t i = 0; i < objects; ++i)
         {
-            return false;
+            glm::quat rotation = glm::normalize(glm::quat(component(random), 
+                        component(random), component(random), 
+                        component(random)));
+            transforms.Add(glm::vec3(position(random), position(random), 
+                            position(random)), rotation, 
+                            glm::vec3(size(random), size(random), 
+                            size(random)));
         }
-    }
 
-    std::cout << "All " << glfwExtensionCount << 
-    " GLFW extensions are supported" << std::endl;
+        std::vector<TransformSystem::Instance> reference(objects);
+        std::vector<TransformSystem::Instance> instances(objects);
+        auto best = TransformSystem::DetectIsa();
+        for (int isa = 0; isa <= static_cast<int>(best); ++isa)
+        {
+            transforms.SetIsa(static_cast<TransformSystem::Isa>(isa));
+            auto& output = (0 == isa) ? reference : instances;
+            transforms.Compose(viewProj, output.data(), 0, objects);
 
-    return true;
-}
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                transforms.Compose(viewProj, output.data(), 0, objects);
+            }
+            auto end = std::chrono::steady_clock::now();
 
-void TriangleApp::PickPhysicalDevice()
-{
+            float error = 0.0f;
+            const float *expected = &reference[0].m_world[0][0];
+            const float *actual = &output[0].m_world[0][0];
+            for (std::size_t i = 0; i < objects * 32ull; ++i)
+            {
+                error = std::max(error, std::abs(expected[i] - actual[i]));
+            }
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double perObject = seconds / ITERATIONS / objects;
+            std::cout << "transforms " << 
+            TransformSystem::GetIsaName(transforms.GetIsa()) << " " << 
+            objects << " objects: " << perObject * 1e9 << " ns/object, " << 
+            1e-6 / perObject << " Mobjects/s, max error " << error << 
+            std::endl;
+        }
+    }
+}
+
+// A forest of 10000 trees with 9 children and 90 grandchildren each. Every
+// case moves its nodes and times the Update() that follows.
+void TriangleApp::BenchmarkScene()
+{
+    constexpr uint32_t TREES = 10000;
+    constexpr uint32_t CHILDREN = 9;
+    constexpr uint32_t GRANDCHILDREN = 10;
+    constexpr uint32_t ITERATIONS = 8;
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+    glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+    SceneGraph::Bounds bounds{glm::vec3(-0.5f), glm::vec3(0.5f)};
+
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t workers : {0u, threads - 1})
+    {
+        SceneGraph scene;
+        scene.Create(workers);
+        scene.Reserve(TREES * (1 + CHILDREN * (1 + GRANDCHILDREN)));
+
+        std::vector<SceneGraph::NodeId> roots;
+        for (uint32_t tree = 0; tree < TREES; ++tree)
+        {
+            glm::vec3 offset(position(random) * 100.0f, 
+                        position(random) * 100.0f, position(random) * 100.0f);
+            SceneGraph::NodeId root = scene.Add(SceneGraph::NO_PARENT, offset, 
+                                        identity, glm::vec3(1.0f), bounds);
+            roots.push_back(root);
+            for (uint32_t child = 0; child < CHILDREN; ++child)
+            {
+                SceneGraph::NodeId node = scene.Add(root, glm::vec3(
+                                position(random), position(random), 0.0f), 
+                                identity, glm::vec3(1.0f), bounds);
+                for (uint32_t i = 0; i < GRANDCHILDREN; ++i)
+                {
+                    scene.Add(node, glm::vec3(position(random), 
+                                position(random), position(random)), 
+                                identity, glm::vec3(0.5f), bounds);
+                }
+            }
+        }
+        uint32_t nodes = scene.GetNodeCount();
+
+        auto measure = [&scene, nodes, workers](const char *name, 
+                            const std::vector<SceneGraph::NodeId>& moved)
+        {
+            double seconds = 0.0;
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                for (SceneGraph::NodeId node : moved)
+                {
+                    scene.SetScale(node, glm::vec3(1.0f + 0.01f * i));
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                scene.Update();
+                auto end = std::chrono::steady_clock::now();
+                seconds += std::chrono::duration<double>(end - start).count();
+            }
+
+            std::cout << "scene workers " << workers << " " << name << ": " << 
+            seconds / ITERATIONS * 1e3 << " ms, " << scene.GetUpdatedCount() << 
+            "/" << nodes << " nodes updated" << std::endl;
+        };
+
+        std::vector<SceneGraph::NodeId> someNodes;
+        for (uint32_t i = 0; i < nodes / 100; ++i)
+        {
+            someNodes.push_back(static_cast<SceneGraph::NodeId>(random() % 
+                                                                nodes));
+        }
+        std::vector<SceneGraph::NodeId> someRoots(roots.begin(), 
+                                                roots.begin() + 10);
+
+        scene.Update();
+        measure("static", {});
+        measure("1% of the nodes moved", someNodes);
+        measure("10 trees moved", someRoots);
+        measure("all trees moved", roots);
+    }
+}
+
+// Random boxes in a cube that grows with their count, seen by a camera in
+// front of it. The linear line tests every box against the planes in turn.
+void TriangleApp::BenchmarkBvh()
+{
+    constexpr uint32_t ITERATIONS = 8;
+    constexpr uint32_t RAYS = 10000;
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (uint32_t count : {10000u, 100000u, 1000000u})
+    {
+        float side = 4.0f * std::cbrt(static_cast<float>(count));
+        std::vector<Bvh::Bounds> bounds(count);
+        for (Bvh::Bounds& box : bounds)
+        {
+            glm::vec3 center = glm::vec3(unit(random), unit(random), 
+                                        unit(random)) * side;
+            glm::vec3 extent(0.1f + unit(random));
+            box = {center - extent, center + extent};
+        }
+
+        glm::vec3 target(side * 0.5f);
+        glm::mat4 proj = glm::perspective(glm::radians(60.0f), 2.0f, 
+                                            NEAR_PLANE, side);
+        glm::mat4 view = glm::lookAt(target - glm::vec3(0.0f, side, 0.0f), 
+                                    target, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::vec4 planes[6];
+        MakeFrustumPlanes(proj * view, planes);
+
+        for (uint32_t workers : {0u, threads - 1})
+        {
+            Bvh bvh;
+            bvh.Create(workers);
+            auto start = std::chrono::steady_clock::now();
+            bvh.Build(bounds);
+            auto end = std::chrono::steady_clock::now();
+            std::cout << "bvh " << count << " boxes, workers " << workers << 
+            ": build " << std::chrono::duration<double, std::milli>(end - 
+            start).count() << " ms, " << bvh.GetNodeCount() << " nodes" << 
+            std::endl;
+        }
+
+        Bvh bvh;
+        bvh.Create(0);
+        bvh.Build(bounds);
+
+        std::vector<Bvh::Bounds> moved(bounds);
+        double refitSeconds = 0.0;
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            for (Bvh::Bounds& box : moved)
+            {
+                glm::vec3 offset = glm::vec3(unit(random), unit(random), 
+                                            unit(random)) - glm::vec3(0.5f);
+                box.m_min += offset;
+                box.m_max += offset;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            bvh.Refit(moved);
+            auto end = std::chrono::steady_clock::now();
+            refitSeconds += std::chrono::duration<double>(end - start).count();
+        }
+        bvh.Build(bounds);
+        std::cout << "bvh " << count << " boxes: refit " << 
+        refitSeconds / ITERATIONS * 1e3 << " ms" << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        uint32_t linearVisible = 0;
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            linearVisible = 0;
+            for (const Bvh::Bounds& box : bounds)
+            {
+                glm::vec3 center = (box.m_min + box.m_max) * 0.5f;
+                glm::vec3 extent = (box.m_max - box.m_min) * 0.5f;
+                bool visible = true;
+                for (const glm::vec4& plane : planes)
+                {
+                    visible = visible && (glm::dot(glm::vec3(plane), center) + 
+                        plane.w >= -glm::dot(glm::abs(glm::vec3(plane)), 
+                                            extent));
+                }
+                linearVisible += visible ? 1 : 0;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "bvh " << count << " boxes: linear cull " << 
+        std::chrono::duration<double, std::milli>(end - start).count() / 
+        ITERATIONS << " ms, visible " << linearVisible << std::endl;
+
+        std::vector<uint32_t> visible;
+        for (int isa = 0; isa <= static_cast<int>(Bvh::DetectIsa()); ++isa)
+        {
+            bvh.SetIsa(static_cast<Bvh::Isa>(isa));
+            start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                bvh.Cull(planes, visible);
+            }
+            end = std::chrono::steady_clock::now();
+            std::cout << "bvh " << count << " boxes: " << 
+            Bvh::GetIsaName(bvh.GetIsa()) << " cull " << 
+            std::chrono::duration<double, std::milli>(end - start).count() / 
+            ITERATIONS << " ms, visible " << visible.size() << std::endl;
+        }
+
+        uint32_t hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < RAYS; ++i)
+        {
+            glm::vec3 origin = glm::vec3(unit(random), unit(random), 
+                                        unit(random)) * side;
+            glm::vec3 direction = glm::vec3(unit(random), unit(random), 
+                                        unit(random)) - glm::vec3(0.5f);
+            Bvh::Hit hit = bvh.Raycast(origin, direction, 
+                                    std::numeric_limits<float>::max());
+            hits += (Bvh::NO_HIT != hit.m_primitive) ? 1 : 0;
+        }
+        end = std::chrono::steady_clock::now();
+        std::cout << "bvh " << count << " boxes: " << 
+        std::chrono::duration<double, std::nano>(end - start).count() / RAYS << 
+        " ns/ray, " << hits << "/" << RAYS << " rays hit" << std::endl;
+    }
+}
+
+inline void TriangleApp::Run()
+{
+    PROFILE_THREAD("main");
+    m_startTime = std::chrono::steady_clock::now();
+    InitVulkan();
+    if (m_options.m_mipBenchmark)
+    {
+        BenchmarkMips();
+    }
+    else
+    {
+        MainLoop();
+    }
+    Cleanup();
+
+    if (!m_options.m_tracePath.empty())
+    {
+        WriteTrace();
+    }
+    ReportAllocTest();
+    ReportReuseTest();
+}
+
+void TriangleApp::InitWindow()
+{
+    PROFILE_FUNCTION();
+    glfwInit();
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+    m_window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    glfwSetWindowUserPointer(m_window, this);
+    glfwSetFramebufferSizeCallback(m_window, &FramebufferResizeCallback);
+    glfwSetKeyCallback(m_window, &KeyCallback);
+    glfwSetMouseButtonCallback(m_window, &MouseButtonCallback);
+}
+
+// Initialization as a dependency graph. The model and its textures only need
+// the CPU, so they are parsed and decoded on workers from the start while the
+// window, the device and the pipelines are created in order on this thread.
+void TriangleApp::InitVulkan()
+{
+    PROFILE_FUNCTION();
+    using Affinity = TaskGraph::Affinity;
+    TaskGraph graph;
+
+    TaskGraph::TaskId model = graph.Add("LoadModel", Affinity::WORKER, [this]
+    {
+        LoadModel();
+        CollectTexturePaths();
+    });
+    TaskGraph::TaskId occlusion = graph.Add("CreateOcclusionCuller", 
+                Affinity::WORKER, [this] { CreateOcclusionCuller(); }, {model});
+    graph.Add("CreateScene", Affinity::WORKER, [this] { CreateScene(); }, 
+                {model});
+
+    // the texture count is known once the model is parsed, each task decodes
+    // every n-th texture
+    uint32_t workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    std::vector<TaskGraph::TaskId> decodes;
+    for (uint32_t slot = 0; slot < workers; ++slot)
+    {
+        decodes.push_back(graph.Add("DecodeImage", Affinity::WORKER, 
+                                    [this, slot, workers]
+        {
+            for (std::size_t i = slot; i < m_texturePaths.size(); i += workers)
+            {
+                m_decodedImages[i] = DecodeImage(m_texturePaths[i]);
+            }
+        }, {model}));
+    }
+
+    TaskGraph::TaskId previous = 0;
+    bool first = true;
+    auto addStep = [this, &graph, &previous, &first](const char *name,
+            std::function<void(TriangleApp&)> step, 
+            std::vector<TaskGraph::TaskId> after)
+    {
+        if (!first)
+        {
+            after.push_back(previous);
+        }
+        previous = graph.Add(name, Affinity::MAIN, [this, step]
+        {
+            step(*this);
+        }, after);
+        first = false;
+    };
+
+    addStep("InitWindow", &TriangleApp::InitWindow, {});
+    addStep("CreateInstance", &TriangleApp::CreateInstance, {});
+    addStep("SetUpDebugMessenger", &TriangleApp::SetUpDebugMessenger, {});
+    addStep("CreateSurface", &TriangleApp::CreateSurface, {});
+    addStep("PickPhysicalDevice", &TriangleApp::PickPhysicalDevice, {});
+    addStep("CreateLogicalDevice", &TriangleApp::CreateLogicalDevice, {});
+    addStep("CreatePipelineCache", &TriangleApp::CreatePipelineCache, {});
+    addStep("CreateQueryPool", &TriangleApp::CreateQueryPool, {});
+    addStep("CreateSwapChain", [](TriangleApp& app)
+    {
+        app.CreateSwapChain();
+    }, {});
+    addStep("CreateImageViews", &TriangleApp::CreateImageViews, {});
+    addStep("CreateRenderPass", &TriangleApp::CreateRenderPass, {});
+    addStep("CreateDescriptorSetLayout", 
+            &TriangleApp::CreateDescriptorSetLayout, {});
+    addStep("CreateBindlessTable", &TriangleApp::CreateBindlessTable, {});
+    addStep("CreateGraphicsPipeline", &TriangleApp::CreateGraphicsPipeline, {});
+    addStep("CreateUpscalePass", &TriangleApp::CreateUpscalePass, {});
+    addStep("CreateUpscaleDescriptors", 
+            &TriangleApp::CreateUpscaleDescriptors, {});
+    addStep("CreateCommandPool", &TriangleApp::CreateCommandPool, {});
+    addStep("CreateMipGenerator", &TriangleApp::CreateMipGenerator, {});
+    addStep("CreateReadback", &TriangleApp::CreateReadback, {});
+    addStep("CreateSyncObjects", &TriangleApp::CreateSyncObjects, {});
+    addStep("CreateRenderGraph", &TriangleApp::CreateRenderGraph, {});
+    addStep("CreateFramebuffers", &TriangleApp::CreateFramebuffers, {});
+    addStep("CreateGeometryPool", &TriangleApp::CreateGeometryPool, {});
+    addStep("CreateUniformBuffers", &TriangleApp::CreateUniformBuffers, {});
+    addStep("CreateDrawBuffers", &TriangleApp::CreateDrawBuffers, {});
+    addStep("CreateCommandBuffers", &TriangleApp::CreateCommandBuffers, {});
+    addStep("CreateTextures", &TriangleApp::CreateTextures, decodes);
+    addStep("CreateTextureSampler", &TriangleApp::CreateTextureSampler, {});
+    addStep("CreateMaterials", &TriangleApp::CreateMaterials, {});
+    // the occluders are picked before the meshes are rebased into the pool
+    addStep("UploadModel", &TriangleApp::UploadModel, {occlusion});
+    addStep("CreateCullPipeline", &TriangleApp::CreateCullPipeline, {});
+    addStep("CreateDescriptorPool", &TriangleApp::CreateDescriptorPool, {});
+    addStep("CreateDescriptorSets", &TriangleApp::CreateDescriptorSets, {});
+
+    graph.Run(workers);
+    graph.Report(std::cout);
+}
+
+void TriangleApp::SetUpDebugMessenger()
+{
+    PROFILE_FUNCTION();
+    if (s_enableValidationLayers)
+    {
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        PopulateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(m_instance, &createInfo, 
+            m_allocator, &m_debugMessenger) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to set up debug messenger");
+        }
+    }
+}
+
+void TriangleApp::CreateInstance()
+{
+    PROFILE_FUNCTION();
+    if (s_enableValidationLayers && !CheckValidationLayerSupport())
+    {
+        throw std::runtime_error("validation layers requested, but not available");
+    }
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pNext = nullptr;
+    appInfo.pApplicationName = "Vulkan Triangle";
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = "No Engine";
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.apiVersion = VK_API_VERSION_1_3;
+    
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions = 
+    glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+    auto extensions = GetRequiredExtensions(glfwExtensions, glfwExtensionCount);
+    
+    VkInstanceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+    if (s_enableValidationLayers)
+    {
+        createInfo.enabledLayerCount = static_cast<uint32_t>
+                                        (s_validationLayers.size());
+        createInfo.ppEnabledLayerNames = s_validationLayers.data();
+
+        PopulateDebugMessengerCreateInfo(debugCreateInfo);
+        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+    }
+    else
+    {
+        createInfo.enabledLayerCount = 0;
+        createInfo.pNext = nullptr;
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
+
+    if (!CheckExstensions(glfwExtensions, glfwExtensionCount))
+    {
+        throw std::runtime_error("not all extensions are supported");
+    }
+
+    if (VK_SUCCESS != vkCreateInstance(&createInfo, m_allocator, &m_instance))
+    {
+        throw std::runtime_error("failed to create instance");
+    }
+
+}
+
+void TriangleApp::CreateSurface()
+{
+    PROFILE_FUNCTION();
+    if (VK_SUCCESS != glfwCreateWindowSurface(m_instance, m_window, 
+                                                m_allocator, &m_surface))
+    {
+        throw std::runtime_error("failed to create window surface");
+    }
+}
+
+bool TriangleApp::CheckExstensions(const char **glfwExtensions, 
+                                    uint32_t glfwExtensionCount)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> supportedExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, 
+                                            supportedExtensions.data());
+    std::cout << "Available extensions " << extensionCount << ":" << std::endl;
+
+    for (const auto& extension : supportedExtensions)
+    {
+        std::cout << '\t' << extension.extensionName << '\n';
+    }
+
+    for (uint32_t i = 0; i < glfwExtensionCount; ++i)
+    {
+        if (std::find_if(supportedExtensions.begin(), supportedExtensions.end(),
+            [glfwExtensions, i](const auto& extension)
+            {
+                return (0 == std::strcmp(extension.extensionName, 
+                                        glfwExtensions[i]));
+            })  == supportedExtensions.end())
+        {
+            return false;
+        }
+    }
+
+    std::cout << "All " << glfwExtensionCount << 
+    " GLFW extensions are supported" << std::endl;
+
+    return true;
+}
+
+void TriangleApp::PickPhysicalDevice()
+{
+    PROFILE_FUNCTION();
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
     if (0 == deviceCount)
@@ -476,11 +1606,43 @@ void TriangleApp::PickPhysicalDevice()
     if (deviceMap.rbegin()->first > 0)
     {
         m_physicalDevice = deviceMap.rbegin()->second;
-        m_msaaSamples = GetMaxUsableSampleCount();
+        m_msaaSamples = ChooseSampleCount(m_requestedSamples);
+        m_dynamicResolution = m_requestedDynamicResolution;
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(m_physicalDevice, &features);
+        m_multiDrawIndirect = (VK_TRUE == features.multiDrawIndirect);
+        m_pipelineStatistics = (VK_TRUE == features.pipelineStatisticsQuery);
+        m_depthPrepass = m_requestedDepthPrepass;
+        m_memoryBudget = HasDeviceExtension(m_physicalDevice, 
+                                        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_calibratedTimestamps = (!m_options.m_tracePath.empty() || 
+                                m_options.m_asyncCompute) && 
+                                SupportsCalibratedTimestamps(m_physicalDevice);
+        m_computeMips = MipGenerator::IsSupported(m_physicalDevice);
         VkPhysicalDeviceProperties properties;
         vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+        // software rasterizers cull faster on the CPU than in an emulated
+        // compute shader
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = 
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+        // occlusion queries run on the CPU before recording, so they need
+        // the CPU culling path
+        m_gpuCulling = !m_options.m_cpuCulling && 
+                !m_options.m_occlusionCulling && m_multiDrawIndirect &&
+                (VK_TRUE == vulkan12Features.drawIndirectCount) &&
+                (VK_PHYSICAL_DEVICE_TYPE_CPU != properties.deviceType);
         std::cout << "Selected device: " << properties.deviceName << std::endl;
-        std::cout << "Max samples: " << m_msaaSamples << std::endl;
+        std::cout << "Samples: " << m_msaaSamples << std::endl;
+        std::cout << "Meshlet culling: " << (m_gpuCulling ? "gpu" : "cpu") << 
+        std::endl;
+        std::cout << "Mip generation: " << (m_computeMips ? "compute" : "blit") <<
+        std::endl;
     }
     else
     {
@@ -490,6 +1652,7 @@ void TriangleApp::PickPhysicalDevice()
 
 void TriangleApp::CreateLogicalDevice()
 {
+    PROFILE_FUNCTION();
     QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -497,6 +1660,14 @@ void TriangleApp::CreateLogicalDevice()
     {indices.m_graphicsFamily.value(), indices.m_presentFamily.value()};
     float queuePriority = 1.0f;
 
+    // only the GPU culling pass runs on the compute queue so far
+    m_asyncCompute = m_options.m_asyncCompute && m_gpuCulling && 
+                    indices.m_computeFamily.has_value();
+    if (m_asyncCompute)
+    {
+        uniqueQueueFamilies.insert(indices.m_computeFamily.value());
+    }
+
     for (uint32_t queueFamily : uniqueQueueFamilies)
     {
         VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -510,16 +1681,46 @@ void TriangleApp::CreateLogicalDevice()
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_FALSE;
+    deviceFeatures.multiDrawIndirect = m_multiDrawIndirect ? VK_TRUE : VK_FALSE;
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+    deviceFeatures.pipelineStatisticsQuery = 
+                                m_pipelineStatistics ? VK_TRUE : VK_FALSE;
+    deviceFeatures.shaderStorageImageArrayDynamicIndexing = 
+                                m_computeMips ? VK_TRUE : VK_FALSE;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+    vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+    vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan12Features.drawIndirectCount = m_gpuCulling ? VK_TRUE : VK_FALSE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13Features.synchronization2 = VK_TRUE;
+    vulkan12Features.pNext = &vulkan13Features;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan12Features;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>
                                         (queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>
-                                        (s_deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = s_deviceExtensions.data();
+    std::vector<const char*> extensions(s_deviceExtensions);
+    if (m_memoryBudget)
+    {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    if (m_calibratedTimestamps)
+    {
+        extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (s_enableValidationLayers)
     {
@@ -533,19 +1734,46 @@ void TriangleApp::CreateLogicalDevice()
     }
 
     if (VK_SUCCESS != vkCreateDevice(m_physicalDevice, &createInfo, 
-                                    nullptr, &m_device))
+                                    m_allocator, &m_device))
     {
         throw std::runtime_error("failed to create logical device");
     }
 
+    m_deletionQueue.SetDevice(m_device);
+    m_deletionQueue.SetAllocator(m_allocator);
+    m_memory.Create(m_physicalDevice, m_device, m_memoryBudget, m_allocator);
+    if (m_calibratedTimestamps)
+    {
+        m_getCalibratedTimestamps = PFN_vkGetCalibratedTimestampsEXT(
+            vkGetDeviceProcAddr(m_device, "vkGetCalibratedTimestampsEXT"));
+    }
+    m_deletionQueue.SetFreeMemory([this](VkDeviceMemory memory)
+    {
+        m_memory.Free(memory);
+    });
+
     vkGetDeviceQueue(m_device, indices.m_graphicsFamily.value(), 
                         0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, indices.m_presentFamily.value(), 
                         0, &m_presentQueue);
+
+    // without a separate family compute work is recorded into the graphics
+    // command buffer
+    m_computeQueue = m_graphicsQueue;
+    if (m_asyncCompute)
+    {
+        vkGetDeviceQueue(m_device, indices.m_computeFamily.value(), 
+                            0, &m_computeQueue);
+        m_bufferQueueFamilies = {indices.m_graphicsFamily.value(), 
+                                indices.m_computeFamily.value()};
+    }
+    std::cout << "async compute: " << (m_asyncCompute ? "on" : "off") << 
+    std::endl;
 }
 
-void TriangleApp::CreateSwapChain()
+void TriangleApp::CreateSwapChain(VkSwapchainKHR oldSwapChain)
 {
+    PROFILE_FUNCTION();
     SwapChainSupportDetails swapChainSupport = 
                         QuerySwapChainSupport(m_physicalDevice);
     VkSurfaceFormatKHR surfaceFormat = 
@@ -569,6 +1797,12 @@ void TriangleApp::CreateSwapChain()
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (!m_options.m_capturePath.empty() && 
+        (swapChainSupport.m_capabilities.supportedUsageFlags & 
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
 
     QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
     uint32_t queueFamilyIndices[] = 
@@ -590,10 +1824,10 @@ void TriangleApp::CreateSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = oldSwapChain;
 
     if (VK_SUCCESS != vkCreateSwapchainKHR(m_device, &createInfo, 
-                                            nullptr, &m_swapChain))
+                                            m_allocator, &m_swapChain))
     {
         throw std::runtime_error("failed to create swap chain");
     }
@@ -616,43 +1850,60 @@ void TriangleApp::RecreateSwapChain()
         glfwGetFramebufferSize(m_window, &width, &height);
         glfwWaitEvents();
     }
-    
-    vkDeviceWaitIdle(m_device);
 
-    CleanupSwapChain();
+    auto start = std::chrono::steady_clock::now();
+
+    // frames already submitted keep rendering into the old swapchain, 
+    // its resources are destroyed once those frames have retired
+    VkSwapchainKHR oldSwapChain = m_swapChain;
+    RetireSwapChain();
 
-    CreateSwapChain();
+    CreateSwapChain(oldSwapChain);
     CreateImageViews();
-    CreateColorResources();
-    CreateDepthResources();
+    AllocateRecordedCommands();
+    CreateRenderGraph();
     CreateFramebuffers();
+
+    if (nullptr != m_resizeBenchmark)
+    {
+        ++m_resizeBenchmark->m_recreateCount;
+        m_resizeBenchmark->m_recreateTime += 
+        std::chrono::duration<double, std::milli>
+        (std::chrono::steady_clock::now() - start).count();
+    }
 }
 
-void TriangleApp::CleanupSwapChain()
+void TriangleApp::RetireSwapChain()
 {
-    vkDestroyImageView(m_device, m_colorImageView, nullptr);
-    vkDestroyImage(m_device, m_colorImage, nullptr);
-    vkFreeMemory(m_device, m_colorImageMemory, nullptr);
+    uint64_t lastUse = NextTimelineValue();
+
+    m_renderGraph.Reset(m_deletionQueue, lastUse);
 
-    vkDestroyImageView(m_device, m_depthImageView, nullptr);
-    vkDestroyImage(m_device, m_depthImage, nullptr);
-    vkFreeMemory(m_device, m_depthImageMemory, nullptr);
-    
     for (auto framebuffer : m_swapChainFramebuffers)
     {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        m_deletionQueue.Retire(framebuffer, lastUse);
+    }
+
+    for (auto framebuffer : m_upscaleFramebuffers)
+    {
+        m_deletionQueue.Retire(framebuffer, lastUse);
     }
 
     for (VkImageView imageView : m_swapChainImageViews)
     {
-        vkDestroyImageView(m_device, imageView, nullptr);
+        m_deletionQueue.Retire(imageView, lastUse);
     }
-    
-    vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+
+    m_deletionQueue.Retire(m_swapChain, lastUse);
+
+    m_swapChainImageViews.clear();
+    m_swapChainFramebuffers.clear();
+    m_upscaleFramebuffers.clear();
 }
 
 void TriangleApp::CreateImageViews()
 {
+    PROFILE_FUNCTION();
     m_swapChainImageViews.resize(m_swapChainImages.size());
 
     for (std::size_t i = 0; i < m_swapChainImages.size(); ++i)
@@ -665,14 +1916,19 @@ void TriangleApp::CreateImageViews()
 
 void TriangleApp::CreateRenderPass()
 {
+    PROFILE_FUNCTION();
+    bool multisampled = (VK_SAMPLE_COUNT_1_BIT != m_msaaSamples);
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = m_swapChainImageFormat;
     colorAttachment.samples = m_msaaSamples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.storeOp = multisampled ? 
+        VK_ATTACHMENT_STORE_OP_DONT_CARE : // resolved
+        VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
@@ -686,7 +1942,7 @@ void TriangleApp::CreateRenderPass()
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference depthAttachmentRef{};
@@ -700,8 +1956,8 @@ void TriangleApp::CreateRenderPass()
     colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentResolveRef{};
     colorAttachmentResolveRef.attachment = 2;
@@ -712,33 +1968,55 @@ void TriangleApp::CreateRenderPass()
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
-
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-                                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-    std::array<VkAttachmentDescription, 3> attachments = 
-    {colorAttachment, depthAttachment, colorAttachmentResolve};
+    subpass.pResolveAttachments = multisampled ? 
+                                    &colorAttachmentResolveRef : nullptr;
+
+    // the prepass only lays down depth, the color subpass then shades each
+    // covered sample once with an equal depth test
+    VkSubpassDescription prepass{};
+    prepass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    prepass.colorAttachmentCount = 0;
+    prepass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    std::vector<VkSubpassDescription> subpasses = {subpass};
+    std::vector<VkSubpassDependency> dependencies;
+    if (m_depthPrepass)
+    {
+        subpasses.insert(subpasses.begin(), prepass);
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = 0;
+        dependency.dstSubpass = 1;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(dependency);
+    }
+
+    // layout transitions and external dependencies come from the render graph
+
+    std::vector<VkAttachmentDescription> attachments = 
+    {colorAttachment, depthAttachment};
+    if (multisampled)
+    {
+        attachments.push_back(colorAttachmentResolve);
+    }
 
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
     renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+    renderPassInfo.pSubpasses = subpasses.data();
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (VK_SUCCESS != vkCreateRenderPass(m_device, &renderPassInfo, 
-                                        nullptr, &m_renderPass))
+                                        m_allocator, &m_renderPass))
     {
         throw std::runtime_error("failed to create render pass");
     }
@@ -746,6 +2024,7 @@ void TriangleApp::CreateRenderPass()
 
 void TriangleApp::CreateDescriptorSetLayout()
 {
+    PROFILE_FUNCTION();
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -753,15 +2032,16 @@ void TriangleApp::CreateDescriptorSetLayout()
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutBinding drawDataLayoutBinding{};
+    drawDataLayoutBinding.binding = 1;
+    drawDataLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    drawDataLayoutBinding.descriptorCount = 1;
+    drawDataLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    drawDataLayoutBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings =
-    {uboLayoutBinding, samplerLayoutBinding};
+    // textures and materials live in the bindless set
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = 
+    {uboLayoutBinding, drawDataLayoutBinding};
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -769,7 +2049,7 @@ void TriangleApp::CreateDescriptorSetLayout()
     layoutInfo.pBindings = bindings.data();
 
     if (VK_SUCCESS != vkCreateDescriptorSetLayout(m_device, &layoutInfo,
-                                            nullptr, &m_descriptorSetLayout))
+                                m_allocator, &m_descriptorSetLayout))
     {
         throw std::runtime_error("failed to create descriptor set layout");
     }
@@ -777,6 +2057,7 @@ void TriangleApp::CreateDescriptorSetLayout()
 
 void TriangleApp::CreateGraphicsPipeline()
 {
+    PROFILE_FUNCTION();
     auto vertShaderCode = ReadFile("shaders/vert.spv");
     auto fragShaderCode = ReadFile("shaders/frag.spv");
 
@@ -873,13 +2154,16 @@ void TriangleApp::CreateGraphicsPipeline()
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    std::array<VkDescriptorSetLayout, 2> setLayouts = 
+    {m_descriptorSetLayout, m_bindless.GetLayout()};
+
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
     pipelineLayoutInfo.pushConstantRangeCount = 0;
     pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
     if (VK_SUCCESS != vkCreatePipelineLayout(m_device, &pipelineLayoutInfo,
-                                        nullptr, &m_pipelineLayout))
+                                        m_allocator, &m_pipelineLayout))
     {
         throw std::runtime_error("failed to create pipeline layout");
     }
@@ -887,8 +2171,9 @@ void TriangleApp::CreateGraphicsPipeline()
     VkPipelineDepthStencilStateCreateInfo depthStencil{};
     depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthWriteEnable = m_depthPrepass ? VK_FALSE : VK_TRUE;
+    depthStencil.depthCompareOp = m_depthPrepass ? VK_COMPARE_OP_EQUAL : 
+                                                    VK_COMPARE_OP_LESS;
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.minDepthBounds = 0.0f;
     depthStencil.maxDepthBounds = 1.0f;
@@ -910,338 +2195,1768 @@ void TriangleApp::CreateGraphicsPipeline()
     pipelineInfo.pDynamicState = &dynamicStateInfo;
     pipelineInfo.layout = m_pipelineLayout;
     pipelineInfo.renderPass = m_renderPass;
-    pipelineInfo.subpass = 0;
+    pipelineInfo.subpass = m_depthPrepass ? 1 : 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (VK_SUCCESS != vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE,
-                1, &pipelineInfo, nullptr, &m_graphicsPipeline))
+    if (VK_SUCCESS != vkCreateGraphicsPipelines(m_device, m_pipelineCache,
+                1, &pipelineInfo, m_allocator, &m_graphicsPipeline))
     {
         throw std::runtime_error("failed to create graphics pipeline");
     }
 
-    vkDestroyShaderModule(m_device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(m_device, vertShaderModule, nullptr);
-}
-
-void TriangleApp::CreateFramebuffers()
-{
-    m_swapChainFramebuffers.resize(m_swapChainImageViews.size());
-
-    for (std::size_t i = 0; i < m_swapChainImageViews.size(); ++i)
-    {
-        std::array<VkImageView, 3> attachments = 
-        {m_colorImageView, m_depthImageView, m_swapChainImageViews[i]};
-        
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = m_renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = m_swapChainExtent.width;
-        framebufferInfo.height = m_swapChainExtent.height;
-        framebufferInfo.layers = 1;
-
-        if (VK_SUCCESS != vkCreateFramebuffer(m_device, &framebufferInfo,
-                                nullptr, &m_swapChainFramebuffers[i]))
-        {
-            throw std::runtime_error("failed to create framebuffer");
-        }
-    }
-}
-
-void TriangleApp::CreateCommandPool()
-{
-    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevice);
-
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.m_graphicsFamily.value();
+    vkDestroyShaderModule(m_device, fragShaderModule, m_allocator);
+    vkDestroyShaderModule(m_device, vertShaderModule, m_allocator);
 
-    if (VK_SUCCESS != vkCreateCommandPool(m_device, &poolInfo, 
-                                    nullptr, &m_commandPool))
+    m_prepassPipeline = VK_NULL_HANDLE;
+    if (!m_depthPrepass)
     {
-        throw std::runtime_error("failed to create command pool");
+        return;
     }
-}
 
-void TriangleApp::CreateColorResources()
-{
-    VkFormat colorFormat = m_swapChainImageFormat;
+    // depth only: positions from their own stream, no fragment shader and no
+    // color attachment, both vertex shaders declare gl_Position invariant so
+    // the equal test in the color subpass matches exactly
+    auto prepassShaderCode = ReadFile("shaders/prepass_vert.spv");
+    VkShaderModule prepassShaderModule = CreateShaderModule(prepassShaderCode);
+    vertStageInfo.module = prepassShaderModule;
 
-    CreateImage(m_swapChainExtent.width, m_swapChainExtent.height, 1,
-                m_msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | 
-                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_colorImage, 
-                m_colorImageMemory);
-    m_colorImageView = CreateImageView(m_colorImage, colorFormat, 
-                                        VK_IMAGE_ASPECT_COLOR_BIT, 1);
-}
+    VkVertexInputBindingDescription positionBinding{};
+    positionBinding.binding = 0;
+    positionBinding.stride = GeometryPool::POSITION_STRIDE;
+    positionBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-void TriangleApp::CreateDepthResources()
-{
-    VkFormat depthFormat = FindDepthFormat();
+    VkVertexInputAttributeDescription positionAttribute{};
+    positionAttribute.binding = 0;
+    positionAttribute.location = 0;
+    positionAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+    positionAttribute.offset = 0;
 
-    CreateImage(m_swapChainExtent.width, m_swapChainExtent.height, 1, 
-                m_msaaSamples ,depthFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                m_depthImage, m_depthImageMemory);
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &positionBinding;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexAttributeDescriptions = &positionAttribute;
 
-    m_depthImageView = CreateImageView(m_depthImage, depthFormat, 
-                                        VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    colorBlending.attachmentCount = 0;
+    colorBlending.pAttachments = nullptr;
 
-}
+    pipelineInfo.stageCount = 1;
+    pipelineInfo.pStages = &vertStageInfo;
+    pipelineInfo.subpass = 0;
 
-void TriangleApp::CreateTextureImage()
-{
-    int texWidth = 0, texHeight = 0, texChannels = 0;
-    stbi_uc *pixels = stbi_load(TEXTURE_PATH.data(), &texWidth, &texHeight,
-                            &texChannels, STBI_rgb_alpha);
-    if (nullptr == pixels)
+    if (VK_SUCCESS != vkCreateGraphicsPipelines(m_device, m_pipelineCache,
+                1, &pipelineInfo, m_allocator, &m_prepassPipeline))
     {
-        throw std::runtime_error("failed to load texture image");
+        throw std::runtime_error("failed to create depth prepass pipeline");
     }
 
-    m_mipLevels = static_cast<uint32_t>(
-                    std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-    VkBuffer stagingBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    vkDestroyShaderModule(m_device, prepassShaderModule, m_allocator);
+}
 
-    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer, stagingBufferMemory);
+// the upscale runs as a fullscreen fragment pass since sRGB swapchain images
+// usually cannot be bound as storage images
+void TriangleApp::CreateUpscalePass()
+{
+    PROFILE_FUNCTION();
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = m_swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    void *data = nullptr;
-    vkMapMemory(m_device, stagingBufferMemory, 0, imageSize, 0, &data);
-    std::memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(m_device, stagingBufferMemory);
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    stbi_image_free(pixels);
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
 
-    CreateImage(texWidth, texHeight, m_mipLevels, VK_SAMPLE_COUNT_1_BIT,
-                VK_FORMAT_R8G8B8A8_SRGB, 
-                VK_IMAGE_TILING_OPTIMAL, 
-                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | 
-                VK_IMAGE_USAGE_SAMPLED_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_textureImage, 
-                m_textureImageMemory);
-    TransitionImageLayout(m_textureImage, VK_FORMAT_R8G8B8A8_SRGB, 
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-            m_mipLevels);
-    CopyBufferToImage(stagingBuffer, m_textureImage, 
-            static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    // TransitionImageLayout(m_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-    //                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-    //                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
-    GenerateMipmaps(m_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                    texWidth, texHeight, m_mipLevels);
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
 
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
-}
+    if (VK_SUCCESS != vkCreateRenderPass(m_device, &renderPassInfo, 
+                                        m_allocator, &m_upscaleRenderPass))
+    {
+        throw std::runtime_error("failed to create upscale render pass");
+    }
 
-inline void TriangleApp::CreateTextureImageView()
-{
-    m_textureImageView = CreateImageView(m_textureImage, 
-                                        VK_FORMAT_R8G8B8A8_SRGB,
-                                        VK_IMAGE_ASPECT_COLOR_BIT, m_mipLevels);
-}
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-void TriangleApp::CreateTextureSampler()
-{
-    VkSamplerCreateInfo samplerInfo{};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.anisotropyEnable = VK_TRUE;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = static_cast<float>(m_mipLevels);
-    samplerInfo.mipLodBias = 0.0f;
-    
-    VkPhysicalDeviceProperties properties{};
-    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
-    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
 
-    if (VK_SUCCESS != vkCreateSampler(m_device, &samplerInfo, 
-                                    nullptr, &m_textureSampler))
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(m_device, &layoutInfo,
+                                            m_allocator, &m_upscaleSetLayout))
     {
-        throw std::runtime_error("failed to create texture sampler");
+        throw std::runtime_error("failed to create upscale set layout");
     }
-}
 
-void TriangleApp::LoadModel()
-{
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(UpscaleConstants);
 
-    if (false == tinyobj::LoadObj(&attrib, &shapes, &materials, 
-                        &warn, &err, MODEL_PATH.data()))
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_upscaleSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (VK_SUCCESS != vkCreatePipelineLayout(m_device, &pipelineLayoutInfo,
+                                        m_allocator, &m_upscalePipelineLayout))
     {
-        throw std::runtime_error(warn + err);
+        throw std::runtime_error("failed to create upscale pipeline layout");
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
-    for (const auto& shape : shapes)
-    {
-        for (const auto& indx : shape.mesh.indices)
-        {
-            Vertex vertex{};
-            vertex.m_pos = {attrib.vertices[3 * indx.vertex_index + 0],
-                            attrib.vertices[3 * indx.vertex_index + 1],
-                            attrib.vertices[3 * indx.vertex_index + 2]};
-            vertex.m_texCoord = {attrib.texcoords[2 * indx.texcoord_index + 0],
-                        1.0f - attrib.texcoords[2 * indx.texcoord_index + 1]};
-            vertex.m_color = {1.0f, 1.0f, 1.0f};
+    auto vertShaderCode = ReadFile("shaders/upscale_vert.spv");
+    auto fragShaderCode = ReadFile("shaders/upscale_frag.spv");
 
-            if (0 == uniqueVertices.count(vertex))
-            {
-                uniqueVertices[vertex] = static_cast<uint32_t>(m_vertices.size());
-                m_vertices.push_back(vertex);
-            }
+    VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
+    VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
 
-            m_indices.push_back(uniqueVertices[vertex]);
-        }
-    }
-    std::cout << "vertices: " << m_vertices.size() << std::endl;
-}
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
 
-void TriangleApp::CreateVertexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
-    VkBuffer stagingBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer, stagingBufferMemory);
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-    void *data = nullptr;
-    vkMapMemory(m_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    std::memcpy(data, m_vertices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(m_device, stagingBufferMemory);
+    std::vector<VkDynamicState> dynamicStates = 
+    {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
 
-    CreateBuffer(bufferSize, 
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory);
+    VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicStateInfo.pDynamicStates = dynamicStates.data();
 
-    CopyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
 
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
-}
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-void TriangleApp::CreateIndexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
-    VkBuffer stagingBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
 
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer, stagingBufferMemory);
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | 
+    VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
 
-    void *data = nullptr;
-    vkMapMemory(m_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    std::memcpy(data, m_indices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(m_device, stagingBufferMemory);
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
 
-    CreateBuffer(bufferSize, 
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
+    pipelineInfo.layout = m_upscalePipelineLayout;
+    pipelineInfo.renderPass = m_upscaleRenderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineIndex = -1;
 
-    CopyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
+    if (VK_SUCCESS != vkCreateGraphicsPipelines(m_device, m_pipelineCache,
+                1, &pipelineInfo, m_allocator, &m_upscalePipeline))
+    {
+        throw std::runtime_error("failed to create upscale pipeline");
+    }
 
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+    vkDestroyShaderModule(m_device, fragShaderModule, m_allocator);
+    vkDestroyShaderModule(m_device, vertShaderModule, m_allocator);
 }
 
-void TriangleApp::CreateUniformBuffers()
+// one set per frame in flight, a set is only rewritten once the frame that
+// last used it has completed
+void TriangleApp::CreateUpscaleDescriptors()
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    m_uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    m_uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    m_uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    PROFILE_FUNCTION();
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.0f;
 
-    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    if (VK_SUCCESS != vkCreateSampler(m_device, &samplerInfo, 
+                                    m_allocator, &m_upscaleSampler))
     {
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        m_uniformBuffers[i], m_uniformBuffersMemory[i]);
-
-        vkMapMemory(m_device, m_uniformBuffersMemory[i], 0, bufferSize, 
-                    0, &m_uniformBuffersMapped[i]);
+        throw std::runtime_error("failed to create upscale sampler");
     }
-}
 
-void TriangleApp::CreateDescriptorPool()
-{
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
     poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
 
-    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo, nullptr, 
-                                            &m_descriptorPool))
+    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, 
+                                            &m_upscaleDescriptorPool))
     {
-        throw std::runtime_error("failed to create descriptor pool");
+        throw std::runtime_error("failed to create upscale descriptor pool");
     }
-}
 
-void TriangleApp::CreateDescriptorSets()
-{
     std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, 
-                                                m_descriptorSetLayout);
+                                                m_upscaleSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_descriptorPool;
+    allocInfo.descriptorPool = m_upscaleDescriptorPool;
     allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
     allocInfo.pSetLayouts = layouts.data();
 
-    m_descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    m_upscaleDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    m_upscaleSetGenerations.assign(MAX_FRAMES_IN_FLIGHT, 0);
     if (VK_SUCCESS != vkAllocateDescriptorSets(m_device, &allocInfo, 
-                                                m_descriptorSets.data()))
+                                        m_upscaleDescriptorSets.data()))
     {
-        throw std::runtime_error("failed to allocate descriptor sets");
+        throw std::runtime_error("failed to allocate upscale descriptor sets");
     }
+}
 
-    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-    {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = m_uniformBuffers[i];
+void TriangleApp::CreateFramebuffers()
+{
+    PROFILE_FUNCTION();
+    m_swapChainFramebuffers.resize(m_swapChainImageViews.size());
+    m_upscaleFramebuffers.assign(m_dynamicResolution ? 
+                            m_swapChainImageViews.size() : 0, VK_NULL_HANDLE);
+
+    for (std::size_t i = 0; i < m_swapChainImageViews.size(); ++i)
+    {
+        VkImageView target = m_dynamicResolution ? 
+                            m_renderGraph.GetImageView(m_graphSceneColor) :
+                            m_swapChainImageViews[i];
+        VkImageView depth = m_renderGraph.GetImageView(m_graphDepth);
+
+        std::vector<VkImageView> attachments = {target, depth};
+        if (VK_SAMPLE_COUNT_1_BIT != m_msaaSamples)
+        {
+            attachments = {m_renderGraph.GetImageView(m_graphColor), depth, 
+                            target};
+        }
+        
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = m_swapChainExtent.width;
+        framebufferInfo.height = m_swapChainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (VK_SUCCESS != vkCreateFramebuffer(m_device, &framebufferInfo,
+                                m_allocator, &m_swapChainFramebuffers[i]))
+        {
+            throw std::runtime_error("failed to create framebuffer");
+        }
+
+        if (m_dynamicResolution)
+        {
+            framebufferInfo.renderPass = m_upscaleRenderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &m_swapChainImageViews[i];
+
+            if (VK_SUCCESS != vkCreateFramebuffer(m_device, &framebufferInfo,
+                                    m_allocator, &m_upscaleFramebuffers[i]))
+            {
+                throw std::runtime_error("failed to create upscale framebuffer");
+            }
+        }
+    }
+}
+
+void TriangleApp::CreateCommandPool()
+{
+    PROFILE_FUNCTION();
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevice);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.m_graphicsFamily.value();
+
+    if (VK_SUCCESS != vkCreateCommandPool(m_device, &poolInfo, 
+                                    m_allocator, &m_commandPool))
+    {
+        throw std::runtime_error("failed to create command pool");
+    }
+
+    if (m_asyncCompute)
+    {
+        poolInfo.queueFamilyIndex = queueFamilyIndices.m_computeFamily.value();
+        if (VK_SUCCESS != vkCreateCommandPool(m_device, &poolInfo, 
+                                            m_allocator, &m_computeCommandPool))
+        {
+            throw std::runtime_error("failed to create compute command pool");
+        }
+    }
+}
+
+void TriangleApp::CreateMipGenerator()
+{
+    PROFILE_FUNCTION();
+    if (!m_computeMips)
+    {
+        return;
+    }
+
+    m_mipGenerator.Create(m_device, m_pipelineCache, &TriangleApp::ReadFile,
+                        m_allocator);
+}
+
+// Frames are copied into host cached memory when there is some, reading
+// write-combined memory from the writer thread is many times slower. One
+// slot more than frames in flight leaves the writer a frame of slack.
+void TriangleApp::CreateReadback()
+{
+    PROFILE_FUNCTION();
+    if (m_options.m_capturePath.empty())
+    {
+        return;
+    }
+
+    SwapChainSupportDetails swapChainSupport = 
+                        QuerySwapChainSupport(m_physicalDevice);
+    if (!ReadbackRing::IsSupported(m_swapChainImageFormat) || 
+        (0 == (swapChainSupport.m_capabilities.supportedUsageFlags & 
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT)))
+    {
+        std::cout << "capture: the swapchain images cannot be copied" << 
+        std::endl;
+        return;
+    }
+
+    m_capture = true;
+    m_readback.Create(m_device, MAX_FRAMES_IN_FLIGHT + 2, 
+        m_swapChainImageFormat, m_swapChainExtent, m_options.m_captureFormat, 
+        m_options.m_capturePath,
+        [this](VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& memory, 
+                void *& mapped, bool& coherent)
+        {
+            VkMemoryPropertyFlags properties = 
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | 
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            coherent = !HasMemoryType(GetBufferMemoryTypes(size, 
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT), properties);
+            if (coherent)
+            {
+                properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | 
+                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            }
+
+            CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, 
+                        buffer, memory, MemoryTracker::Category::STAGING);
+            vkMapMemory(m_device, memory, 0, size, 0, &mapped);
+        },
+        [this](VkBuffer buffer, VkDeviceMemory memory)
+        {
+            m_deletionQueue.Retire(buffer, NextTimelineValue());
+            m_deletionQueue.Retire(memory, NextTimelineValue());
+        });
+}
+
+// GPU frame time for the dynamic resolution controller, two timestamps per
+// frame in flight
+void TriangleApp::CreateQueryPool()
+{
+    PROFILE_FUNCTION();
+    if (m_pipelineStatistics)
+    {
+        VkQueryPoolCreateInfo statisticsPoolInfo{};
+        statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        statisticsPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+        statisticsPoolInfo.pipelineStatistics = 
+            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (VK_SUCCESS != vkCreateQueryPool(m_device, &statisticsPoolInfo, 
+                                            m_allocator, &m_statisticsPool))
+        {
+            throw std::runtime_error("failed to create statistics query pool");
+        }
+    }
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, 
+                                            &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, 
+                                &queueFamilyCount, queueFamilies.data());
+    QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
+    uint32_t validBits = 
+            queueFamilies[indices.m_graphicsFamily.value()].timestampValidBits;
+
+    if (!properties.limits.timestampComputeAndGraphics || (0 == validBits))
+    {
+        std::cout << "timestamps not supported, dynamic resolution disabled" << 
+        std::endl;
+        m_dynamicResolution = false;
+        m_requestedDynamicResolution = false;
+        return;
+    }
+    m_timestampPeriod = properties.limits.timestampPeriod;
+    m_timestampMask = (64 > validBits) ? (uint64_t{1} << validBits) - 1 : 
+                                        ~uint64_t{0};
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+
+    if (VK_SUCCESS != vkCreateQueryPool(m_device, &queryPoolInfo, 
+                                        m_allocator, &m_timestampPool))
+    {
+        throw std::runtime_error("failed to create timestamp query pool");
+    }
+
+    // the culling dispatch is timed on its own queue to measure the overlap,
+    // timestamps of two queues only compare on the calibrated host clock
+    if (m_asyncCompute && !m_calibratedTimestamps)
+    {
+        std::cout << "calibrated timestamps not supported, async compute " << 
+        "overlap not measured" << std::endl;
+    }
+    else if (m_asyncCompute)
+    {
+        uint32_t computeFamily = indices.m_computeFamily.value();
+
+        if ((0 != queueFamilies[computeFamily].timestampValidBits) && 
+            (VK_SUCCESS != vkCreateQueryPool(m_device, &queryPoolInfo, 
+                                        m_allocator, &m_computeTimestampPool)))
+        {
+            throw std::runtime_error("failed to create compute query pool");
+        }
+    }
+}
+
+// Pipelines compiled by an earlier run are loaded from disk. The driver checks
+// the header and ignores data from another device or driver version.
+void TriangleApp::CreatePipelineCache()
+{
+    PROFILE_FUNCTION();
+    std::vector<char> data;
+    std::ifstream file(std::string(PIPELINE_CACHE_PATH), 
+                        std::ios::ate | std::ios::binary);
+    if (file.is_open())
+    {
+        data.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    m_warmPipelineCache = !data.empty();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+
+    if (VK_SUCCESS != vkCreatePipelineCache(m_device, &cacheInfo, m_allocator, 
+                                            &m_pipelineCache))
+    {
+        throw std::runtime_error("failed to create pipeline cache");
+    }
+}
+
+void TriangleApp::SavePipelineCache()
+{
+    std::size_t size = 0;
+    vkGetPipelineCacheData(m_device, m_pipelineCache, &size, nullptr);
+    std::vector<char> data(size);
+    if ((0 == size) || (VK_SUCCESS != vkGetPipelineCacheData(m_device, 
+                                        m_pipelineCache, &size, data.data())))
+    {
+        return;
+    }
+
+    std::ofstream file(std::string(PIPELINE_CACHE_PATH), std::ios::binary);
+    file.write(data.data(), static_cast<std::streamsize>(size));
+}
+
+// the frame is described once per swapchain, the graph derives the barriers
+// and the memory placement of the transient attachments from it
+void TriangleApp::CreateRenderGraph()
+{
+    PROFILE_FUNCTION();
+    m_renderGraph.Reset(m_deletionQueue, NextTimelineValue());
+
+    ++m_renderTargetGeneration;
+    ++m_commandGeneration;
+
+    RenderGraph::ImageDesc depthDesc{};
+    depthDesc.m_format = FindDepthFormat();
+    depthDesc.m_extent = m_swapChainExtent;
+    depthDesc.m_samples = m_msaaSamples;
+    depthDesc.m_usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
+                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depthDesc.m_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    m_graphDepth = m_renderGraph.CreateImage("depth", depthDesc);
+
+    // the acquire semaphore is waited on at the color attachment stage
+    RenderGraph::State acquired{};
+    acquired.m_stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    m_graphBackBuffer = m_renderGraph.ImportImage("swapchain", 
+                                    VK_IMAGE_ASPECT_COLOR_BIT, acquired);
+
+    // with dynamic resolution the scene is rendered into the corner of a full
+    // size target and scaled up, so changing the scale never reallocates
+    RenderGraph::Resource sceneTarget = m_graphBackBuffer;
+    if (m_dynamicResolution)
+    {
+        RenderGraph::ImageDesc sceneDesc{};
+        sceneDesc.m_format = m_swapChainImageFormat;
+        sceneDesc.m_extent = m_swapChainExtent;
+        sceneDesc.m_samples = VK_SAMPLE_COUNT_1_BIT;
+        sceneDesc.m_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | 
+                            VK_IMAGE_USAGE_SAMPLED_BIT;
+        sceneDesc.m_aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        m_graphSceneColor = m_renderGraph.CreateImage("scene color", sceneDesc);
+        sceneTarget = m_graphSceneColor;
+    }
+
+    // draw buffers are per frame in flight, imported each frame like the
+    // swapchain image, the CPU culling path fills them from the host
+    m_graphIndirect = m_renderGraph.ImportBuffer("indirect", {});
+    m_graphDrawData = m_renderGraph.ImportBuffer("draw data", {});
+    m_graphDrawCount = m_renderGraph.ImportBuffer("draw count", {});
+
+    // async culling is submitted to the compute queue before the frame, the
+    // submit waits for it at the indirect draw stage
+    if (m_gpuCulling && !m_asyncCompute)
+    {
+        RenderGraph::Pass cull = m_renderGraph.AddPass("cull",
+        [this](VkCommandBuffer commandBuffer)
+        {
+            RecordCullPass(commandBuffer);
+        });
+        m_renderGraph.Write(cull, m_graphIndirect, 
+                            RenderGraph::Access::STORAGE_WRITE);
+        m_renderGraph.Write(cull, m_graphDrawData, 
+                            RenderGraph::Access::STORAGE_WRITE);
+        m_renderGraph.Write(cull, m_graphDrawCount, 
+                            RenderGraph::Access::STORAGE_WRITE);
+    }
+
+    RenderGraph::Pass scene = m_renderGraph.AddPass("scene",
+    [this](VkCommandBuffer commandBuffer)
+    {
+        RecordScenePass(commandBuffer);
+    });
+    m_renderGraph.Read(scene, m_graphIndirect, 
+                        RenderGraph::Access::INDIRECT_READ);
+    m_renderGraph.Read(scene, m_graphDrawCount, 
+                        RenderGraph::Access::INDIRECT_READ);
+    m_renderGraph.Read(scene, m_graphDrawData, 
+                        RenderGraph::Access::VERTEX_STORAGE_READ);
+
+    if (VK_SAMPLE_COUNT_1_BIT != m_msaaSamples)
+    {
+        RenderGraph::ImageDesc colorDesc{};
+        colorDesc.m_format = m_swapChainImageFormat;
+        colorDesc.m_extent = m_swapChainExtent;
+        colorDesc.m_samples = m_msaaSamples;
+        colorDesc.m_usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | 
+                            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        colorDesc.m_aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        m_graphColor = m_renderGraph.CreateImage("msaa color", colorDesc);
+        m_renderGraph.Write(scene, m_graphColor, 
+                            RenderGraph::Access::COLOR_ATTACHMENT);
+    }
+    m_renderGraph.Write(scene, m_graphDepth, 
+                        RenderGraph::Access::DEPTH_ATTACHMENT);
+    m_renderGraph.Write(scene, sceneTarget, 
+                        RenderGraph::Access::COLOR_ATTACHMENT);
+
+    if (m_dynamicResolution)
+    {
+        RenderGraph::Pass upscale = m_renderGraph.AddPass("upscale",
+        [this](VkCommandBuffer commandBuffer)
+        {
+            RecordUpscalePass(commandBuffer);
+        });
+        m_renderGraph.Read(upscale, m_graphSceneColor, 
+                            RenderGraph::Access::SAMPLED);
+        m_renderGraph.Write(upscale, m_graphBackBuffer, 
+                            RenderGraph::Access::COLOR_ATTACHMENT);
+    }
+    // the copy is read on the host once the frame's timeline value is reached
+    if (m_capture)
+    {
+        m_graphReadback = m_renderGraph.ImportBuffer("readback", {});
+        RenderGraph::Pass capture = m_renderGraph.AddPass("capture",
+        [this](VkCommandBuffer commandBuffer)
+        {
+            RecordCapturePass(commandBuffer);
+        });
+        m_renderGraph.Read(capture, m_graphBackBuffer, 
+                            RenderGraph::Access::TRANSFER_SRC);
+        m_renderGraph.Write(capture, m_graphReadback, 
+                            RenderGraph::Access::TRANSFER_DST);
+        m_renderGraph.Export(m_graphReadback, RenderGraph::Access::HOST_READ);
+    }
+    m_renderGraph.Export(m_graphBackBuffer, RenderGraph::Access::PRESENT);
+
+    m_renderGraph.Compile(m_device, m_allocator, 
+    [this](const VkMemoryRequirements& requirements, bool lazy)
+    {
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (lazy && HasMemoryType(requirements.memoryTypeBits, 
+                    properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+        {
+            properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = FindMemoryType(
+                                    requirements.memoryTypeBits, properties);
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (VK_SUCCESS != m_memory.Allocate(allocInfo, 
+                            MemoryTracker::Category::ATTACHMENT, memory))
+        {
+            throw std::runtime_error("failed to allocate render graph memory");
+        }
+
+        return memory;
+    });
+
+    // depth, MSAA color and the scaled scene color are all attachments of
+    // the scene pass, their lifetimes overlap and each gets its own memory;
+    // only images whose pass ranges are disjoint would share a slot
+    const RenderGraph::Stats& stats = m_renderGraph.GetStats();
+    std::cout << "render graph: " << stats.m_passes << " passes (" << 
+    stats.m_culledPasses << " culled), " << stats.m_barriers << 
+    " barriers per frame, transient memory " << stats.m_allocatedBytes << 
+    " bytes + " << stats.m_lazyBytes << " lazy";
+    VkDeviceSize aliased = stats.m_transientBytes - stats.m_allocatedBytes - 
+                            stats.m_lazyBytes;
+    if (0 != aliased)
+    {
+        std::cout << " (" << aliased << " saved by aliasing)";
+    }
+    std::cout << std::endl;
+}
+
+TriangleApp::DecodedImage TriangleApp::DecodeImage(const std::string& path)
+{
+    PROFILE_FUNCTION();
+    int texWidth = 0, texHeight = 0, texChannels = 0;
+    stbi_uc *pixels = stbi_load(path.c_str(), &texWidth, &texHeight,
+                            &texChannels, STBI_rgb_alpha);
+    if (nullptr == pixels)
+    {
+        throw std::runtime_error("failed to load texture image " + path);
+    }
+
+    DecodedImage image;
+    image.m_pixels.reset(pixels);
+    image.m_width = static_cast<uint32_t>(texWidth);
+    image.m_height = static_cast<uint32_t>(texHeight);
+
+    return image;
+}
+
+void TriangleApp::CreateTextureImage(const DecodedImage& image, 
+                                    const std::string& path, Texture& texture)
+{
+    uint32_t texWidth = image.m_width;
+    uint32_t texHeight = image.m_height;
+    texture.m_mipLevels = static_cast<uint32_t>(
+                    std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    texture.m_path = path;
+    texture.m_width = texWidth;
+    texture.m_height = texHeight;
+    texture.m_baseMip = 0;
+    texture.m_targetMip = 0;
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(texWidth) * texHeight * 4;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+
+    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    stagingBuffer, stagingBufferMemory, MemoryTracker::Category::STAGING);
+
+    void *data = nullptr;
+    vkMapMemory(m_device, stagingBufferMemory, 0, imageSize, 0, &data);
+    std::memcpy(data, image.m_pixels.get(), static_cast<size_t>(imageSize));
+    vkUnmapMemory(m_device, stagingBufferMemory);
+
+    // the compute path writes the levels through UNORM storage views
+    bool computeMips = UseComputeMips(VK_FORMAT_R8G8B8A8_SRGB, texWidth, 
+                                    texHeight, texture.m_mipLevels);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | 
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (computeMips)
+    {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    CreateImage(texWidth, texHeight, texture.m_mipLevels, VK_SAMPLE_COUNT_1_BIT,
+                VK_FORMAT_R8G8B8A8_SRGB, 
+                VK_IMAGE_TILING_OPTIMAL, usage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.m_image, 
+                texture.m_memory, MemoryTracker::Category::TEXTURE,
+                computeMips ? (VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | 
+                            VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) : 0);
+    TransitionImageLayout(texture.m_image, VK_FORMAT_R8G8B8A8_SRGB, 
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+            texture.m_mipLevels);
+    CopyBufferToImage(stagingBuffer, texture.m_image, texWidth, texHeight);
+    GenerateMipmaps(texture.m_image, VK_FORMAT_R8G8B8A8_SRGB,
+                    texWidth, texHeight, texture.m_mipLevels);
+
+    vkDestroyBuffer(m_device, stagingBuffer, m_allocator);
+    m_memory.Free(stagingBufferMemory);
+
+    texture.m_view = CreateImageView(texture.m_image, VK_FORMAT_R8G8B8A8_SRGB,
+                                VK_IMAGE_ASPECT_COLOR_BIT, texture.m_mipLevels);
+}
+
+// Texture 0 is the default, used by faces without a material and by
+// materials without a diffuse map. Maps shared by several materials are
+// loaded once.
+void TriangleApp::CollectTexturePaths()
+{
+    std::unordered_map<std::string, uint32_t> texturesByPath;
+
+    m_texturePaths.push_back(std::string(TEXTURE_PATH));
+    texturesByPath[m_texturePaths.back()] = 0;
+
+    m_objMaterialTextures.assign(m_objMaterials.size(), 0);
+    for (std::size_t i = 0; i < m_objMaterials.size(); ++i)
+    {
+        const std::string& name = m_objMaterials[i].diffuse_texname;
+        if (name.empty())
+        {
+            continue;
+        }
+
+        std::string path = std::string(MODEL_DIR) + name;
+        auto found = texturesByPath.find(path);
+        if (texturesByPath.end() == found)
+        {
+            m_texturePaths.push_back(path);
+            found = texturesByPath.emplace(path, 
+                    static_cast<uint32_t>(m_texturePaths.size() - 1)).first;
+        }
+        m_objMaterialTextures[i] = found->second;
+    }
+
+    m_decodedImages.resize(m_texturePaths.size());
+}
+
+// the images were decoded on the workers, the pixels are freed once uploaded
+void TriangleApp::CreateTextures()
+{
+    PROFILE_FUNCTION();
+    for (std::size_t i = 0; i < m_texturePaths.size(); ++i)
+    {
+        m_textures.emplace_back();
+        CreateTextureImage(m_decodedImages[i], m_texturePaths[i], 
+                            m_textures.back());
+    }
+    m_decodedImages.clear();
+
+    for (const Texture& texture : m_textures)
+    {
+        m_mipLevels = std::max(m_mipLevels, texture.m_mipLevels);
+        m_residency.AddTexture(texture.m_width, texture.m_height, 
+                                texture.m_mipLevels, 4);
+    }
+    m_residency.SetBudget(static_cast<VkDeviceSize>(
+                            m_options.m_textureBudgetMb) << 20);
+    std::cout << "textures: " << m_textures.size() << " resident " << 
+    (m_residency.GetResidentBytes() >> 20) << " MB" << std::endl;
+
+    m_streamer.Start();
+}
+
+// The finest level a mesh needs is where one texel covers one pixel: the
+// texels per model unit from the texture coordinate density against the
+// pixels per model unit at the nearest point of the mesh bounds. The visible
+// meshes come from the mesh BVH in world space.
+void TriangleApp::RequestTextureMips()
+{
+    CullConstants constants = MakeCullConstants();
+    glm::vec3 cameraPosition(constants.m_cameraPosition);
+    float pixelsPerUnit = std::abs(m_camera.m_proj[1][1]) * 0.5f * 
+                        static_cast<float>(GetRenderExtent().height);
+
+    glm::vec4 planes[6];
+    MakeFrustumPlanes(m_camera.m_proj * m_camera.m_view, planes);
+    m_meshBvh.Cull(planes, m_visibleMeshes);
+    for (uint32_t meshIndex : m_visibleMeshes)
+    {
+        const Mesh& mesh = m_meshes[meshIndex];
+        uint32_t textureIndex = m_materialTextures[mesh.m_material];
+        const Texture& texture = m_textures[textureIndex];
+        float distance = std::max(NEAR_PLANE, 
+                glm::length(mesh.m_center - cameraPosition) - mesh.m_radius);
+        float texelsPerUnit = mesh.m_uvDensity * 
+                static_cast<float>(std::max(texture.m_width, texture.m_height));
+        float mip = std::log2(std::max(1e-6f, 
+                            texelsPerUnit * distance / pixelsPerUnit));
+        m_residency.Request(textureIndex, mip, m_frameNumber);
+    }
+}
+
+// The residency manager moves the finest level of a texture one step per
+// update. Evicted levels are dropped at once, streamed levels are decoded on
+// the streamer thread and applied in the frame they arrive in. Either way the
+// texture gets a new image and bindless slot, filled by copies that go ahead
+// of the frame in its submit, and the materials are pointed at the new slot
+// on the GPU once the frames in flight have read them. The old image and slot
+// retire with the frame, nothing waits for the GPU. Returns the copies to
+// submit, VK_NULL_HANDLE when no texture changed.
+VkCommandBuffer TriangleApp::UpdateResidency()
+{
+    PROFILE_FUNCTION();
+    if (0 == m_frameNumber % RESIDENCY_INTERVAL)
+    {
+        for (const TextureResidency::Change& change : 
+                                        m_residency.Update(m_frameNumber))
+        {
+            m_textures[change.m_texture].m_targetMip = change.m_baseMip;
+            StepTexture(change.m_texture);
+        }
+    }
+
+    // a file that failed to load or changed size keeps the levels the
+    // texture has, levels that arrive after the chain moved are dropped
+    m_streamer.Poll(m_streamedLevels);
+    for (const TextureStreamer::Levels& levels : m_streamedLevels)
+    {
+        Texture& texture = m_textures[levels.m_texture];
+        texture.m_streaming = false;
+
+        uint32_t end = levels.m_baseMip + levels.m_levelCount;
+        VkDeviceSize bytes = 
+                m_residency.GetChainBytes(levels.m_texture, levels.m_baseMip) - 
+                m_residency.GetChainBytes(levels.m_texture, end);
+        if (levels.m_pixels.size() != bytes)
+        {
+            texture.m_targetMip = texture.m_baseMip;
+            continue;
+        }
+
+        if ((end == texture.m_baseMip) && 
+            (levels.m_baseMip >= texture.m_targetMip))
+        {
+            SetTextureBaseMip(levels.m_texture, levels.m_baseMip, 
+                            levels.m_pixels);
+        }
+        StepTexture(levels.m_texture);
+    }
+
+    if (!m_streamRecording)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    // the update waits for the frames in flight to finish reading the
+    // materials, the frame submitted after it samples the new slots
+    VkCommandBuffer commandBuffer = m_streamCommandBuffers[m_currentFrame];
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_materialBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, 
+                        &barrier, 0, nullptr);
+
+    for (uint32_t material = 0; material < m_materialCount; ++material)
+    {
+        const Texture& texture = m_textures[m_materialTextures[material]];
+        if (m_swappedTextures.end() == std::find(m_swappedTextures.begin(), 
+                    m_swappedTextures.end(), m_materialTextures[material]))
+        {
+            continue;
+        }
+
+        VkDeviceSize offset = sizeof(Material) * material + 
+                            offsetof(Material, m_albedoTexture);
+        vkCmdUpdateBuffer(commandBuffer, m_materialBuffer, offset, 
+                        sizeof(texture.m_bindlessIndex), 
+                        &texture.m_bindlessIndex);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, 
+                        &barrier, 0, nullptr);
+
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+    {
+        throw std::runtime_error("failed to record texture stream commands");
+    }
+    m_streamRecording = false;
+    m_swappedTextures.clear();
+
+    return commandBuffer;
+}
+
+// evictions apply at once, missing levels are requested from the streamer
+// unless a request is out already
+void TriangleApp::StepTexture(uint32_t index)
+{
+    Texture& texture = m_textures[index];
+    if (texture.m_targetMip > texture.m_baseMip)
+    {
+        SetTextureBaseMip(index, texture.m_targetMip, {});
+    }
+    else if ((texture.m_targetMip < texture.m_baseMip) && !texture.m_streaming)
+    {
+        m_streamer.Request(index, texture.m_path, texture.m_targetMip, 
+                        texture.m_baseMip - texture.m_targetMip);
+        texture.m_streaming = true;
+    }
+}
+
+// Records the texture image again with its finest level at baseMip. Levels
+// the old image holds are copied over, pixels holds the streamed levels above
+// them, from baseMip on. The texture moves to a new bindless slot, the old
+// image and slot retire with the frame.
+void TriangleApp::SetTextureBaseMip(uint32_t index, uint32_t baseMip, 
+                                    const std::vector<uint8_t>& pixels)
+{
+    Texture& texture = m_textures[index];
+    Texture resized = texture;
+    resized.m_baseMip = baseMip;
+    uint32_t levels = texture.m_mipLevels - baseMip;
+    uint32_t width = std::max(1u, texture.m_width >> baseMip);
+    uint32_t height = std::max(1u, texture.m_height >> baseMip);
+    CreateImage(width, height, levels, VK_SAMPLE_COUNT_1_BIT, 
+                VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | 
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resized.m_image, 
+                resized.m_memory, MemoryTracker::Category::TEXTURE);
+
+    // kept is the first level copied from the old image
+    uint32_t kept = std::max(baseMip, texture.m_baseMip);
+    uint32_t keptLevels = texture.m_mipLevels - kept;
+    uint64_t lastUse = NextTimelineValue();
+    VkCommandBuffer commandBuffer = GetStreamCommands();
+
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (VkImageMemoryBarrier& barrier : barriers)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    barriers[0].image = texture.m_image;
+    barriers[0].subresourceRange.baseMipLevel = kept - texture.m_baseMip;
+    barriers[0].subresourceRange.levelCount = keptLevels;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image = resized.m_image;
+    barriers[1].subresourceRange.levelCount = levels;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, 
+                        nullptr, static_cast<uint32_t>(barriers.size()), 
+                        barriers.data());
+
+    if (!pixels.empty())
+    {
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+        VkDeviceSize size = static_cast<VkDeviceSize>(pixels.size());
+        CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        stagingBuffer, stagingBufferMemory, MemoryTracker::Category::STAGING);
+
+        void *data = nullptr;
+        vkMapMemory(m_device, stagingBufferMemory, 0, size, 0, &data);
+        std::memcpy(data, pixels.data(), pixels.size());
+        vkUnmapMemory(m_device, stagingBufferMemory);
+
+        std::vector<VkBufferImageCopy> uploads(kept - baseMip);
+        VkDeviceSize offset = 0;
+        for (uint32_t level = 0; level < uploads.size(); ++level)
+        {
+            VkBufferImageCopy& region = uploads[level];
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {std::max(1u, width >> level), 
+                                std::max(1u, height >> level), 1};
+            offset += static_cast<VkDeviceSize>(region.imageExtent.width) * 
+                                                region.imageExtent.height * 4;
+        }
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, resized.m_image, 
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                            static_cast<uint32_t>(uploads.size()), 
+                            uploads.data());
+
+        m_deletionQueue.Retire(stagingBuffer, lastUse);
+        m_deletionQueue.Retire(stagingBufferMemory, lastUse);
+    }
+
+    std::vector<VkImageCopy> regions(keptLevels);
+    for (uint32_t level = 0; level < keptLevels; ++level)
+    {
+        VkImageCopy& region = regions[level];
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = kept - texture.m_baseMip + level;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.mipLevel = kept - baseMip + level;
+        region.dstSubresource.layerCount = 1;
+        region.extent.width = std::max(1u, texture.m_width >> (kept + level));
+        region.extent.height = std::max(1u, texture.m_height >> (kept + level));
+        region.extent.depth = 1;
+    }
+    vkCmdCopyImage(commandBuffer, texture.m_image, 
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, resized.m_image, 
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                static_cast<uint32_t>(regions.size()), regions.data());
+
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 
+                        0, nullptr, 1, &barriers[1]);
+
+    resized.m_view = CreateImageView(resized.m_image, VK_FORMAT_R8G8B8A8_SRGB,
+                                    VK_IMAGE_ASPECT_COLOR_BIT, levels);
+    resized.m_bindlessIndex = m_bindless.AddTexture(resized.m_view, 
+                                                    m_textureSampler);
+
+    // frames in flight may still sample the old image through the old slot
+    m_bindless.RetireTexture(texture.m_bindlessIndex, lastUse);
+    m_deletionQueue.Retire(texture.m_view, lastUse);
+    m_deletionQueue.Retire(texture.m_image, lastUse);
+    m_deletionQueue.Retire(texture.m_memory, lastUse);
+    texture = resized;
+    m_swappedTextures.push_back(index);
+}
+
+// the buffer of this frame slot was last submitted with the frame the slot
+// waited for, so it is recorded again
+VkCommandBuffer TriangleApp::GetStreamCommands()
+{
+    VkCommandBuffer commandBuffer = m_streamCommandBuffers[m_currentFrame];
+    if (m_streamRecording)
+    {
+        return commandBuffer;
+    }
+
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo))
+    {
+        throw std::runtime_error("failed to begin texture stream commands");
+    }
+    m_streamRecording = true;
+
+    return commandBuffer;
+}
+
+void TriangleApp::CreateTextureSampler()
+{
+    PROFILE_FUNCTION();
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.anisotropyEnable = VK_TRUE;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(m_mipLevels);
+    samplerInfo.mipLodBias = 0.0f;
+    
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+
+    if (VK_SUCCESS != vkCreateSampler(m_device, &samplerInfo, 
+                                    m_allocator, &m_textureSampler))
+    {
+        throw std::runtime_error("failed to create texture sampler");
+    }
+}
+
+// the texture array is sized to what the device allows for update-after-bind
+// samplers, capped at MAX_BINDLESS_TEXTURES
+void TriangleApp::CreateBindlessTable()
+{
+    PROFILE_FUNCTION();
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = 
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &vulkan12Properties;
+    vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties);
+
+    uint32_t capacity = std::min({MAX_BINDLESS_TEXTURES, 
+        vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+        vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+        vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages});
+
+    m_bindless.Create(m_device, capacity, m_allocator);
+    std::cout << "bindless textures: " << capacity << std::endl;
+}
+
+void TriangleApp::CreateMaterials()
+{
+    PROFILE_FUNCTION();
+    VkDeviceSize bufferSize = sizeof(Material) * MAX_MATERIALS;
+
+    CreateBuffer(bufferSize, 
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    m_materialBuffer, m_materialBufferMemory, 
+    MemoryTracker::Category::STORAGE);
+    vkMapMemory(m_device, m_materialBufferMemory, 0, bufferSize, 0, 
+                &m_materialBufferMapped);
+    m_bindless.SetMaterialBuffer(m_materialBuffer, bufferSize);
+
+    for (Texture& texture : m_textures)
+    {
+        texture.m_bindlessIndex = m_bindless.AddTexture(texture.m_view, 
+                                                        m_textureSampler);
+    }
+
+    Material material{};
+    material.m_baseColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    material.m_albedoTexture = m_textures[0].m_bindlessIndex;
+    m_defaultMaterial = AddMaterial(material);
+    m_materialTextures.push_back(0);
+
+    // the diffuse color only tints untextured materials, exporters often
+    // leave it dark when a map is set
+    std::vector<uint32_t> objToMaterial(m_objMaterials.size());
+    for (std::size_t i = 0; i < m_objMaterials.size(); ++i)
+    {
+        const tinyobj::material_t& objMaterial = m_objMaterials[i];
+        material.m_baseColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+        if (objMaterial.diffuse_texname.empty())
+        {
+            material.m_baseColor = glm::vec4(objMaterial.diffuse[0],
+                    objMaterial.diffuse[1], objMaterial.diffuse[2], 1.0f);
+        }
+        material.m_albedoTexture = 
+                m_textures[m_objMaterialTextures[i]].m_bindlessIndex;
+        objToMaterial[i] = AddMaterial(material);
+        m_materialTextures.push_back(m_objMaterialTextures[i]);
+    }
+
+    for (Mesh& mesh : m_meshes)
+    {
+        mesh.m_material = (0 > mesh.m_objMaterial) ? m_defaultMaterial : 
+                        objToMaterial[mesh.m_objMaterial];
+    }
+}
+
+// materials are appended from the host before the first frame, later changes
+// go through the GPU timeline so frames in flight never see them
+uint32_t TriangleApp::AddMaterial(const Material& material)
+{
+    if (MAX_MATERIALS == m_materialCount)
+    {
+        throw std::runtime_error("material buffer is full");
+    }
+
+    std::memcpy(static_cast<Material*>(m_materialBufferMapped) + m_materialCount,
+                &material, sizeof(material));
+
+    return m_materialCount++;
+}
+
+void TriangleApp::LoadModel()
+{
+    PROFILE_FUNCTION();
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::string warn, err;
+
+    if (false == tinyobj::LoadObj(&attrib, &shapes, &m_objMaterials, 
+                        &warn, &err, MODEL_PATH.data(), MODEL_DIR.data()))
+    {
+        throw std::runtime_error(warn + err);
+    }
+
+    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+    // faces are triangulated by the loader, one submesh per shape and material
+    for (const auto& shape : shapes)
+    {
+        std::map<int, std::vector<uint32_t>> faceIndices;
+        for (std::size_t face = 0; face < shape.mesh.material_ids.size(); ++face)
+        {
+            std::vector<uint32_t>& indices = 
+                                faceIndices[shape.mesh.material_ids[face]];
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                indices.push_back(static_cast<uint32_t>(3 * face + corner));
+            }
+        }
+
+        for (const auto& [objMaterial, indices] : faceIndices)
+        {
+            Mesh mesh{};
+            mesh.m_firstIndex = static_cast<uint32_t>(m_indices.size());
+            mesh.m_indexCount = static_cast<uint32_t>(indices.size());
+            mesh.m_objMaterial = objMaterial;
+
+            glm::vec3 minPos(std::numeric_limits<float>::max());
+            glm::vec3 maxPos(std::numeric_limits<float>::lowest());
+            for (uint32_t index : indices)
+            {
+                const tinyobj::index_t& indx = shape.mesh.indices[index];
+                Vertex vertex{};
+                vertex.m_pos = {attrib.vertices[3 * indx.vertex_index + 0],
+                                attrib.vertices[3 * indx.vertex_index + 1],
+                                attrib.vertices[3 * indx.vertex_index + 2]};
+                vertex.m_texCoord = 
+                        {attrib.texcoords[2 * indx.texcoord_index + 0],
+                        1.0f - attrib.texcoords[2 * indx.texcoord_index + 1]};
+                vertex.m_color = {1.0f, 1.0f, 1.0f};
+
+                if (0 == uniqueVertices.count(vertex))
+                {
+                    uniqueVertices[vertex] = 
+                                    static_cast<uint32_t>(m_vertices.size());
+                    m_vertices.push_back(vertex);
+                }
+
+                m_indices.push_back(uniqueVertices[vertex]);
+                minPos = glm::min(minPos, vertex.m_pos);
+                maxPos = glm::max(maxPos, vertex.m_pos);
+            }
+
+            mesh.m_center = (minPos + maxPos) * 0.5f;
+            mesh.m_radius = glm::length(maxPos - minPos) * 0.5f;
+
+            float area = 0.0f;
+            float uvArea = 0.0f;
+            for (uint32_t i = mesh.m_firstIndex; 
+                i < mesh.m_firstIndex + mesh.m_indexCount; i += 3)
+            {
+                const Vertex& a = m_vertices[m_indices[i + 0]];
+                const Vertex& b = m_vertices[m_indices[i + 1]];
+                const Vertex& c = m_vertices[m_indices[i + 2]];
+                area += glm::length(glm::cross(b.m_pos - a.m_pos, 
+                                                c.m_pos - a.m_pos));
+                glm::vec2 ab = b.m_texCoord - a.m_texCoord;
+                glm::vec2 ac = c.m_texCoord - a.m_texCoord;
+                uvArea += std::abs(ab.x * ac.y - ab.y * ac.x);
+            }
+            mesh.m_uvDensity = (0.0f < area) ? std::sqrt(uvArea / area) : 0.0f;
+
+            m_meshes.push_back(mesh);
+        }
+    }
+
+    m_positions.reserve(m_vertices.size());
+    for (const Vertex& vertex : m_vertices)
+    {
+        m_positions.push_back(vertex.m_pos);
+    }
+
+    for (Mesh& mesh : m_meshes)
+    {
+        mesh.m_firstMeshlet = static_cast<uint32_t>(m_meshlets.size());
+        MeshletBuilder::Build(m_positions, m_indices, mesh.m_firstIndex, 
+                                mesh.m_indexCount, m_meshlets);
+        mesh.m_meshletCount = static_cast<uint32_t>(m_meshlets.size()) - 
+                                mesh.m_firstMeshlet;
+    }
+
+    std::cout << "vertices: " << m_vertices.size() << " meshes: " << 
+    m_meshes.size() << " materials: " << m_objMaterials.size() << 
+    " meshlets: " << m_meshlets.size() << std::endl;
+}
+
+void TriangleApp::CreateGeometryPool()
+{
+    PROFILE_FUNCTION();
+    m_geometryPool.Create(m_device, sizeof(Vertex), GEOMETRY_POOL_VERTICES,
+        GEOMETRY_POOL_INDICES, [this](VkDeviceSize size, 
+        VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
+        {
+            MemoryTracker::Category category = 
+                        (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ? 
+                        MemoryTracker::Category::INDEX : 
+                        MemoryTracker::Category::VERTEX;
+            CreateBuffer(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+                        buffer, memory, category);
+        }, m_allocator);
+}
+
+// The mesh nodes keep the bounding box around their sphere. The scene is only
+// a handful of nodes, so it updates on the render thread.
+void TriangleApp::CreateScene()
+{
+    PROFILE_FUNCTION();
+    m_scene.Create(0);
+    m_scene.Reserve(static_cast<uint32_t>(m_meshes.size()) + 1);
+
+    glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+    m_modelNode = m_scene.Add(SceneGraph::NO_PARENT, glm::vec3(0.0f), 
+                            identity, glm::vec3(1.0f), SceneGraph::Bounds{});
+    m_firstMeshNode = m_modelNode + 1;
+    for (const Mesh& mesh : m_meshes)
+    {
+        glm::vec3 extent(mesh.m_radius);
+        m_scene.Add(m_modelNode, glm::vec3(0.0f), identity, glm::vec3(1.0f), 
+                    {mesh.m_center - extent, mesh.m_center + extent});
+    }
+    m_scene.Update();
+
+    m_meshBvh.Create(0);
+    m_meshBounds.resize(m_meshes.size());
+    UpdateMeshBounds();
+    m_meshBvh.Build(m_meshBounds);
+}
+
+// the hierarchy stays, only the boxes follow the nodes
+void TriangleApp::UpdateMeshBounds()
+{
+    for (uint32_t i = 0; i < m_meshBounds.size(); ++i)
+    {
+        m_meshBounds[i] = m_scene.GetWorldBounds(m_firstMeshNode + i);
+    }
+}
+
+// picks the occluder triangles before UploadModel rebases the meshes into the
+// geometry pool
+void TriangleApp::CreateOcclusionCuller()
+{
+    PROFILE_FUNCTION();
+    if (!m_options.m_occlusionCulling)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> occluderIndices;
+    for (const Mesh& mesh : m_meshes)
+    {
+        OcclusionCuller::SelectOccluders(m_positions, m_indices, 
+                    mesh.m_firstIndex, mesh.m_indexCount, OCCLUDER_TRIANGLES,
+                    occluderIndices);
+    }
+
+    // one core stays with the render thread
+    uint32_t workers = std::clamp(std::thread::hardware_concurrency(), 2u, 
+                                OcclusionCuller::TILES_Y + 1) - 1;
+    m_occlusion.Create(workers, OcclusionCuller::DetectIsa());
+    m_occlusion.SetOccluders(m_positions, occluderIndices);
+
+    std::cout << "occluders: " << m_occlusion.GetTriangleCount() << 
+    " triangles, " << workers << " workers, " << 
+    OcclusionCuller::GetIsaName(m_occlusion.GetIsa()) << std::endl;
+}
+
+// submesh index ranges are relative to the model, they are rebased onto the
+// range the model got in the pool
+void TriangleApp::UploadModel()
+{
+    PROFILE_FUNCTION();
+    GeometryPool::Range range = m_geometryPool.Allocate(
+                                static_cast<uint32_t>(m_vertices.size()),
+                                static_cast<uint32_t>(m_indices.size()));
+
+    UploadBuffer(m_geometryPool.GetVertexBuffer(), 
+                m_geometryPool.GetVertexByteOffset(range), m_vertices.data(),
+                sizeof(m_vertices[0]) * m_vertices.size());
+    UploadBuffer(m_geometryPool.GetIndexBuffer(), 
+                m_geometryPool.GetIndexByteOffset(range), m_indices.data(),
+                sizeof(m_indices[0]) * m_indices.size());
+
+    UploadBuffer(m_geometryPool.GetPositionBuffer(), 
+                m_geometryPool.GetPositionByteOffset(range), m_positions.data(),
+                GeometryPool::POSITION_STRIDE * m_positions.size());
+
+    for (Mesh& mesh : m_meshes)
+    {
+        mesh.m_firstIndex += range.m_firstIndex;
+        mesh.m_vertexOffset = range.m_vertexOffset;
+
+        for (uint32_t i = 0; i < mesh.m_meshletCount; ++i)
+        {
+            Meshlet& meshlet = m_meshlets[mesh.m_firstMeshlet + i];
+            meshlet.m_firstIndex += range.m_firstIndex;
+            meshlet.m_vertexOffset = range.m_vertexOffset;
+            meshlet.m_material = mesh.m_material;
+        }
+    }
+
+    // every meshlet may be visible at once
+    if (m_meshlets.size() > MAX_DRAWS)
+    {
+        throw std::runtime_error("too many meshlets for the indirect buffer");
+    }
+
+    VkDeviceSize meshletSize = sizeof(Meshlet) * m_meshlets.size();
+    CreateBuffer(meshletSize, 
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_meshletBuffer, m_meshletBufferMemory,
+    MemoryTracker::Category::STORAGE, true);
+    UploadBuffer(m_meshletBuffer, 0, m_meshlets.data(), meshletSize);
+}
+
+void TriangleApp::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, 
+                                const void *data, VkDeviceSize size)
+{
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+
+    CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    stagingBuffer, stagingBufferMemory, MemoryTracker::Category::STAGING);
+
+    void *mapped = nullptr;
+    vkMapMemory(m_device, stagingBufferMemory, 0, size, 0, &mapped);
+    std::memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(m_device, stagingBufferMemory);
+
+    CopyBuffer(stagingBuffer, dstBuffer, size, dstOffset);
+
+    vkDestroyBuffer(m_device, stagingBuffer, m_allocator);
+    m_memory.Free(stagingBufferMemory);
+}
+
+void TriangleApp::CreateUniformBuffers()
+{
+    PROFILE_FUNCTION();
+    VkDeviceSize bufferSize = sizeof(TransformSystem::Instance);
+    m_transforms.Clear();
+    m_modelTransform = m_transforms.Add(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 
+                                        0.0f, 0.0f), glm::vec3(1.0f));
+
+    m_uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    m_uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    m_uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_uniformBuffers[i], m_uniformBuffersMemory[i], 
+        MemoryTracker::Category::UNIFORM);
+
+        vkMapMemory(m_device, m_uniformBuffersMemory[i], 0, bufferSize, 
+                    0, &m_uniformBuffersMapped[i]);
+    }
+}
+
+// written by the CPU every frame, so one per frame in flight like the UBOs
+void TriangleApp::CreateDrawBuffers()
+{
+    PROFILE_FUNCTION();
+    VkDeviceSize indirectSize = sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAWS;
+    VkDeviceSize drawDataSize = sizeof(DrawData) * MAX_DRAWS;
+
+    m_indirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    m_indirectBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    m_indirectBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawDataBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawDataBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawDataBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawCountBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawCountBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    m_drawCountBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+    // the GPU culling pass writes the same buffers the CPU path fills
+    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        CreateBuffer(indirectSize, 
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_indirectBuffers[i], m_indirectBuffersMemory[i], 
+        MemoryTracker::Category::STORAGE, true);
+        vkMapMemory(m_device, m_indirectBuffersMemory[i], 0, indirectSize, 
+                    0, &m_indirectBuffersMapped[i]);
+
+        CreateBuffer(drawDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_drawDataBuffers[i], m_drawDataBuffersMemory[i], 
+        MemoryTracker::Category::STORAGE, true);
+        vkMapMemory(m_device, m_drawDataBuffersMemory[i], 0, drawDataSize, 
+                    0, &m_drawDataBuffersMapped[i]);
+
+        CreateBuffer(sizeof(uint32_t), 
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_drawCountBuffers[i], m_drawCountBuffersMemory[i], 
+        MemoryTracker::Category::STORAGE, true);
+        vkMapMemory(m_device, m_drawCountBuffersMemory[i], 0, sizeof(uint32_t), 
+                    0, &m_drawCountBuffersMapped[i]);
+        *static_cast<uint32_t*>(m_drawCountBuffersMapped[i]) = 0;
+    }
+}
+
+void TriangleApp::CreateCullPipeline()
+{
+    PROFILE_FUNCTION();
+    if (!m_gpuCulling)
+    {
+        return;
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(m_device, &layoutInfo,
+                                            m_allocator, &m_cullSetLayout))
+    {
+        throw std::runtime_error("failed to create cull set layout");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_cullSetLayout;
+
+    if (VK_SUCCESS != vkCreatePipelineLayout(m_device, &pipelineLayoutInfo,
+                                        m_allocator, &m_cullPipelineLayout))
+    {
+        throw std::runtime_error("failed to create cull pipeline layout");
+    }
+
+    auto cullShaderCode = ReadFile("shaders/cull_comp.spv");
+    VkShaderModule cullShaderModule = CreateShaderModule(cullShaderCode);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_cullPipelineLayout;
+
+    if (VK_SUCCESS != vkCreateComputePipelines(m_device, m_pipelineCache, 1, 
+                            &pipelineInfo, m_allocator, &m_cullPipeline))
+    {
+        throw std::runtime_error("failed to create cull pipeline");
+    }
+
+    vkDestroyShaderModule(m_device, cullShaderModule, m_allocator);
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(bindings.size()) * 
+                                MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, 
+                                            &m_cullDescriptorPool))
+    {
+        throw std::runtime_error("failed to create cull descriptor pool");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, 
+                                                m_cullSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_cullDescriptorPool;
+    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    allocInfo.pSetLayouts = layouts.data();
+
+    m_cullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (VK_SUCCESS != vkAllocateDescriptorSets(m_device, &allocInfo, 
+                                                m_cullDescriptorSets.data()))
+    {
+        throw std::runtime_error("failed to allocate cull descriptor sets");
+    }
+
+    // written by the CPU every frame, so one per frame in flight
+    m_cullConstantBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    m_cullConstantBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    m_cullConstantBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        CreateBuffer(sizeof(CullConstants), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_cullConstantBuffers[i], m_cullConstantBuffersMemory[i], 
+        MemoryTracker::Category::STORAGE, true);
+        vkMapMemory(m_device, m_cullConstantBuffersMemory[i], 0, 
+                    sizeof(CullConstants), 0, &m_cullConstantBuffersMapped[i]);
+
+        std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+        bufferInfos[0].buffer = m_meshletBuffer;
+        bufferInfos[1].buffer = m_indirectBuffers[i];
+        bufferInfos[2].buffer = m_drawDataBuffers[i];
+        bufferInfos[3].buffer = m_drawCountBuffers[i];
+        bufferInfos[4].buffer = m_cullConstantBuffers[i];
+
+        std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding)
+        {
+            bufferInfos[binding].offset = 0;
+            bufferInfos[binding].range = VK_WHOLE_SIZE;
+
+            descriptorWrites[binding].sType = 
+                                        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = m_cullDescriptorSets[i];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorType = 
+                                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(m_device, 
+                            static_cast<uint32_t>(descriptorWrites.size()), 
+                            descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void TriangleApp::CreateDescriptorPool()
+{
+    PROFILE_FUNCTION();
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, 
+                                            &m_descriptorPool))
+    {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+}
+
+void TriangleApp::CreateDescriptorSets()
+{
+    PROFILE_FUNCTION();
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, 
+                                                m_descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_descriptorPool;
+    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    allocInfo.pSetLayouts = layouts.data();
+
+    m_descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (VK_SUCCESS != vkAllocateDescriptorSets(m_device, &allocInfo, 
+                                                m_descriptorSets.data()))
+    {
+        throw std::runtime_error("failed to allocate descriptor sets");
+    }
+
+    for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = m_uniformBuffers[i];
         bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
+        bufferInfo.range = sizeof(TransformSystem::Instance);
 
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = m_textureImageView;
-        imageInfo.sampler = m_textureSampler;
+        VkDescriptorBufferInfo drawDataInfo{};
+        drawDataInfo.buffer = m_drawDataBuffers[i];
+        drawDataInfo.offset = 0;
+        drawDataInfo.range = sizeof(DrawData) * MAX_DRAWS;
 
         std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -1258,10 +3973,10 @@ void TriangleApp::CreateDescriptorSets()
         descriptorWrites[1].dstSet = m_descriptorSets[i];
         descriptorWrites[1].dstBinding = 1;
         descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pBufferInfo = nullptr;
+        descriptorWrites[1].pBufferInfo = &drawDataInfo;
+        descriptorWrites[1].pImageInfo = nullptr;
         descriptorWrites[1].pTexelBufferView = nullptr;
 
         vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), 
@@ -1271,68 +3986,290 @@ void TriangleApp::CreateDescriptorSets()
 
 void TriangleApp::CreateCommandBuffers()
 {
-    m_commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    PROFILE_FUNCTION();
+    AllocateRecordedCommands();
+
+    m_streamCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo streamInfo{};
+    streamInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    streamInfo.commandPool = m_commandPool;
+    streamInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    streamInfo.commandBufferCount = 
+                        static_cast<uint32_t>(m_streamCommandBuffers.size());
+    if (VK_SUCCESS != vkAllocateCommandBuffers(m_device, &streamInfo,
+                                            m_streamCommandBuffers.data()))
+    {
+        throw std::runtime_error("failed to allocate stream command buffers");
+    }
+
+    if (m_asyncCompute)
+    {
+        m_computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_computeCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 
+                        static_cast<uint32_t>(m_computeCommandBuffers.size());
+        if (VK_SUCCESS != vkAllocateCommandBuffers(m_device, &allocInfo,
+                                            m_computeCommandBuffers.data()))
+        {
+            throw std::runtime_error("failed to allocate compute command buffers");
+        }
+    }
+}
+
+// A recreated swapchain may have more images than the cache has rows for.
+// Existing buffers are kept, the new generation records them again.
+void TriangleApp::AllocateRecordedCommands()
+{
+    std::size_t count = m_swapChainImages.size() * MAX_FRAMES_IN_FLIGHT;
+    if (count <= m_recordedCommands.size())
+    {
+        return;
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(count - 
+                                                m_recordedCommands.size());
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = m_commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = static_cast<uint32_t>(m_commandBuffers.size());
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
 
     if (VK_SUCCESS != vkAllocateCommandBuffers(m_device, &allocInfo,
-                                                m_commandBuffers.data()))
+                                                commandBuffers.data()))
     {
         throw std::runtime_error("failed to allocate command buffers");
     }
+
+    for (VkCommandBuffer commandBuffer : commandBuffers)
+    {
+        m_recordedCommands.push_back({commandBuffer, 0, DrawStats{}});
+    }
 }
 
 void TriangleApp::CreateSyncObjects()
 {
+    PROFILE_FUNCTION();
     m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     m_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    m_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    m_frameTimelineValues.assign(MAX_FRAMES_IN_FLIGHT, 0);
+    m_frameSubmitTimes.assign(MAX_FRAMES_IN_FLIGHT, 0);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
     
     for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         if ((VK_SUCCESS != vkCreateSemaphore(m_device, &semaphoreInfo, 
-                                nullptr, &m_imageAvailableSemaphores[i])) || 
+                        m_allocator, &m_imageAvailableSemaphores[i])) || 
             (VK_SUCCESS != vkCreateSemaphore(m_device, &semaphoreInfo,
-                                nullptr, &m_renderFinishedSemaphores[i])) ||
-            (VK_SUCCESS != vkCreateFence(m_device, &fenceInfo,
-                                nullptr, &m_inFlightFences[i])))
+                                m_allocator, &m_renderFinishedSemaphores[i])))
         {
             throw std::runtime_error("failed to create sync objects");
         }
     }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    semaphoreInfo.pNext = &timelineInfo;
+
+    if (VK_SUCCESS != vkCreateSemaphore(m_device, &semaphoreInfo, 
+                                        m_allocator, &m_timeline))
+    {
+        throw std::runtime_error("failed to create timeline semaphore");
+    }
+
+    // the queues finish out of order, so compute signals its own timeline
+    if (m_asyncCompute && (VK_SUCCESS != vkCreateSemaphore(m_device, 
+                        &semaphoreInfo, m_allocator, &m_computeTimeline)))
+    {
+        throw std::runtime_error("failed to create compute timeline semaphore");
+    }
 }
+
 void TriangleApp::MainLoop()
 {
+    StartSimulation();
     while (!glfwWindowShouldClose(m_window))
     {
+        m_frameArena.Reset();
+        uint64_t heapAllocations = CountHeapAllocations();
         glfwPollEvents();
         ShowFPS();
+        StepResizeBenchmark();
+
+        uint64_t frameNumber = m_frameNumber;
+        uint32_t recordedFrames = m_recordedFrames;
         DrawFrame();
+        if ((0 == frameNumber) && (1 == m_frameNumber))
+        {
+            std::chrono::duration<double, std::milli> elapsed = 
+                            std::chrono::steady_clock::now() - m_startTime;
+            std::cout << "first frame: " << elapsed.count() << " ms (" << 
+            (m_warmPipelineCache ? "warm" : "cold") << " pipeline cache)" << 
+            std::endl;
+        }
+
+        if (0 != m_options.m_allocTestFrames)
+        {
+            StepAllocTest(CountHeapAllocations() - heapAllocations);
+        }
+        if (0 != m_options.m_reuseTestFrames)
+        {
+            StepReuseTest(recordedFrames != m_recordedFrames);
+        }
     }
+    StopSimulation();
 
     vkDeviceWaitIdle(m_device);
+    ReportResizeBenchmark();
+}
+
+void TriangleApp::StartSimulation()
+{
+    m_simulationRunning.store(true, std::memory_order_relaxed);
+    m_simulationThread = std::thread(&TriangleApp::SimulationLoop, this);
+}
+
+void TriangleApp::StopSimulation()
+{
+    m_simulationRunning.store(false, std::memory_order_relaxed);
+    if (m_simulationThread.joinable())
+    {
+        m_simulationThread.join();
+    }
+}
+
+// Advances the simulation in fixed ticks and publishes every tick, rendering
+// never waits for it. Late ticks run back to back to catch up; a thread more
+// than MAX_CATCH_UP_TICKS behind drops the missed time instead of spiralling.
+void TriangleApp::SimulationLoop()
+{
+    PROFILE_THREAD("simulation");
+    using Clock = std::chrono::steady_clock;
+
+    double dt = 1.0 / m_options.m_tickRate;
+    auto tick = std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(dt));
+
+    SimulationState state{};
+    uint64_t lateTicks = 0;
+    Clock::time_point next = Clock::now();
+    while (m_simulationRunning.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(next);
+
+        SimulationState previous = state;
+        StepSimulation(state, dt);
+
+        SimulationFrame& frame = m_simulation.GetBack();
+        frame.m_previous = previous;
+        frame.m_current = state;
+        frame.m_tickTime = next;
+        frame.m_lateTicks = lateTicks;
+        m_simulation.Publish();
+
+        next += tick;
+        Clock::time_point now = Clock::now();
+        if (now > next)
+        {
+            ++lateTicks;
+            if (now - next > MAX_CATCH_UP_TICKS * tick)
+            {
+                next = now;
+            }
+        }
+    }
+}
+
+// --sim-load stands in for game logic that takes that long every tick
+void TriangleApp::StepSimulation(SimulationState& state, double dt) const
+{
+    PROFILE_FUNCTION();
+    if (0.0 < m_options.m_simulationLoadMs)
+    {
+        auto end = std::chrono::steady_clock::now() + 
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(
+                                        m_options.m_simulationLoadMs));
+        while (std::chrono::steady_clock::now() < end)
+        {
+        }
+    }
+
+    state.m_angle += dt * glm::radians(90.0);
 }
 
 void TriangleApp::DrawFrame()
 {
-    vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], 
-                                    VK_TRUE, UINT64_MAX);
+    PROFILE_FUNCTION();
+    // the occluders rasterize on the workers while the GPU finishes the
+    // frame this slot waits for
+    UpdateCamera();
+    if (m_options.m_occlusionCulling)
+    {
+        m_occlusion.Render(m_modelViewProj);
+    }
+    RequestTextureMips();
+
+    {
+        PROFILE_ZONE("fence wait");
+        WaitForTimeline(m_frameTimelineValues[m_currentFrame]);
+    }
+
+    uint64_t completedValue = 0;
+    vkGetSemaphoreCounterValue(m_device, m_timeline, &completedValue);
+    m_deletionQueue.Collect(completedValue);
+    m_bindless.Collect(completedValue);
+    if (m_capture)
+    {
+        m_readback.Poll(completedValue);
+    }
+
+    m_memory.UpdateBudget();
+    if (m_memoryReportRequested)
+    {
+        m_memory.Report(std::cout);
+        m_hostAllocator.Report(std::cout);
+        m_memoryReportRequested = false;
+    }
+    if (m_pickRequested)
+    {
+        PickMesh();
+        m_pickRequested = false;
+    }
+
+    if ((ChooseSampleCount(m_requestedSamples) != m_msaaSamples) ||
+        (m_requestedDynamicResolution != m_dynamicResolution) ||
+        (m_requestedDepthPrepass != m_depthPrepass))
+    {
+        ApplyQuality();
+    }
+    UpdateRenderScale();
+    ReadPipelineStatistics();
+    TraceGpuFrame();
+    MeasureComputeOverlap();
+    if (m_options.m_occlusionCulling)
+    {
+        PROFILE_ZONE("occlusion wait");
+        m_occlusion.Wait();
+    }
     
     uint32_t imageIndex = 0;
-    VkResult result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, 
+    VkResult result = VK_SUCCESS;
+    {
+        PROFILE_ZONE("acquire");
+        result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, 
                                     m_imageAvailableSemaphores[m_currentFrame], 
                                     VK_NULL_HANDLE, &imageIndex);
+    }
     if (VK_ERROR_OUT_OF_DATE_KHR == result)
     {
         RecreateSwapChain();
@@ -1342,110 +4279,564 @@ void TriangleApp::DrawFrame()
     {
         throw std::runtime_error("failed to acquire swap chain image");
     }
+
+    if (m_gpuCulling)
+    {
+        PrepareCulling();
+    }
+
+    uint64_t computeValue = 0;
+    if (m_asyncCompute)
+    {
+        PROFILE_ZONE("compute submit");
+        computeValue = SubmitCompute();
+    }
     
-    vkResetFences(m_device, 1, &m_inFlightFences[m_currentFrame]);
+    {
+        PROFILE_ZONE("ubo update");
+        UpdateUniformBuffer(m_currentFrame);
+    }
+
+    if (m_capture)
+    {
+        m_captureSlot = m_readback.Acquire(m_swapChainExtent);
+    }
 
-    vkResetCommandBuffer(m_commandBuffers[m_currentFrame], 0);
-    RecordCommandBuffer(m_commandBuffers[m_currentFrame], imageIndex);
+    // the image is acquired, so the residency copies are submitted with
+    // this frame and retire with it
+    VkCommandBuffer streamCommands = UpdateResidency();
 
-    UpdateUniformBuffer(m_currentFrame);
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    {
+        PROFILE_ZONE("record");
+        commandBuffer = GetFrameCommands(imageIndex);
+    }
+    std::array<VkCommandBuffer, 2> commandBuffers = {streamCommands, 
+                                                    commandBuffer};
+    uint32_t firstCommands = (VK_NULL_HANDLE == streamCommands) ? 1 : 0;
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = {m_imageAvailableSemaphores[m_currentFrame]};
+    VkSemaphore waitSemaphores[] = 
+    {m_imageAvailableSemaphores[m_currentFrame], m_computeTimeline};
     VkPipelineStageFlags waitStages[] = 
-    {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT};
+    uint64_t waitValues[] = {0, computeValue};
+    submitInfo.waitSemaphoreCount = m_asyncCompute ? 2 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = 
+                    static_cast<uint32_t>(commandBuffers.size()) - firstCommands;
+    submitInfo.pCommandBuffers = commandBuffers.data() + firstCommands;
+
+    // the binary semaphore feeds present, the timeline paces the CPU
+    uint64_t frameValue = NextTimelineValue();
+    VkSemaphore signalSemaphores[] = 
+    {m_renderFinishedSemaphores[m_currentFrame], m_timeline};
+    uint64_t signalValues[] = {0, frameValue};
+    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submitInfo.pNext = &timelineInfo;
+
+    m_frameSubmitTimes[m_currentFrame] = Profiler::Now();
+    {
+        PROFILE_ZONE("submit");
+        if (VK_SUCCESS != vkQueueSubmit(m_graphicsQueue, 1, &submitInfo,
+                                        VK_NULL_HANDLE))
+        {
+            throw std::runtime_error("failed to submit draw command buffer");
+        }
+    }
+    m_timelineValue = frameValue;
+    m_frameTimelineValues[m_currentFrame] = frameValue;
+    if (m_capture && (ReadbackRing::NO_SLOT != m_captureSlot))
+    {
+        m_readback.Submit(m_captureSlot, frameValue, m_frameNumber);
+    }
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+    
+    VkSwapchainKHR swapChains[] = {m_swapChain};
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapChains;
+    presentInfo.pImageIndices = &imageIndex;
+    presentInfo.pResults = nullptr;
+
+    {
+        PROFILE_ZONE("present");
+        result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+    }
+    if ((VK_ERROR_OUT_OF_DATE_KHR == result) || 
+        (VK_SUBOPTIMAL_KHR == result) ||
+        m_framebufferResized)
+    {
+        m_framebufferResized = false;
+        RecreateSwapChain();
+    }
+    else if (VK_SUCCESS != result)
+    {
+        throw std::runtime_error("failed to present swap chain image");
+    }
+
+    m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    ++m_frameNumber;
+}
+
+// waits on the shared timeline, a wait that exceeds the frame budget is 
+// counted as a stall and only a wait far beyond it is treated as a hang
+void TriangleApp::WaitForTimeline(uint64_t value, uint64_t budget)
+{
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_timeline;
+    waitInfo.pValues = &value;
+
+    VkResult result = vkWaitSemaphores(m_device, &waitInfo, budget);
+    if ((VK_TIMEOUT == result) && (budget < GPU_HANG_TIMEOUT_NS))
+    {
+        ++m_overBudgetWaits;
+        result = vkWaitSemaphores(m_device, &waitInfo, GPU_HANG_TIMEOUT_NS);
+    }
+
+    if (VK_SUCCESS != result)
+    {
+        throw std::runtime_error("failed to wait for timeline semaphore");
+    }
+}
+
+inline uint64_t TriangleApp::NextTimelineValue() const
+{
+    return (m_timelineValue + 1);
+}
+
+// switches the quality preset between frames, everything that depends on the
+// sample count is rebuilt and the old objects retire with the frames using them
+void TriangleApp::ApplyQuality()
+{
+    if (m_requestedDynamicResolution && (VK_NULL_HANDLE == m_timestampPool))
+    {
+        m_requestedDynamicResolution = false;
+    }
+
+    uint64_t lastUse = NextTimelineValue();
+    m_deletionQueue.Retire(m_graphicsPipeline, lastUse);
+    m_deletionQueue.Retire(m_prepassPipeline, lastUse);
+    m_deletionQueue.Retire(m_pipelineLayout, lastUse);
+    m_deletionQueue.Retire(m_renderPass, lastUse);
+
+    for (auto framebuffer : m_swapChainFramebuffers)
+    {
+        m_deletionQueue.Retire(framebuffer, lastUse);
+    }
+
+    for (auto framebuffer : m_upscaleFramebuffers)
+    {
+        m_deletionQueue.Retire(framebuffer, lastUse);
+    }
+
+    m_msaaSamples = ChooseSampleCount(m_requestedSamples);
+    m_dynamicResolution = m_requestedDynamicResolution;
+    m_depthPrepass = m_requestedDepthPrepass;
+    m_renderScale = 1.0f;
+    m_gpuFrameMs = 0.0;
+
+    CreateRenderPass();
+    CreateGraphicsPipeline();
+    CreateRenderGraph();
+    CreateFramebuffers();
+
+    std::cout << "quality: msaa " << m_msaaSamples << "x, dynamic resolution " << 
+    (m_dynamicResolution ? "on" : "off") << ", depth prepass " << 
+    (m_depthPrepass ? "on" : "off") << std::endl;
+}
+
+// Reads the GPU time of the frame that last used this slot and steers the
+// render scale towards the target. The pixel count grows with the square of
+// the scale, and each step is bounded so the resolution does not oscillate.
+void TriangleApp::UpdateRenderScale()
+{
+    if (!m_dynamicResolution || (0 == m_frameTimelineValues[m_currentFrame]))
+    {
+        return;
+    }
+
+    uint64_t timestamps[2] = {0, 0};
+    if (VK_SUCCESS != vkGetQueryPoolResults(m_device, m_timestampPool, 
+                    2 * m_currentFrame, 2, sizeof(timestamps), timestamps, 
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+    {
+        return;
+    }
+
+    double gpuMs = static_cast<double>(GetFrameTicks(timestamps)) * 
+                    m_timestampPeriod / 1000000.0;
+    m_gpuFrameMs = (0.0 == m_gpuFrameMs) ? gpuMs : 
+                    m_gpuFrameMs + GPU_TIME_SMOOTHING * (gpuMs - m_gpuFrameMs);
+
+    double targetMs = (0.0 < m_options.m_targetFrameMs) ? 
+                    m_options.m_targetFrameMs : FRAME_BUDGET_NS / 1000000.0;
+    float step = static_cast<float>(std::sqrt(targetMs / 
+                                        std::max(m_gpuFrameMs, 0.001)));
+    step = std::clamp(step, 1.0f - MAX_RENDER_SCALE_STEP, 
+                        1.0f + MAX_RENDER_SCALE_STEP);
+    float renderScale = std::clamp(m_renderScale * step, MIN_RENDER_SCALE, 
+                                    1.0f);
+
+    // The scale is baked into the recorded render area and upscale constants.
+    // It moves in whole quanta and only when the controller asks for at least
+    // one, so a settled controller keeps the recorded command buffers.
+    if (std::abs(renderScale - m_renderScale) >= RENDER_SCALE_QUANTUM)
+    {
+        m_renderScale = std::clamp(RENDER_SCALE_QUANTUM * 
+                        std::round(renderScale / RENDER_SCALE_QUANTUM), 
+                        MIN_RENDER_SCALE, 1.0f);
+        ++m_commandGeneration;
+    }
+}
+
+// Fragment invocations per pixel of the color pass measure the overdraw the
+// prepass removes, vertex invocations what it costs.
+void TriangleApp::ReadPipelineStatistics()
+{
+    if ((VK_NULL_HANDLE == m_statisticsPool) || 
+        (0 == m_frameTimelineValues[m_currentFrame]))
+    {
+        return;
+    }
+
+    uint64_t statistics[2] = {0, 0};
+    if (VK_SUCCESS == vkGetQueryPoolResults(m_device, m_statisticsPool, 
+                    m_currentFrame, 1, sizeof(statistics), statistics, 
+                    sizeof(statistics), VK_QUERY_RESULT_64_BIT))
+    {
+        m_vertexInvocations = statistics[0];
+        m_fragmentInvocations = statistics[1];
+    }
+}
+
+// Places the GPU time of the frame that last used this slot on the CPU clock
+// of the trace. Calibrated timestamps read both clocks at one instant, without
+// them the frame is assumed to start when it was submitted.
+void TriangleApp::TraceGpuFrame()
+{
+    if (m_options.m_tracePath.empty() || (VK_NULL_HANDLE == m_timestampPool) ||
+        (0 == m_frameTimelineValues[m_currentFrame]))
+    {
+        return;
+    }
+
+    uint64_t timestamps[2] = {0, 0};
+    if (VK_SUCCESS != vkGetQueryPoolResults(m_device, m_timestampPool, 
+                    2 * m_currentFrame, 2, sizeof(timestamps), timestamps, 
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+    {
+        return;
+    }
+
+    uint64_t begin = m_frameSubmitTimes[m_currentFrame];
+    uint64_t now[2] = {0, 0};
+    if (CalibrateTimestamps(now))
+    {
+        begin = ToHostTime(timestamps[0], now);
+    }
+
+    uint64_t duration = static_cast<uint64_t>(
+        static_cast<double>(GetFrameTicks(timestamps)) * m_timestampPeriod);
+    Profiler::Get().AddGpuZone("gpu frame", begin, begin + duration);
+}
+
+// the ticks between the two timestamps of a frame, counting a wrap of the
+// valid bits in between
+uint64_t TriangleApp::GetFrameTicks(const uint64_t (&timestamps)[2]) const
+{
+    return (timestamps[1] - timestamps[0]) & m_timestampMask;
+}
+
+// Reads the device clock and CLOCK_MONOTONIC at one instant into now, false
+// without calibrated timestamps.
+bool TriangleApp::CalibrateTimestamps(uint64_t (&now)[2]) const
+{
+    if (nullptr == m_getCalibratedTimestamps)
+    {
+        return false;
+    }
+
+    VkCalibratedTimestampInfoEXT timestampInfos[2]{};
+    timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+    uint64_t maxDeviation = 0;
+
+    return (VK_SUCCESS == m_getCalibratedTimestamps(m_device, 2, 
+                                    timestampInfos, now, &maxDeviation));
+}
+
+// a timestamp written before the calibration, in nanoseconds of the host clock
+uint64_t TriangleApp::ToHostTime(uint64_t timestamp, 
+                                const uint64_t (&now)[2]) const
+{
+    return now[1] - static_cast<uint64_t>(
+                    static_cast<double>(now[0] - timestamp) * m_timestampPeriod);
+}
+
+// Culls on the compute queue while the graphics queue still renders the
+// previous frame. The frame slot was waited on, so the command buffer and the
+// draw buffers of the slot are free again.
+uint64_t TriangleApp::SubmitCompute()
+{
+    VkCommandBuffer commandBuffer = m_computeCommandBuffers[m_currentFrame];
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo))
+    {
+        throw std::runtime_error("failed to begin compute command buffer");
+    }
+
+    uint32_t firstQuery = 2 * m_currentFrame;
+    if (VK_NULL_HANDLE != m_computeTimestampPool)
+    {
+        vkCmdResetQueryPool(commandBuffer, m_computeTimestampPool, 
+                            firstQuery, 2);
+        vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+                            m_computeTimestampPool, firstQuery);
+    }
+
+    RecordCullPass(commandBuffer);
+
+    if (VK_NULL_HANDLE != m_computeTimestampPool)
+    {
+        vkCmdWriteTimestamp2(commandBuffer, 
+                            VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+                            m_computeTimestampPool, firstQuery + 1);
+    }
+
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+    {
+        throw std::runtime_error("failed to record compute command buffer");
+    }
+
+    uint64_t value = m_computeTimelineValue + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &value;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffers[m_currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_computeTimeline;
+
+    if (VK_SUCCESS != vkQueueSubmit(m_computeQueue, 1, &submitInfo, 
+                                    VK_NULL_HANDLE))
+    {
+        throw std::runtime_error("failed to submit compute command buffer");
+    }
+    m_computeTimelineValue = value;
+
+    return value;
+}
+
+// Share of the culling dispatch that ran while the graphics queue rendered
+// the frame before it. Both finished when their slot was waited on. Only
+// timestamps of one queue compare directly, so both ranges are moved onto the
+// host clock through the calibrated device domain before they are compared.
+void TriangleApp::MeasureComputeOverlap()
+{
+    if ((VK_NULL_HANDLE == m_computeTimestampPool) || 
+        (VK_NULL_HANDLE == m_timestampPool) ||
+        (0 == m_frameTimelineValues[m_currentFrame]))
+    {
+        return;
+    }
 
-    VkSemaphore signalSemaphores[] = {m_renderFinishedSemaphores[m_currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    uint64_t compute[2] = {0, 0};
+    uint64_t graphics[2] = {0, 0};
+    if ((VK_SUCCESS != vkGetQueryPoolResults(m_device, m_computeTimestampPool,
+                    2 * m_currentFrame, 2, sizeof(compute), compute, 
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT)) ||
+        (VK_SUCCESS != vkGetQueryPoolResults(m_device, m_timestampPool, 
+                    2 * m_currentFrame, 2, sizeof(graphics), graphics, 
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT)))
+    {
+        return;
+    }
 
-    if (VK_SUCCESS != vkQueueSubmit(m_graphicsQueue, 1, &submitInfo,
-                                    m_inFlightFences[m_currentFrame]))
+    uint64_t now[2] = {0, 0};
+    if (!CalibrateTimestamps(now))
+    {
+        return;
+    }
+    for (uint64_t *timestamps : {compute, graphics})
     {
-        throw std::runtime_error("failed to submit draw command buffer");
+        timestamps[0] = ToHostTime(timestamps[0], now);
+        timestamps[1] = ToHostTime(timestamps[1], now);
     }
 
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-    
-    VkSwapchainKHR swapChains[] = {m_swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = nullptr;
+    uint64_t overlapBegin = std::max(compute[0], m_lastGraphicsTimestamps[0]);
+    uint64_t overlapEnd = std::min(compute[1], m_lastGraphicsTimestamps[1]);
+    double overlap = (overlapEnd > overlapBegin) ? 
+                    static_cast<double>(overlapEnd - overlapBegin) / 
+                    static_cast<double>(std::max<uint64_t>(1, 
+                                                compute[1] - compute[0])) : 0.0;
+    m_computeOverlap += GPU_TIME_SMOOTHING * (overlap - m_computeOverlap);
+    m_lastGraphicsTimestamps = {graphics[0], graphics[1]};
+}
 
-    result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
-    if ((VK_ERROR_OUT_OF_DATE_KHR == result) || 
-        (VK_SUBOPTIMAL_KHR == result) ||
-        m_framebufferResized)
+void TriangleApp::WriteTrace()
+{
+    if (!Profiler::Get().WriteChromeTrace(m_options.m_tracePath))
     {
-        m_framebufferResized = false;
-        RecreateSwapChain();
+        throw std::runtime_error("failed to write trace " + 
+                                m_options.m_tracePath);
     }
-    else if (VK_SUCCESS != result)
+
+    std::cout << "trace: " << m_options.m_tracePath << 
+#ifdef ENABLE_PROFILER
+    (m_calibratedTimestamps ? "" : " (gpu zones aligned to submit)") <<
+#else
+    " (gpu zones only, build with PROFILE=1 for cpu zones)" <<
+#endif
+    std::endl;
+}
+
+inline VkExtent2D TriangleApp::GetRenderExtent() const
+{
+    if (!m_dynamicResolution)
     {
-        throw std::runtime_error("failed to present swap chain image");
+        return m_swapChainExtent;
     }
 
-    m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    return {std::max(1u, static_cast<uint32_t>(
+                        m_swapChainExtent.width * m_renderScale)),
+            std::max(1u, static_cast<uint32_t>(
+                        m_swapChainExtent.height * m_renderScale))};
 }
 
 void TriangleApp::Cleanup()
 {
+    vkDestroySemaphore(m_device, m_timeline, m_allocator);
+    vkDestroySemaphore(m_device, m_computeTimeline, m_allocator);
     for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
-        vkDestroyFence(m_device, m_inFlightFences[i], nullptr);
-        vkDestroySemaphore(m_device, m_renderFinishedSemaphores[i], nullptr);
-        vkDestroySemaphore(m_device, m_imageAvailableSemaphores[i], nullptr);
+        vkDestroySemaphore(m_device, m_renderFinishedSemaphores[i], 
+                            m_allocator);
+        vkDestroySemaphore(m_device, m_imageAvailableSemaphores[i], 
+                            m_allocator);
     }
 
-    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    vkDestroyCommandPool(m_device, m_commandPool, m_allocator);
+    vkDestroyCommandPool(m_device, m_computeCommandPool, m_allocator);
     
-    CleanupSwapChain();
-
-    vkDestroySampler(m_device, m_textureSampler, nullptr);
-    vkDestroyImageView(m_device, m_textureImageView, nullptr);
+    if (m_capture)
+    {
+        ReadbackRing::Stats stats = m_readback.GetStats();
+        m_readback.Destroy();
+        std::cout << "capture: " << stats.m_captured << " frames, " << 
+        stats.m_dropped << " dropped" << std::endl;
+    }
 
-    vkDestroyImage(m_device, m_textureImage, nullptr);
-    vkFreeMemory(m_device, m_textureImageMemory, nullptr);
+    RetireSwapChain();
+    m_deletionQueue.Flush();
+
+    vkDestroyQueryPool(m_device, m_timestampPool, m_allocator);
+    vkDestroyQueryPool(m_device, m_computeTimestampPool, m_allocator);
+    vkDestroyQueryPool(m_device, m_statisticsPool, m_allocator);
+    vkDestroyPipeline(m_device, m_upscalePipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_upscalePipelineLayout, m_allocator);
+    vkDestroyRenderPass(m_device, m_upscaleRenderPass, m_allocator);
+    vkDestroyDescriptorPool(m_device, m_upscaleDescriptorPool, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_upscaleSetLayout, m_allocator);
+    vkDestroySampler(m_device, m_upscaleSampler, m_allocator);
+
+    vkDestroySampler(m_device, m_textureSampler, m_allocator);
+    if (m_computeMips)
+    {
+        m_mipGenerator.Destroy();
+    }
+    m_streamer.Stop();
+    for (const Texture& texture : m_textures)
+    {
+        vkDestroyImageView(m_device, texture.m_view, m_allocator);
+        vkDestroyImage(m_device, texture.m_image, m_allocator);
+        m_memory.Free(texture.m_memory);
+    }
     
     for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
-        vkDestroyBuffer(m_device, m_uniformBuffers[i], nullptr);
-        vkFreeMemory(m_device, m_uniformBuffersMemory[i], nullptr);
+        vkDestroyBuffer(m_device, m_uniformBuffers[i], m_allocator);
+        m_memory.Free(m_uniformBuffersMemory[i]);
+        vkDestroyBuffer(m_device, m_indirectBuffers[i], m_allocator);
+        m_memory.Free(m_indirectBuffersMemory[i]);
+        vkDestroyBuffer(m_device, m_drawDataBuffers[i], m_allocator);
+        m_memory.Free(m_drawDataBuffersMemory[i]);
+        vkDestroyBuffer(m_device, m_drawCountBuffers[i], m_allocator);
+        m_memory.Free(m_drawCountBuffersMemory[i]);
     }
 
-    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
-
-    vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
-    vkFreeMemory(m_device, m_indexBufferMemory, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, m_allocator);
 
-    vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
-    vkFreeMemory(m_device, m_vertexBufferMemory, nullptr);
+    m_bindless.Destroy();
+    vkDestroyBuffer(m_device, m_materialBuffer, m_allocator);
+    m_memory.Free(m_materialBufferMemory);
 
-    vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-    vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+    m_geometryPool.Destroy([this](VkDeviceMemory memory)
+    {
+        m_memory.Free(memory);
+    });
+    m_occlusion.Destroy();
+    vkDestroyBuffer(m_device, m_meshletBuffer, m_allocator);
+    m_memory.Free(m_meshletBufferMemory);
+    for (std::size_t i = 0; i < m_cullConstantBuffers.size(); ++i)
+    {
+        vkDestroyBuffer(m_device, m_cullConstantBuffers[i], m_allocator);
+        m_memory.Free(m_cullConstantBuffersMemory[i]);
+    }
+    vkDestroyPipeline(m_device, m_cullPipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, m_allocator);
+    vkDestroyDescriptorPool(m_device, m_cullDescriptorPool, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_cullSetLayout, m_allocator);
+
+    vkDestroyPipeline(m_device, m_graphicsPipeline, m_allocator);
+    vkDestroyPipeline(m_device, m_prepassPipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+    vkDestroyRenderPass(m_device, m_renderPass, m_allocator);
+
+    SavePipelineCache();
+    vkDestroyPipelineCache(m_device, m_pipelineCache, m_allocator);
     
-    vkDestroyDevice(m_device, nullptr);
+    vkDestroyDevice(m_device, m_allocator);
     
     if (s_enableValidationLayers)
     {
-        DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
+        DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, 
+                                        m_allocator);
     }
 
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-    vkDestroyInstance(m_instance, nullptr);
+    vkDestroySurfaceKHR(m_instance, m_surface, m_allocator);
+    vkDestroyInstance(m_instance, m_allocator);
     
     glfwDestroyWindow(m_window);
 
@@ -1519,11 +4910,30 @@ bool TriangleApp::IsDeviceSuitable(VkPhysicalDevice device)
                              !swapChainSupport.m_presentModes.empty());
     }
 
-    VkPhysicalDeviceFeatures supportedFeatures;
-    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.pNext = &vulkan13Features;
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &supportedFeatures);
 
     return (indices.IsComplete() && swapChainAdequate && 
-            supportedFeatures.samplerAnisotropy);
+            (properties.apiVersion >= VK_API_VERSION_1_3) &&
+            supportedFeatures.features.samplerAnisotropy &&
+            supportedFeatures.features.drawIndirectFirstInstance &&
+            vulkan12Features.timelineSemaphore &&
+            vulkan12Features.runtimeDescriptorArray &&
+            vulkan12Features.descriptorBindingPartiallyBound &&
+            vulkan12Features.descriptorBindingVariableDescriptorCount &&
+            vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+            vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+            vulkan13Features.synchronization2);
 }
 
 bool TriangleApp::CheckDeviceExtensionSupport(VkPhysicalDevice device)
@@ -1545,6 +4955,54 @@ bool TriangleApp::CheckDeviceExtensionSupport(VkPhysicalDevice device)
     return (requiredExtensions.empty());
 }
 
+bool TriangleApp::HasDeviceExtension(VkPhysicalDevice device, const char *name)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, 
+                                        &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, 
+                                &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions)
+    {
+        if (0 == strcmp(name, extension.extensionName))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the trace and the compute overlap need the device clock and
+// CLOCK_MONOTONIC, the clock behind std::chrono::steady_clock
+bool TriangleApp::SupportsCalibratedTimestamps(VkPhysicalDevice device) const
+{
+    if (!HasDeviceExtension(device, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+    {
+        return false;
+    }
+
+    auto getTimeDomains = PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+                        vkGetInstanceProcAddr(m_instance, 
+                        "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (nullptr == getTimeDomains)
+    {
+        return false;
+    }
+
+    uint32_t domainCount = 0;
+    getTimeDomains(device, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getTimeDomains(device, &domainCount, domains.data());
+
+    return ((domains.end() != std::find(domains.begin(), domains.end(), 
+                                        VK_TIME_DOMAIN_DEVICE_EXT)) && 
+            (domains.end() != std::find(domains.begin(), domains.end(), 
+                                        VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT)));
+}
+
 int TriangleApp::RateDevice(VkPhysicalDevice device)
 {
     VkPhysicalDeviceProperties deviceProperties;
@@ -1606,6 +5064,17 @@ TriangleApp::FindQueueFamilies(VkPhysicalDevice device)
         }
     }
 
+    // a compute family without graphics runs beside the graphics queue
+    for (uint32_t i = 0; i < queueFamilyCount; ++i)
+    {
+        if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+            !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            indices.m_computeFamily = i;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -1707,86 +5176,512 @@ inline std::vector<char> TriangleApp::ReadFile(const std::string& filename)
     return buffer;
 }
 
-inline VkShaderModule TriangleApp::CreateShaderModule(const std::vector<char>& code)
+inline VkShaderModule TriangleApp::CreateShaderModule(const std::vector<char>& code)
+{
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shaderModule;
+    if (VK_SUCCESS != vkCreateShaderModule(m_device, &createInfo, 
+                                            m_allocator, &shaderModule))
+    {
+        throw std::runtime_error("failed to create shader module");
+    }
+
+    return shaderModule;
+}
+
+// Every pass reads its per-frame data from buffers, so a recording stays
+// valid until the render graph is rebuilt, which recreates the pipelines and
+// framebuffers it refers to, or the render scale changes. The CPU culling
+// path bakes the visible draws into the recording and capture the ring slot,
+// those record every frame. The slot was waited on, so none of its buffers
+// is pending.
+VkCommandBuffer TriangleApp::GetFrameCommands(uint32_t imageIndex)
+{
+    RecordedCommands& recorded = 
+        m_recordedCommands[imageIndex * MAX_FRAMES_IN_FLIGHT + m_currentFrame];
+    bool reusable = m_options.m_commandReuse && m_gpuCulling && !m_capture;
+    if (reusable && (m_commandGeneration == recorded.m_generation))
+    {
+        m_drawStats = recorded.m_drawStats;
+        m_drawStats.m_draws = m_visibleMeshlets;
+        return recorded.m_commandBuffer;
+    }
+
+    vkResetCommandBuffer(recorded.m_commandBuffer, 0);
+    RecordCommandBuffer(recorded.m_commandBuffer, imageIndex);
+    recorded.m_generation = reusable ? m_commandGeneration : 0;
+    recorded.m_drawStats = m_drawStats;
+    ++m_recordedFrames;
+
+    return recorded.m_commandBuffer;
+}
+
+void TriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, 
+                                        uint32_t imageIndex)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0;
+    beginInfo.pInheritanceInfo = nullptr;
+
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo))
+    {
+        throw std::runtime_error("failed to begin recording command buffer");
+    }
+
+    uint32_t firstQuery = 2 * m_currentFrame;
+    if (VK_NULL_HANDLE != m_timestampPool)
+    {
+        vkCmdResetQueryPool(commandBuffer, m_timestampPool, firstQuery, 2);
+        vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+                            m_timestampPool, firstQuery);
+    }
+
+    if (VK_NULL_HANDLE != m_statisticsPool)
+    {
+        vkCmdResetQueryPool(commandBuffer, m_statisticsPool, m_currentFrame, 1);
+    }
+
+    m_imageIndex = imageIndex;
+    m_renderGraph.SetImportedImage(m_graphBackBuffer, 
+                                    m_swapChainImages[imageIndex]);
+    m_renderGraph.SetImportedBuffer(m_graphIndirect, 
+                                    m_indirectBuffers[m_currentFrame]);
+    m_renderGraph.SetImportedBuffer(m_graphDrawData, 
+                                    m_drawDataBuffers[m_currentFrame]);
+    m_renderGraph.SetImportedBuffer(m_graphDrawCount, 
+                                    m_drawCountBuffers[m_currentFrame]);
+    if (m_capture)
+    {
+        m_renderGraph.SetImportedBuffer(m_graphReadback, 
+                                        m_readback.GetBuffer(m_captureSlot));
+    }
+    m_renderGraph.Execute(commandBuffer);
+
+    if (VK_NULL_HANDLE != m_timestampPool)
+    {
+        vkCmdWriteTimestamp2(commandBuffer, 
+                            VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+                            m_timestampPool, firstQuery + 1);
+    }
+
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+    {
+        throw std::runtime_error("failed to record command buffer");
+    }
+}
+
+void TriangleApp::RecordScenePass(VkCommandBuffer commandBuffer)
+{
+    VkExtent2D renderExtent = GetRenderExtent();
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_renderPass;
+    renderPassInfo.framebuffer = m_swapChainFramebuffers[m_imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = renderExtent;
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    if (VK_NULL_HANDLE != m_statisticsPool)
+    {
+        vkCmdBeginQuery(commandBuffer, m_statisticsPool, m_currentFrame, 0);
+    }
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, 
+                            VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(renderExtent.width);
+    viewport.height = static_cast<float>(renderExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    m_drawStats = DrawStats{};
+
+    // the culling pass already wrote the commands on the GPU path, its count
+    // buffer bounds the draws
+    uint32_t commandCount = MAX_DRAWS;
+    if (!m_gpuCulling)
+    {
+        SortDraws();
+        commandCount = CullMeshlets();
+        m_visibleMeshlets = commandCount;
+    }
+
+    std::array<VkDescriptorSet, 2> descriptorSets = 
+    {m_descriptorSets[m_currentFrame], m_bindless.GetSet()};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+    m_pipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), 
+    descriptorSets.data(), 0, nullptr);
+    ++m_drawStats.m_descriptorBinds;
+
+    // the prepass draws every command in one call, pipeline runs only matter
+    // for shading
+    if (m_depthPrepass)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                        m_prepassPipeline);
+        ++m_drawStats.m_pipelineBinds;
+        m_geometryPool.BindPositions(commandBuffer);
+        ++m_drawStats.m_vertexBufferBinds;
+
+        DrawCommands(commandBuffer, 0, commandCount);
+
+        vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    m_geometryPool.Bind(commandBuffer);
+    ++m_drawStats.m_vertexBufferBinds;
+
+    if (m_gpuCulling)
+    {
+        // every scene draw shares one pipeline until the culling shader
+        // learns to bin by key
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                        m_graphicsPipeline);
+        ++m_drawStats.m_pipelineBinds;
+
+        DrawCommands(commandBuffer, 0, commandCount);
+        m_drawStats.m_draws = m_visibleMeshlets;
+    }
+
+    // one indirect call per run of draws sharing a pipeline, the descriptor
+    // sets are compatible across every scene pipeline
+    uint32_t first = 0;
+    while (!m_gpuCulling && (first < m_draws.size()))
+    {
+        uint32_t pipeline = static_cast<uint32_t>(m_draws[first].m_key >> 56);
+        uint32_t last = first + 1;
+        while ((last < m_draws.size()) && 
+               (pipeline == static_cast<uint32_t>(m_draws[last].m_key >> 56)))
+        {
+            ++last;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                        m_graphicsPipeline);
+        ++m_drawStats.m_pipelineBinds;
+
+        uint32_t firstCommand = m_draws[first].m_firstCommand;
+        uint32_t lastCommand = m_draws[last - 1].m_firstCommand + 
+                                m_draws[last - 1].m_commandCount;
+        DrawCommands(commandBuffer, firstCommand, lastCommand - firstCommand);
+
+        m_drawStats.m_draws += lastCommand - firstCommand;
+        first = last;
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (VK_NULL_HANDLE != m_statisticsPool)
+    {
+        vkCmdEndQuery(commandBuffer, m_statisticsPool, m_currentFrame);
+    }
+}
+
+// Key layout from the most expensive state to the cheapest: 8 bits of
+// pipeline, 16 of material, 24 of view depth and 16 of mesh, so the meshes
+// sharing a material go front to back and the mesh only breaks depth ties.
+uint64_t TriangleApp::MakeSortKey(uint32_t pipeline, uint32_t material, 
+                                    uint32_t mesh, float depth)
+{
+    float normalized = std::clamp((depth - NEAR_PLANE) / 
+                                (FAR_PLANE - NEAR_PLANE), 0.0f, 1.0f);
+    uint64_t quantized = static_cast<uint64_t>(normalized * 0xFFFFFF);
+
+    return (static_cast<uint64_t>(pipeline & 0xFF) << 56) | 
+            (static_cast<uint64_t>(material & 0xFFFF) << 40) | 
+            (quantized << 16) | static_cast<uint64_t>(mesh & 0xFFFF);
+}
+
+void TriangleApp::SortDraws()
+{
+    if (m_meshes.size() > MAX_DRAWS)
+    {
+        throw std::runtime_error("too many draws for the indirect buffer");
+    }
+
+    m_draws.clear();
+    for (uint32_t i = 0; i < m_meshes.size(); ++i)
+    {
+        const Mesh& mesh = m_meshes[i];
+        float depth = -(m_modelView * glm::vec4(mesh.m_center, 1.0f)).z;
+        m_draws.push_back({MakeSortKey(0, mesh.m_material, i, depth), i, 0, 0});
+    }
+
+    std::sort(m_draws.begin(), m_draws.end(), 
+            [](const Draw& lhs, const Draw& rhs)
+            {
+                return lhs.m_key < rhs.m_key;
+            });
+}
+
+// The sorted draws become one indirect command per visible meshlet, so the
+// commands of a draw stay contiguous and in key order. firstInstance carries
+// the command index the shaders use to find the per-draw data.
+uint32_t TriangleApp::CullMeshlets()
+{
+    CullConstants constants = MakeCullConstants();
+    glm::vec3 cameraPosition(constants.m_cameraPosition);
+
+    auto *commands = static_cast<VkDrawIndexedIndirectCommand*>(
+                                    m_indirectBuffersMapped[m_currentFrame]);
+    auto *drawData = static_cast<DrawData*>(
+                                    m_drawDataBuffersMapped[m_currentFrame]);
+    uint32_t count = 0;
+    m_occludedMeshlets = 0;
+    for (Draw& draw : m_draws)
+    {
+        const Mesh& mesh = m_meshes[draw.m_mesh];
+        draw.m_firstCommand = count;
+        for (uint32_t i = 0; i < mesh.m_meshletCount; ++i)
+        {
+            const Meshlet& meshlet = m_meshlets[mesh.m_firstMeshlet + i];
+            if (!MeshletBuilder::IsVisible(meshlet, constants.m_planes, 
+                                            cameraPosition))
+            {
+                continue;
+            }
+
+            glm::vec3 center(meshlet.m_sphere);
+            glm::vec3 extent(meshlet.m_sphere.w);
+            if (m_options.m_occlusionCulling && 
+                !m_occlusion.IsVisible(center - extent, center + extent))
+            {
+                ++m_occludedMeshlets;
+                continue;
+            }
+
+            commands[count].indexCount = meshlet.m_indexCount;
+            commands[count].instanceCount = 1;
+            commands[count].firstIndex = meshlet.m_firstIndex;
+            commands[count].vertexOffset = meshlet.m_vertexOffset;
+            commands[count].firstInstance = count;
+            drawData[count].m_materialIndex = meshlet.m_material;
+            ++count;
+        }
+        draw.m_commandCount = count - draw.m_firstCommand;
+    }
+
+    return count;
+}
+
+TriangleApp::CullConstants TriangleApp::MakeCullConstants() const
+{
+    CullConstants constants{};
+    MakeFrustumPlanes(m_modelViewProj, constants.m_planes);
+    constants.m_cameraPosition = glm::inverse(m_modelView)[3];
+    constants.m_meshletCount = static_cast<uint32_t>(m_meshlets.size());
+    constants.m_maxDraws = MAX_DRAWS;
+
+    return constants;
+}
+
+// Gribb-Hartmann planes from the rows of the view-projection matrix, with the
+// [0, 1] depth range the near plane is the third row alone. The planes are in
+// the space the matrix transforms from.
+void TriangleApp::MakeFrustumPlanes(const glm::mat4& viewProj, 
+                                    glm::vec4 (&planes)[6])
+{
+    glm::mat4 m = glm::transpose(viewProj);
+
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[2];
+    planes[5] = m[3] - m[2];
+
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+// The cursor position is unprojected to the near and far plane, the ray
+// between them picks the nearest mesh box in world space.
+void TriangleApp::PickMesh()
+{
+    int width = 0;
+    int height = 0;
+    glfwGetWindowSize(m_window, &width, &height);
+    if ((0 == width) || (0 == height))
+    {
+        return;
+    }
+
+    glm::mat4 inverseViewProj = glm::inverse(m_camera.m_proj * m_camera.m_view);
+    float x = static_cast<float>(2.0 * m_pickX / width - 1.0);
+    float y = static_cast<float>(2.0 * m_pickY / height - 1.0);
+    glm::vec4 nearPoint = inverseViewProj * glm::vec4(x, y, 0.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProj * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+    Bvh::Hit hit = m_meshBvh.Raycast(origin, direction, 1.0f);
+    if (Bvh::NO_HIT == hit.m_primitive)
+    {
+        std::cout << "picked nothing" << std::endl;
+        return;
+    }
+
+    const Mesh& mesh = m_meshes[hit.m_primitive];
+    std::cout << "picked mesh " << hit.m_primitive << ", material " << 
+    mesh.m_material << ", " << mesh.m_indexCount / 3 << " triangles at " << 
+    hit.m_distance * glm::length(direction) << " units" << std::endl;
+}
+
+void TriangleApp::DrawCommands(VkCommandBuffer commandBuffer, uint32_t first, 
+                                uint32_t count)
+{
+    VkBuffer indirectBuffer = m_indirectBuffers[m_currentFrame];
+    VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * first;
+
+    if (m_gpuCulling)
+    {
+        vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer, offset, 
+                    m_drawCountBuffers[m_currentFrame], 0, count,
+                    sizeof(VkDrawIndexedIndirectCommand));
+        ++m_drawStats.m_indirectCalls;
+    }
+    else if (m_multiDrawIndirect)
+    {
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, count,
+                                sizeof(VkDrawIndexedIndirectCommand));
+        ++m_drawStats.m_indirectCalls;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, 1, 
+                                    sizeof(VkDrawIndexedIndirectCommand));
+            offset += sizeof(VkDrawIndexedIndirectCommand);
+            ++m_drawStats.m_indirectCalls;
+        }
+    }
+}
+
+// The fence of this frame slot was waited on, the count is the one the last
+// submit using this slot produced. The constants go through a buffer rather
+// than push constants so a recorded dispatch stays valid.
+void TriangleApp::PrepareCulling()
+{
+    auto *drawCount = static_cast<uint32_t*>(
+                                    m_drawCountBuffersMapped[m_currentFrame]);
+    m_visibleMeshlets = *drawCount;
+    *drawCount = 0;
+
+    CullConstants constants = MakeCullConstants();
+    std::memcpy(m_cullConstantBuffersMapped[m_currentFrame], &constants, 
+                sizeof(constants));
+}
+
+void TriangleApp::RecordCullPass(VkCommandBuffer commandBuffer)
 {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    uint32_t meshletCount = static_cast<uint32_t>(m_meshlets.size());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                        m_cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                            m_cullPipelineLayout, 0, 1, 
+                            &m_cullDescriptorSets[m_currentFrame], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (meshletCount + 63) / 64, 1, 1);
+}
 
-    VkShaderModule shaderModule;
-    if (VK_SUCCESS != vkCreateShaderModule(m_device, &createInfo, 
-                                            nullptr, &shaderModule))
+// a dropped frame keeps the pass and its barriers, only the copy is skipped
+void TriangleApp::RecordCapturePass(VkCommandBuffer commandBuffer)
+{
+    if (ReadbackRing::NO_SLOT != m_captureSlot)
     {
-        throw std::runtime_error("failed to create shader module");
+        m_readback.RecordCopy(commandBuffer, m_swapChainImages[m_imageIndex], 
+                            m_captureSlot);
     }
-
-    return shaderModule;
 }
 
-void TriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, 
-                                        uint32_t imageIndex)
+void TriangleApp::RecordUpscalePass(VkCommandBuffer commandBuffer)
 {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo))
+    VkDescriptorSet descriptorSet = m_upscaleDescriptorSets[m_currentFrame];
+    if (m_upscaleSetGenerations[m_currentFrame] != m_renderTargetGeneration)
     {
-        throw std::runtime_error("failed to begin recording command buffer");
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = m_renderGraph.GetImageView(m_graphSceneColor);
+        imageInfo.sampler = m_upscaleSampler;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+        m_upscaleSetGenerations[m_currentFrame] = m_renderTargetGeneration;
     }
 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = m_renderPass;
-    renderPassInfo.framebuffer = m_swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderPass = m_upscaleRenderPass;
+    renderPassInfo.framebuffer = m_upscaleFramebuffers[m_imageIndex];
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = m_swapChainExtent;
 
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-    clearValues[1].depthStencil = {1.0f, 0};
-
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
-
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, 
                             VK_SUBPASS_CONTENTS_INLINE);
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-                            m_graphicsPipeline);
+                            m_upscalePipeline);
 
     VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
     viewport.width = static_cast<float>(m_swapChainExtent.width);
     viewport.height = static_cast<float>(m_swapChainExtent.height);
-    viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
-    scissor.offset = {0, 0};
     scissor.extent = m_swapChainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    VkBuffer vertexBuffers[] = {m_vertexBuffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-    m_pipelineLayout, 0, 1, &m_descriptorSets[m_currentFrame], 0, nullptr);
-
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()),
-                    1, 0, 0, 0);
+    m_upscalePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+    VkExtent2D renderExtent = GetRenderExtent();
+    glm::vec2 fullSize(m_swapChainExtent.width, m_swapChainExtent.height);
+    glm::vec2 renderSize(renderExtent.width, renderExtent.height);
+
+    // sharpen in proportion to how far the image is stretched
+    UpscaleConstants constants{};
+    constants.m_uvScale = renderSize / fullSize;
+    constants.m_uvMax = (renderSize - 0.5f) / fullSize;
+    constants.m_texelSize = 1.0f / fullSize;
+    constants.m_sharpness = UPSCALE_SHARPNESS * (1.0f - m_renderScale) / 
+                            (1.0f - MIN_RENDER_SCALE);
+    vkCmdPushConstants(commandBuffer, m_upscalePipelineLayout, 
+                        VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants),
+                        &constants);
+
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
     vkCmdEndRenderPass(commandBuffer);
-
-    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
-    {
-        throw std::runtime_error("failed to record command buffer");
-    }
 }
 
 void TriangleApp::FramebufferResizeCallback(GLFWwindow* window, 
@@ -1798,6 +5693,54 @@ void TriangleApp::FramebufferResizeCallback(GLFWwindow* window,
     (void)height;
 }
 
+// 1-4 select msaa off/2x/4x/8x, D toggles dynamic resolution, P the depth
+// prepass, M prints the memory report
+void TriangleApp::KeyCallback(GLFWwindow *window, int key, int scancode, 
+                                int action, int mods)
+{
+    if (GLFW_PRESS != action)
+    {
+        return;
+    }
+
+    auto app = reinterpret_cast<TriangleApp*>(glfwGetWindowUserPointer(window));
+    if ((GLFW_KEY_1 <= key) && (key <= GLFW_KEY_4))
+    {
+        app->m_requestedSamples = 
+                    static_cast<VkSampleCountFlagBits>(1 << (key - GLFW_KEY_1));
+    }
+    else if (GLFW_KEY_D == key)
+    {
+        app->m_requestedDynamicResolution = !app->m_requestedDynamicResolution;
+    }
+    else if (GLFW_KEY_P == key)
+    {
+        app->m_requestedDepthPrepass = !app->m_requestedDepthPrepass;
+    }
+    else if (GLFW_KEY_M == key)
+    {
+        app->m_memoryReportRequested = true;
+    }
+
+    (void)scancode;
+    (void)mods;
+}
+
+// a left click prints the mesh under the cursor
+void TriangleApp::MouseButtonCallback(GLFWwindow *window, int button, 
+                                    int action, int mods)
+{
+    if ((GLFW_MOUSE_BUTTON_LEFT != button) || (GLFW_PRESS != action))
+    {
+        return;
+    }
+
+    auto app = reinterpret_cast<TriangleApp*>(glfwGetWindowUserPointer(window));
+    glfwGetCursorPos(window, &app->m_pickX, &app->m_pickY);
+    app->m_pickRequested = true;
+    (void)mods;
+}
+
 uint32_t TriangleApp::FindMemoryType(uint32_t typeFilter, 
                                     VkMemoryPropertyFlags properties)
 {
@@ -1816,9 +5759,8 @@ uint32_t TriangleApp::FindMemoryType(uint32_t typeFilter,
     throw std::runtime_error("failed to find suitable memory type");
 }
 
-void TriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, 
-                        VkMemoryPropertyFlags properties, VkBuffer& buffer,
-                        VkDeviceMemory& bufferMemory)
+VkBufferCreateInfo TriangleApp::MakeBufferInfo(VkDeviceSize size, 
+                            VkBufferUsageFlags usage, bool shared) const
 {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1827,8 +5769,67 @@ void TriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     bufferInfo.flags = 0;
 
+    // the buffers of the culling pass are shared with the compute queue, so
+    // it needs no ownership transfers; concurrent sharing can cost
+    // compression, every other buffer stays exclusive
+    if (shared && !m_bufferQueueFamilies.empty())
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 
+                    static_cast<uint32_t>(m_bufferQueueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = m_bufferQueueFamilies.data();
+    }
+
+    return bufferInfo;
+}
+
+// the memory types a buffer CreateBuffer would make accepts, without creating
+// it
+uint32_t TriangleApp::GetBufferMemoryTypes(VkDeviceSize size, 
+                                            VkBufferUsageFlags usage) const
+{
+    VkBufferCreateInfo bufferInfo = MakeBufferInfo(size, usage);
+
+    VkDeviceBufferMemoryRequirements requirementsInfo{};
+    requirementsInfo.sType = 
+                    VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS;
+    requirementsInfo.pCreateInfo = &bufferInfo;
+
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceBufferMemoryRequirements(m_device, &requirementsInfo, 
+                                        &requirements);
+
+    return requirements.memoryRequirements.memoryTypeBits;
+}
+
+bool TriangleApp::HasMemoryType(uint32_t typeFilter, 
+                                VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+    {
+        if ((typeFilter & (1 << i) && 
+            (properties == (memProperties.memoryTypes[i].propertyFlags & properties))))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, 
+                        VkMemoryPropertyFlags properties, VkBuffer& buffer,
+                        VkDeviceMemory& bufferMemory, 
+                        MemoryTracker::Category category, bool shared)
+{
+    VkBufferCreateInfo bufferInfo = MakeBufferInfo(size, usage, shared);
+
     if (VK_SUCCESS != vkCreateBuffer(m_device, &bufferInfo, 
-                                    nullptr, &buffer))
+                                    m_allocator, &buffer))
     {
         throw std::runtime_error("failed to create vertex buffer");
     }
@@ -1842,10 +5843,9 @@ void TriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits,
                                                 properties);
 
-    if (VK_SUCCESS != vkAllocateMemory(m_device, &allocInfo, nullptr,
-                                        &bufferMemory))
+    if (VK_SUCCESS != m_memory.Allocate(allocInfo, category, bufferMemory))
     {
-        throw std::runtime_error("failed to allocate vertex buffer memory");
+        throw std::runtime_error("failed to allocate buffer memory");
     }
 
     vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
@@ -1853,44 +5853,80 @@ void TriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 }
 
 void TriangleApp::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, 
-                                VkDeviceSize size)
+                                VkDeviceSize size, VkDeviceSize dstOffset)
 {
     VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
 
     VkBufferCopy copyRegion{};
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
     EndSingleTimeCommands(commandBuffer);
 }
 
-void TriangleApp::UpdateUniformBuffer(uint32_t currentImage)
+// blends the two latest ticks, the frame shows the simulation one tick late
+// so it always has a tick on either side
+void TriangleApp::UpdateCamera()
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>
-                (currentTime - startTime).count();
+    m_simulation.Update();
+    const SimulationFrame& frame = m_simulation.GetFront();
+    double elapsed = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - frame.m_tickTime).count();
+    double alpha = std::clamp(elapsed * m_options.m_tickRate, 0.0, 1.0);
+    double angle = glm::mix(frame.m_previous.m_angle, 
+                            frame.m_current.m_angle, alpha);
+    m_lateTicks = frame.m_lateTicks;
+
+    glm::quat rotation = glm::angleAxis(static_cast<float>(angle), 
+                                        glm::vec3(0.0f, 0.0f, 1.0f));
+    m_scene.SetRotation(m_modelNode, rotation);
+    m_scene.Update();
+    if (0 < m_scene.GetUpdatedCount())
+    {
+        UpdateMeshBounds();
+        m_meshBvh.Refit(m_meshBounds);
+    }
 
-    UniformBufferObject ubo{};
-    ubo.m_model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), 
-                                glm::vec3(0.0f, 0.0f, 1.0f));
+    Camera& ubo = m_camera;
+    ubo.m_model = m_scene.GetWorld(m_modelNode);
     ubo.m_view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), 
                              glm::vec3(0.0f, 0.0f, 0.0f), 
                              glm::vec3(0.0f, 0.0f, 1.0f));
     ubo.m_proj = glm::perspective(glm::radians(45.0f), 
                     m_swapChainExtent.width / 
-                    static_cast<float>(m_swapChainExtent.height), 0.1f, 10.0f);
+                    static_cast<float>(m_swapChainExtent.height), 
+                    NEAR_PLANE, FAR_PLANE);
     ubo.m_proj[1][1] *= -1; // flip y
+    m_modelView = ubo.m_view * ubo.m_model;
+    m_modelViewProj = ubo.m_proj * m_modelView;
+}
 
-    std::memcpy(m_uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+void TriangleApp::UpdateUniformBuffer(uint32_t currentImage)
+{
+    // the scene graph owns the model's transform, the model node is a root
+    // so its local transform is the one the shaders need
+    m_transforms.SetPosition(m_modelTransform, 
+                        m_scene.GetPosition(m_modelNode));
+    m_transforms.SetRotation(m_modelTransform, 
+                        m_scene.GetRotation(m_modelNode));
+    m_transforms.SetScale(m_modelTransform, 
+                        m_scene.GetScale(m_modelNode));
+
+    // the uniform buffer holds the one instance of the model
+    auto *instances = static_cast<TransformSystem::Instance*>(
+                                    m_uniformBuffersMapped[currentImage]);
+    m_transforms.Compose(m_camera.m_proj * m_camera.m_view, instances, 
+                        m_modelTransform, 1);
 }
 
 void TriangleApp::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels,
                     VkSampleCountFlagBits numSamples, 
                     VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
                     VkMemoryPropertyFlags properties, VkImage& image, 
-                    VkDeviceMemory& imageMemory)
+                    VkDeviceMemory& imageMemory, 
+                    MemoryTracker::Category category, 
+                    VkImageCreateFlags flags)
 {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1907,10 +5943,10 @@ void TriangleApp::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevel
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.samples = numSamples;
     imageInfo.mipLevels = mipLevels;
-    imageInfo.flags = 0;
+    imageInfo.flags = flags;
 
     if (VK_SUCCESS != vkCreateImage(m_device, &imageInfo, 
-                                    nullptr, &image))
+                                    m_allocator, &image))
     {
         throw std::runtime_error("failed to create texture image");
     }
@@ -1923,8 +5959,7 @@ void TriangleApp::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevel
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits,
                                 properties);
-    if (VK_SUCCESS != vkAllocateMemory(m_device, &allocInfo, 
-                                        nullptr, &imageMemory))
+    if (VK_SUCCESS != m_memory.Allocate(allocInfo, category, imageMemory))
     {
         throw std::runtime_error("failed to allocate texture image memory");
     }
@@ -1961,8 +5996,18 @@ inline void TriangleApp::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
+    uint64_t uploadValue = NextTimelineValue();
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &uploadValue;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_timeline;
+
     vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
+    m_timelineValue = uploadValue;
+    WaitForTimeline(uploadValue, GPU_HANG_TIMEOUT_NS);
 
     vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
 }
@@ -2057,7 +6102,7 @@ inline VkImageView TriangleApp::CreateImageView(VkImage image, VkFormat format,
 
     VkImageView imageView = VK_NULL_HANDLE;
     if (VK_SUCCESS != vkCreateImageView(m_device, &viewInfo, 
-                                        nullptr, &imageView))
+                                        m_allocator, &imageView))
     {
         throw std::runtime_error("failed to create texture image view");
     }
@@ -2088,8 +6133,21 @@ VkFormat TriangleApp::FindSupportedFormat(const std::vector<VkFormat>& candidate
     throw std::runtime_error("failed to find supported format");
 }
 
+// A 16 bit depth buffer halves the depth traffic. Its step at the far plane,
+// relative to the distance, is (far - near) / near / 2^16, it is only used
+// when that stays below the precision the scene needs.
 inline VkFormat TriangleApp::FindDepthFormat()
 {
+    float farStep = (FAR_PLANE - NEAR_PLANE) / NEAR_PLANE / 65536.0f;
+
+    if (farStep <= DEPTH_RELATIVE_PRECISION)
+    {
+        return FindSupportedFormat({VK_FORMAT_D16_UNORM, VK_FORMAT_D32_SFLOAT,
+                VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+                VK_IMAGE_TILING_OPTIMAL, 
+                VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    }
+
     return FindSupportedFormat({VK_FORMAT_D32_SFLOAT, 
             VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
             VK_IMAGE_TILING_OPTIMAL, 
@@ -2102,9 +6160,57 @@ inline bool TriangleApp::HasStencilComponent(VkFormat format)
             (VK_FORMAT_D24_UNORM_S8_UINT == format));
 }
 
+bool TriangleApp::UseComputeMips(VkFormat format, uint32_t width, 
+                                uint32_t height, uint32_t mipLevels) const
+{
+    return (m_computeMips && 
+            MipGenerator::CanGenerate(format, width, height, mipLevels));
+}
+
+// Level 0 is in TRANSFER_DST_OPTIMAL. The compute path writes every level in
+// one dispatch, images it cannot handle fall back to the blit chain.
 void TriangleApp::GenerateMipmaps(VkImage image, VkFormat imageFormat,
                                   int32_t texWidth, int32_t texHeight, 
                                   uint32_t mipLevels)
+{
+    uint32_t width = static_cast<uint32_t>(texWidth);
+    uint32_t height = static_cast<uint32_t>(texHeight);
+    if (!UseComputeMips(imageFormat, width, height, mipLevels))
+    {
+        VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+        RecordBlitMips(commandBuffer, image, imageFormat, texWidth, texHeight,
+                        mipLevels);
+        EndSingleTimeCommands(commandBuffer);
+        return;
+    }
+
+    MipGenerator::Target target;
+    m_mipGenerator.CreateTarget(image, imageFormat, width, height, mipLevels,
+        [this](VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, 
+                VkDeviceMemory& memory)
+        {
+            CreateBuffer(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+                        buffer, memory, MemoryTracker::Category::STORAGE);
+        }, target);
+
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    m_mipGenerator.Record(commandBuffer, target, 
+                        MipGenerator::Reduction::AVERAGE,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                        VK_ACCESS_TRANSFER_WRITE_BIT, 
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    EndSingleTimeCommands(commandBuffer);
+
+    m_mipGenerator.DestroyTarget(target, [this](VkDeviceMemory memory)
+    {
+        m_memory.Free(memory);
+    });
+}
+
+void TriangleApp::RecordBlitMips(VkCommandBuffer commandBuffer, VkImage image, 
+                                VkFormat imageFormat, int32_t texWidth, 
+                                int32_t texHeight, uint32_t mipLevels)
 {
     VkFormatProperties formatProps;
     vkGetPhysicalDeviceFormatProperties(m_physicalDevice, imageFormat, &formatProps);
@@ -2115,8 +6221,6 @@ void TriangleApp::GenerateMipmaps(VkImage image, VkFormat imageFormat,
         throw std::runtime_error("texture image does not support linear blitting");
     }
 
-    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
@@ -2180,27 +6284,168 @@ void TriangleApp::GenerateMipmaps(VkImage image, VkFormat imageFormat,
     vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
 
-    EndSingleTimeCommands(commandBuffer);
+// Times the blit chain against the compute generator on a power of two and
+// on odd sizes, the image contents do not matter.
+void TriangleApp::BenchmarkMips()
+{
+    constexpr uint32_t ITERATIONS = 16;
+    const std::array<VkExtent2D, 3> sizes = {VkExtent2D{4096, 4096}, 
+                                    VkExtent2D{1920, 1080}, VkExtent2D{999, 333}};
+
+    if (0.0f == m_timestampPeriod)
+    {
+        std::cout << "mip benchmark needs timestamps" << std::endl;
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    if (VK_SUCCESS != vkCreateQueryPool(m_device, &queryPoolInfo, 
+                                        m_allocator, &queryPool))
+    {
+        throw std::runtime_error("failed to create mip benchmark query pool");
+    }
+
+    for (const VkExtent2D& size : sizes)
+    {
+        uint32_t mipLevels = static_cast<uint32_t>(
+                std::floor(std::log2(std::max(size.width, size.height)))) + 1;
+        bool computeMips = UseComputeMips(VK_FORMAT_R8G8B8A8_SRGB, size.width, 
+                                        size.height, mipLevels);
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | 
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (computeMips)
+        {
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        CreateImage(size.width, size.height, mipLevels, VK_SAMPLE_COUNT_1_BIT,
+                    VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, usage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory, 
+                    MemoryTracker::Category::TEXTURE,
+                    computeMips ? (VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | 
+                                VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) : 0);
+
+        MipGenerator::Target target;
+        if (computeMips)
+        {
+            m_mipGenerator.CreateTarget(image, VK_FORMAT_R8G8B8A8_SRGB, 
+                size.width, size.height, mipLevels,
+                [this](VkDeviceSize bufferSize, VkBufferUsageFlags usage, 
+                        VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+                {
+                    CreateBuffer(bufferSize, usage, 
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, 
+                                bufferMemory, MemoryTracker::Category::STORAGE);
+                }, target);
+        }
+
+        std::array<double, 2> totalMs{};
+        for (uint32_t method = 0; method < (computeMips ? 2u : 1u); ++method)
+        {
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                barrier.subresourceRange.levelCount = mipLevels;
+                barrier.subresourceRange.layerCount = 1;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(commandBuffer, 
+                                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                    VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 
+                                    nullptr, 0, nullptr, 1, &barrier);
+
+                vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+                vkCmdWriteTimestamp(commandBuffer, 
+                            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+                if (0 == method)
+                {
+                    RecordBlitMips(commandBuffer, image, VK_FORMAT_R8G8B8A8_SRGB,
+                                static_cast<int32_t>(size.width), 
+                                static_cast<int32_t>(size.height), mipLevels);
+                }
+                else
+                {
+                    m_mipGenerator.Record(commandBuffer, target, 
+                                    MipGenerator::Reduction::AVERAGE,
+                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                                    VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                                    VK_ACCESS_TRANSFER_WRITE_BIT, 
+                                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+                }
+                vkCmdWriteTimestamp(commandBuffer, 
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+                EndSingleTimeCommands(commandBuffer);
+
+                std::array<uint64_t, 2> timestamps{};
+                vkGetQueryPoolResults(m_device, queryPool, 0, 2, 
+                                    sizeof(timestamps), timestamps.data(), 
+                                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | 
+                                    VK_QUERY_RESULT_WAIT_BIT);
+                totalMs[method] += static_cast<double>(timestamps[1] - 
+                                timestamps[0]) * m_timestampPeriod / 1000000.0;
+            }
+        }
+
+        std::cout << "mips " << size.width << "x" << size.height << " (" << 
+        mipLevels << " levels): blit " << totalMs[0] / ITERATIONS << " ms";
+        if (computeMips)
+        {
+            std::cout << ", compute " << totalMs[1] / ITERATIONS << " ms";
+            m_mipGenerator.DestroyTarget(target, [this](VkDeviceMemory memory)
+            {
+                m_memory.Free(memory);
+            });
+        }
+        std::cout << std::endl;
+
+        vkDestroyImage(m_device, image, m_allocator);
+        m_memory.Free(memory);
+    }
+
+    vkDestroyQueryPool(m_device, queryPool, m_allocator);
 }
 
-VkSampleCountFlagBits TriangleApp::GetMaxUsableSampleCount()
+// the highest count supported by both color and depth that does not exceed
+// the requested preset
+VkSampleCountFlagBits TriangleApp::ChooseSampleCount(
+                                        VkSampleCountFlagBits requested)
 {
     VkPhysicalDeviceProperties pdProps;
     vkGetPhysicalDeviceProperties(m_physicalDevice, &pdProps);
 
     VkSampleCountFlags count = pdProps.limits.framebufferColorSampleCounts &
                                pdProps.limits.framebufferDepthSampleCounts;
-    if (count & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
-    if (count & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
-    if (count & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
-    if (count & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
-    if (count & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
-    if (count & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
+    for (VkSampleCountFlags bit = requested; bit > VK_SAMPLE_COUNT_1_BIT; bit >>= 1)
+    {
+        if (count & bit)
+        {
+            return static_cast<VkSampleCountFlagBits>(bit);
+        }
+    }
 
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+// the title is formatted into the frame arena, the loop stays free of heap
+// allocations once it is warm
 void TriangleApp::ShowFPS()
 {
     static double lastTime = glfwGetTime();
@@ -2213,16 +6458,232 @@ void TriangleApp::ShowFPS()
 
     if (deltaTime >= 1.0)
     {
+        char *title = m_frameArena.AllocateArray<char>(TITLE_SIZE);
+        std::size_t length = 0;
+        auto append = [title, &length](const char *format, auto... args)
+        {
+            int written = std::snprintf(title + length, TITLE_SIZE - length, 
+                                        format, args...);
+            if (0 < written)
+            {
+                length = std::min(TITLE_SIZE - 1, 
+                                length + static_cast<std::size_t>(written));
+            }
+        };
+
         double fps = double(frameCount) / deltaTime;
-        std::stringstream ss;
-        ss << "Vulkan | FPS: " << fps;
+        append("Vulkan | FPS: %g | over budget waits: %u | msaa %dx", fps, 
+        m_overBudgetWaits, static_cast<int>(m_msaaSamples));
+        append(" | draws %u in %u calls, state changes %u", 
+        m_drawStats.m_draws, m_drawStats.m_indirectCalls, 
+        m_drawStats.m_pipelineBinds + 
+        m_drawStats.m_descriptorBinds + m_drawStats.m_vertexBufferBinds);
+        append(" | meshlets %u/%zu", m_visibleMeshlets, m_meshlets.size());
+        append(" | recorded %u/%zu frames", m_recordedFrames, frameCount);
+        if (m_options.m_occlusionCulling)
+        {
+            append(" occluded %u", m_occludedMeshlets);
+        }
+        append(" | textures %llu MB", static_cast<unsigned long long>(
+                                    m_residency.GetResidentBytes() >> 20));
+        if (0 != m_residency.GetBudget())
+        {
+            append("/%llu", static_cast<unsigned long long>(
+                                    m_residency.GetBudget() >> 20));
+        }
+        if (VK_NULL_HANDLE != m_computeTimestampPool)
+        {
+            append(" | async compute overlap %d%%", 
+                    static_cast<int>(100.0 * m_computeOverlap));
+        }
+        append(" | memory %llu MB in %u%s", static_cast<unsigned long long>(
+        m_memory.GetAllocatedBytes() >> 20), m_memory.GetAllocationCount(), 
+        m_memory.IsOverBudget() ? " over budget" : "");
+        if (VK_NULL_HANDLE != m_statisticsPool)
+        {
+            VkExtent2D extent = GetRenderExtent();
+            append(" | prepass %s vs %llu fs/px %g", 
+            m_depthPrepass ? "on" : "off", 
+            static_cast<unsigned long long>(m_vertexInvocations), 
+            static_cast<double>(m_fragmentInvocations) / 
+            (static_cast<double>(extent.width) * extent.height));
+        }
+        append(" | sim %g Hz, %llu late ticks", m_options.m_tickRate, 
+                static_cast<unsigned long long>(m_lateTicks));
+        if (m_dynamicResolution)
+        {
+            append(" | scale %g (gpu %g ms)", 
+                    static_cast<double>(m_renderScale), m_gpuFrameMs);
+        }
 
-        glfwSetWindowTitle(m_window, ss.str().c_str());
+        glfwSetWindowTitle(m_window, title);
         frameCount = 0;
+        m_recordedFrames = 0;
         lastTime = currentTime;
     }
 }
 
+void TriangleApp::StepResizeBenchmark()
+{
+    if (nullptr == m_resizeBenchmark)
+    {
+        return;
+    }
+
+    ResizeBenchmark& bench = *m_resizeBenchmark;
+    auto now = std::chrono::steady_clock::now();
+
+    if (std::chrono::steady_clock::time_point{} != bench.m_lastFrame)
+    {
+        bench.m_frameTimes.push_back(std::chrono::duration<double, std::milli>
+                                    (now - bench.m_lastFrame).count());
+    }
+    bench.m_lastFrame = now;
+
+    if (bench.m_frameTimes.size() >= m_options.m_resizeBenchmarkFrames)
+    {
+        glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+        return;
+    }
+
+    if (0 == (bench.m_frameTimes.size() % RESIZE_BENCHMARK_PERIOD))
+    {
+        bench.m_large = !bench.m_large;
+        int width = static_cast<int>(bench.m_large ? WIDTH * 3 / 2 : WIDTH);
+        int height = static_cast<int>(bench.m_large ? HEIGHT * 3 / 2 : HEIGHT);
+        glfwSetWindowSize(m_window, width, height);
+    }
+}
+
+void TriangleApp::ReportResizeBenchmark()
+{
+    if ((nullptr == m_resizeBenchmark) || 
+        m_resizeBenchmark->m_frameTimes.empty())
+    {
+        return;
+    }
+
+    const ResizeBenchmark& bench = *m_resizeBenchmark;
+    std::vector<double> sorted = bench.m_frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&sorted](double p)
+    {
+        return sorted[static_cast<std::size_t>(p * (sorted.size() - 1))];
+    };
+    double median = percentile(0.5);
+    std::size_t spikes = std::count_if(sorted.begin(), sorted.end(),
+                        [median](double frameTime)
+                        {
+                            return (frameTime > 2.0 * median);
+                        });
+
+    std::cout << "resize benchmark: " << sorted.size() << " frames, " <<
+    bench.m_recreateCount << " recreations (" << 
+    (bench.m_recreateCount ? bench.m_recreateTime / bench.m_recreateCount : 0.0) <<
+    " ms avg)" << std::endl;
+    std::cout << "\tframe time ms: median " << median << 
+    ", p99 " << percentile(0.99) << ", max " << sorted.back() << 
+    ", spikes (>2x median) " << spikes << std::endl;
+}
+
+// C++ heap allocations of every thread plus the host allocator's trips to the
+// system heap, a warm pool serves the driver without either
+uint64_t TriangleApp::CountHeapAllocations() const
+{
+    return s_heapAllocations.load(std::memory_order_relaxed) + 
+            m_hostAllocator.GetHeapAllocations();
+}
+
+void TriangleApp::StepAllocTest(uint64_t allocations)
+{
+    if (m_frameNumber <= ALLOC_TEST_WARMUP)
+    {
+        return;
+    }
+
+    ++m_allocTest.m_frames;
+    m_allocTest.m_allocations += allocations;
+    if (0 != allocations)
+    {
+        ++m_allocTest.m_allocatingFrames;
+        m_allocTest.m_worstFrame = std::max(m_allocTest.m_worstFrame, 
+                                            allocations);
+    }
+
+    if (m_allocTest.m_frames >= m_options.m_allocTestFrames)
+    {
+        glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+    }
+}
+
+// runs after cleanup so a failed test still releases the device
+void TriangleApp::ReportAllocTest()
+{
+    if (0 == m_options.m_allocTestFrames)
+    {
+        return;
+    }
+
+    std::cout << "alloc test: " << m_allocTest.m_frames << " frames after " << 
+    ALLOC_TEST_WARMUP << " warm-up frames, " << 
+    m_allocTest.m_allocatingFrames << " allocated, " << 
+    m_allocTest.m_allocations << " allocations (worst frame " << 
+    m_allocTest.m_worstFrame << "), frame arena high water " << 
+    m_frameArena.GetHighWater() << " bytes" << std::endl;
+    m_hostAllocator.Report(std::cout);
+
+    if (m_allocTest.m_frames < m_options.m_allocTestFrames)
+    {
+        throw std::runtime_error("alloc test ended before the last frame");
+    }
+    if (0 != m_allocTest.m_allocatingFrames)
+    {
+        throw std::runtime_error("alloc test failed: steady state frames "
+                                "allocated on the heap");
+    }
+}
+
+// the warm-up lets the dynamic resolution controller settle
+void TriangleApp::StepReuseTest(bool recorded)
+{
+    if (m_frameNumber <= ALLOC_TEST_WARMUP)
+    {
+        return;
+    }
+
+    ++m_reuseTest.m_frames;
+    m_reuseTest.m_recordedFrames += recorded ? 1 : 0;
+
+    if (m_reuseTest.m_frames >= m_options.m_reuseTestFrames)
+    {
+        glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+    }
+}
+
+void TriangleApp::ReportReuseTest()
+{
+    if (0 == m_options.m_reuseTestFrames)
+    {
+        return;
+    }
+
+    std::cout << "reuse test: " << m_reuseTest.m_frames << " frames after " << 
+    ALLOC_TEST_WARMUP << " warm-up frames, " << m_reuseTest.m_recordedFrames << 
+    " recorded" << std::endl;
+
+    if (m_reuseTest.m_frames < m_options.m_reuseTestFrames)
+    {
+        throw std::runtime_error("reuse test ended before the last frame");
+    }
+    if (m_reuseTest.m_recordedFrames * REUSE_TEST_RECORDED_SHARE > 
+        m_reuseTest.m_frames)
+    {
+        throw std::runtime_error("reuse test failed: steady state frames "
+                                "recorded their command buffers");
+    }
+}
+
 inline VkVertexInputBindingDescription TriangleApp::Vertex::GetBindingDescription()
 {
     VkVertexInputBindingDescription bindingDescription{};
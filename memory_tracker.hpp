@@ -0,0 +1,269 @@
+#ifndef MEMORY_TRACKER_HPP
+#define MEMORY_TRACKER_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <array> // std::array
+#include <vector> // std::vector
+#include <unordered_map> // std::unordered_map
+#include <ostream> // std::ostream
+#include <iostream> // std::cerr
+#include <iomanip> // std::setw
+#include <cstdint> // uint32_t
+
+// Owns every vkAllocateMemory/vkFreeMemory of the app. Allocations are tagged
+// with a category and summed per heap, the heap budget and usage come from
+// VK_EXT_memory_budget when the device has it and from the heap size and our
+// own totals otherwise. A failed allocation prints the full report before the
+// caller throws.
+class MemoryTracker
+{
+public:
+    enum class Category
+    {
+        VERTEX,
+        INDEX,
+        TEXTURE,
+        STAGING,
+        UNIFORM,
+        ATTACHMENT,
+        STORAGE,
+        COUNT
+    };
+
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device,
+                bool budgetExtension, const VkAllocationCallbacks *allocator);
+
+    VkResult Allocate(const VkMemoryAllocateInfo& allocInfo, Category category,
+                        VkDeviceMemory& memory);
+    void Free(VkDeviceMemory memory);
+
+    void UpdateBudget();
+    void Report(std::ostream& os) const;
+
+    VkDeviceSize GetAllocatedBytes() const;
+    uint32_t GetAllocationCount() const;
+    bool IsOverBudget() const;
+
+    static const char *GetCategoryName(Category category);
+
+private:
+    static constexpr std::size_t CATEGORY_COUNT =
+                                static_cast<std::size_t>(Category::COUNT);
+
+    struct Allocation
+    {
+        VkDeviceSize m_size;
+        uint32_t m_heap;
+        Category m_category;
+    };
+
+    struct Heap
+    {
+        VkDeviceSize m_size;
+        VkMemoryHeapFlags m_flags;
+        VkDeviceSize m_budget;
+        VkDeviceSize m_usage;
+        std::array<VkDeviceSize, CATEGORY_COUNT> m_bytes;
+        std::array<uint32_t, CATEGORY_COUNT> m_counts;
+    };
+
+    VkPhysicalDevice m_physicalDevice{VK_NULL_HANDLE};
+    VkDevice m_device{VK_NULL_HANDLE};
+    const VkAllocationCallbacks *m_allocator{nullptr};
+    bool m_budgetExtension{false};
+    std::vector<Heap> m_heaps;
+    std::vector<uint32_t> m_typeHeaps;
+    std::unordered_map<VkDeviceMemory, Allocation> m_allocations;
+    VkDeviceSize m_allocatedBytes{0};
+};
+
+inline void MemoryTracker::Create(VkPhysicalDevice physicalDevice,
+                                VkDevice device, bool budgetExtension,
+                                const VkAllocationCallbacks *allocator)
+{
+    m_physicalDevice = physicalDevice;
+    m_device = device;
+    m_allocator = allocator;
+    m_budgetExtension = budgetExtension;
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+
+    m_heaps.assign(memProperties.memoryHeapCount, Heap{});
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; ++i)
+    {
+        m_heaps[i].m_size = memProperties.memoryHeaps[i].size;
+        m_heaps[i].m_flags = memProperties.memoryHeaps[i].flags;
+    }
+
+    m_typeHeaps.resize(memProperties.memoryTypeCount);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+    {
+        m_typeHeaps[i] = memProperties.memoryTypes[i].heapIndex;
+    }
+
+    UpdateBudget();
+}
+
+inline VkResult MemoryTracker::Allocate(const VkMemoryAllocateInfo& allocInfo,
+                                    Category category, VkDeviceMemory& memory)
+{
+    VkResult result = vkAllocateMemory(m_device, &allocInfo, m_allocator,
+                                        &memory);
+    uint32_t heap = m_typeHeaps[allocInfo.memoryTypeIndex];
+
+    if (VK_SUCCESS != result)
+    {
+        UpdateBudget();
+        std::cerr << "failed to allocate " << allocInfo.allocationSize <<
+        " bytes of " << GetCategoryName(category) << " memory from heap " <<
+        heap << std::endl;
+        Report(std::cerr);
+
+        return result;
+    }
+
+    std::size_t index = static_cast<std::size_t>(category);
+    m_heaps[heap].m_bytes[index] += allocInfo.allocationSize;
+    ++m_heaps[heap].m_counts[index];
+    m_allocatedBytes += allocInfo.allocationSize;
+    m_allocations[memory] = {allocInfo.allocationSize, heap, category};
+
+    return result;
+}
+
+inline void MemoryTracker::Free(VkDeviceMemory memory)
+{
+    if (VK_NULL_HANDLE == memory)
+    {
+        return;
+    }
+
+    auto found = m_allocations.find(memory);
+    if (m_allocations.end() != found)
+    {
+        const Allocation& allocation = found->second;
+        std::size_t index = static_cast<std::size_t>(allocation.m_category);
+        m_heaps[allocation.m_heap].m_bytes[index] -= allocation.m_size;
+        --m_heaps[allocation.m_heap].m_counts[index];
+        m_allocatedBytes -= allocation.m_size;
+        m_allocations.erase(found);
+    }
+
+    vkFreeMemory(m_device, memory, m_allocator);
+}
+
+// the budget covers every process on the device, usage includes memory that
+// the driver allocates on our behalf
+inline void MemoryTracker::UpdateBudget()
+{
+    if (!m_budgetExtension)
+    {
+        for (Heap& heap : m_heaps)
+        {
+            heap.m_budget = heap.m_size;
+            heap.m_usage = 0;
+            for (VkDeviceSize bytes : heap.m_bytes)
+            {
+                heap.m_usage += bytes;
+            }
+        }
+
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memProperties{};
+    memProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memProperties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < m_heaps.size(); ++i)
+    {
+        m_heaps[i].m_budget = budget.heapBudget[i];
+        m_heaps[i].m_usage = budget.heapUsage[i];
+    }
+}
+
+inline void MemoryTracker::Report(std::ostream& os) const
+{
+    constexpr double MB = 1024.0 * 1024.0;
+
+    os << "memory: " << m_allocations.size() << " allocations, " <<
+    m_allocatedBytes / MB << " MB" <<
+    (m_budgetExtension ? "" : " (no VK_EXT_memory_budget)") << std::endl;
+
+    for (uint32_t i = 0; i < m_heaps.size(); ++i)
+    {
+        const Heap& heap = m_heaps[i];
+        os << "  heap " << i <<
+        ((heap.m_flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " device" : " host") <<
+        ": usage " << heap.m_usage / MB << " / budget " << heap.m_budget / MB <<
+        " / size " << heap.m_size / MB << " MB" << std::endl;
+
+        for (std::size_t category = 0; category < CATEGORY_COUNT; ++category)
+        {
+            if (0 == heap.m_counts[category])
+            {
+                continue;
+            }
+
+            os << "    " << std::setw(10) <<
+            GetCategoryName(static_cast<Category>(category)) << " " <<
+            heap.m_bytes[category] / MB << " MB in " <<
+            heap.m_counts[category] << std::endl;
+        }
+    }
+}
+
+inline VkDeviceSize MemoryTracker::GetAllocatedBytes() const
+{
+    return m_allocatedBytes;
+}
+
+inline uint32_t MemoryTracker::GetAllocationCount() const
+{
+    return static_cast<uint32_t>(m_allocations.size());
+}
+
+inline bool MemoryTracker::IsOverBudget() const
+{
+    for (const Heap& heap : m_heaps)
+    {
+        if (heap.m_usage > heap.m_budget)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline const char *MemoryTracker::GetCategoryName(Category category)
+{
+    switch (category)
+    {
+    case Category::VERTEX:
+        return "vertex";
+    case Category::INDEX:
+        return "index";
+    case Category::TEXTURE:
+        return "texture";
+    case Category::STAGING:
+        return "staging";
+    case Category::UNIFORM:
+        return "uniform";
+    case Category::ATTACHMENT:
+        return "attachment";
+    case Category::STORAGE:
+        return "storage";
+    default:
+        return "unknown";
+    }
+}
+
+#endif // MEMORY_TRACKER_HPP
@@ -0,0 +1,182 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <glm/glm.hpp> // linear algebra
+
+#include <vector> // std::vector
+#include <algorithm> // std::min, std::find
+#include <cmath> // std::sqrt
+#include <cstdint> // uint32_t
+
+// matches the std430 Meshlet in cull.comp
+struct Meshlet
+{
+    alignas(16) glm::vec4 m_sphere; // center, radius
+    alignas(16) glm::vec4 m_cone; // axis, cutoff
+    uint32_t m_firstIndex;
+    uint32_t m_indexCount;
+    int32_t m_vertexOffset;
+    uint32_t m_material;
+};
+
+// Splits a triangle list into clusters of at most MAX_VERTICES unique vertices
+// and MAX_TRIANGLES triangles. Triangles are taken in index buffer order, so a
+// meshlet is a contiguous index range and the index buffer is left untouched.
+// Every meshlet gets a bounding sphere for frustum tests and a normal cone
+// that rejects it when all of its triangles face away from the camera.
+class MeshletBuilder
+{
+public:
+    static constexpr uint32_t MAX_VERTICES = 64;
+    static constexpr uint32_t MAX_TRIANGLES = 124;
+
+    static void Build(const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount, std::vector<Meshlet>& meshlets);
+    static bool IsVisible(const Meshlet& meshlet, const glm::vec4 *planes,
+                        const glm::vec3& cameraPosition);
+
+private:
+    static Meshlet ComputeBounds(const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount);
+};
+
+inline void MeshletBuilder::Build(const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount, std::vector<Meshlet>& meshlets)
+{
+    uint32_t unique[MAX_VERTICES];
+    uint32_t uniqueCount = 0;
+    uint32_t meshletFirst = firstIndex;
+    uint32_t end = firstIndex + indexCount;
+
+    auto isNew = [&unique, &uniqueCount](uint32_t vertex)
+    {
+        return (unique + uniqueCount == 
+                std::find(unique, unique + uniqueCount, vertex));
+    };
+
+    for (uint32_t triangle = firstIndex; triangle < end; triangle += 3)
+    {
+        const uint32_t *corners = &indices[triangle];
+        uint32_t newCount = 0;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            bool repeated = (corners + corner != 
+                            std::find(corners, corners + corner, corners[corner]));
+            newCount += (!repeated && isNew(corners[corner])) ? 1 : 0;
+        }
+
+        if ((uniqueCount + newCount > MAX_VERTICES) ||
+            ((triangle - meshletFirst) / 3 == MAX_TRIANGLES))
+        {
+            meshlets.push_back(ComputeBounds(positions, indices, meshletFirst,
+                                            triangle - meshletFirst));
+            meshletFirst = triangle;
+            uniqueCount = 0;
+        }
+
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            if (isNew(corners[corner]))
+            {
+                unique[uniqueCount++] = corners[corner];
+            }
+        }
+    }
+
+    if (meshletFirst < end)
+    {
+        meshlets.push_back(ComputeBounds(positions, indices, meshletFirst,
+                                        end - meshletFirst));
+    }
+}
+
+// Same test as cull.comp. The planes and the camera are in model space, the
+// cone test is the conservative one against the bounding sphere.
+inline bool MeshletBuilder::IsVisible(const Meshlet& meshlet,
+                    const glm::vec4 *planes, const glm::vec3& cameraPosition)
+{
+    glm::vec3 center(meshlet.m_sphere);
+    float radius = meshlet.m_sphere.w;
+
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+        {
+            return false;
+        }
+    }
+
+    glm::vec3 view = center - cameraPosition;
+    float distance = glm::length(view);
+
+    return (glm::dot(view, glm::vec3(meshlet.m_cone)) <
+            meshlet.m_cone.w * distance + radius);
+}
+
+inline Meshlet MeshletBuilder::ComputeBounds(
+                    const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount)
+{
+    glm::vec3 minPos = positions[indices[firstIndex]];
+    glm::vec3 maxPos = minPos;
+    glm::vec3 axis(0.0f);
+    std::vector<glm::vec3> normals;
+    normals.reserve(indexCount / 3);
+
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3)
+    {
+        const glm::vec3& a = positions[indices[i + 0]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        minPos = glm::min(minPos, glm::min(a, glm::min(b, c)));
+        maxPos = glm::max(maxPos, glm::max(a, glm::max(b, c)));
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (0.0f < length)
+        {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    glm::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; ++i)
+    {
+        radius = std::max(radius, glm::length(positions[indices[i]] - center));
+    }
+
+    // a cutoff of 1 never rejects, used when the normals spread over a
+    // hemisphere or more
+    float cutoff = 1.0f;
+    float axisLength = glm::length(axis);
+    if (0.0f < axisLength)
+    {
+        axis /= axisLength;
+        float minDot = 1.0f;
+        for (const glm::vec3& normal : normals)
+        {
+            minDot = std::min(minDot, glm::dot(normal, axis));
+        }
+
+        if (0.0f < minDot)
+        {
+            cutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+    }
+
+    Meshlet meshlet{};
+    meshlet.m_sphere = glm::vec4(center, radius);
+    meshlet.m_cone = glm::vec4(axis, cutoff);
+    meshlet.m_firstIndex = firstIndex;
+    meshlet.m_indexCount = indexCount;
+
+    return meshlet;
+}
+
+#endif // MESHLET_HPP
@@ -0,0 +1,574 @@
+#ifndef MIP_GENERATOR_HPP
+#define MIP_GENERATOR_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <array> // std::array
+#include <vector> // std::vector
+#include <string> // std::string
+#include <functional> // std::function
+#include <algorithm> // std::max, std::min
+#include <stdexcept> // std::runtime_error
+#include <cstddef> // offsetof
+#include <cstdint> // uint32_t
+
+// Writes every mip level of an image in one compute dispatch instead of a
+// blit and two barriers per level. Each workgroup reduces a 64x64 tile of
+// level 0 to levels 1-6 in shared memory, the last workgroup to finish
+// reduces level 6 to the rest, see shaders/downsample.comp. Sources up to
+// MAX_SOURCE_SIZE texels are supported.
+// sRGB images are read through a sampled sRGB view and written through UNORM
+// storage views with the encoding done in the shader, so they have to be
+// created with VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT and
+// VK_IMAGE_CREATE_EXTENDED_USAGE_BIT. Levels are averaged by default, MIN and
+// MAX build depth pyramids for Hi-Z culling.
+// On odd sizes level 1 folds the last row or column of level 0 into its last
+// texel, deeper levels drop it like the blit chain does. Hi-Z pyramids that
+// must stay conservative should start from a power of two.
+class MipGenerator
+{
+public:
+    static constexpr uint32_t MAX_LEVELS = 12;
+    static constexpr uint32_t MAX_SOURCE_SIZE = 4096;
+    static constexpr uint32_t MAX_TARGETS = 16;
+    // levels 1-6 of a workgroup, level 1 is 32x32 texels
+    static constexpr uint32_t TILE_SIZE = 32;
+    static constexpr uint32_t SHARED_MEMORY_SIZE =
+                                            TILE_SIZE * TILE_SIZE * 16 + 16;
+
+    enum class Reduction
+    {
+        AVERAGE,
+        MIN,
+        MAX,
+        COUNT
+    };
+
+    using ReadShaderFunction = std::function<std::vector<char>(
+                                                const std::string& path)>;
+    using CreateBufferFunction = std::function<void(VkDeviceSize size,
+                        VkBufferUsageFlags usage, VkBuffer& buffer,
+                        VkDeviceMemory& memory)>;
+    using FreeMemoryFunction = std::function<void(VkDeviceMemory memory)>;
+
+    // the views and the descriptor set of one image, reused every Record()
+    struct Target
+    {
+        VkImage m_image{VK_NULL_HANDLE};
+        VkFormat m_format{VK_FORMAT_UNDEFINED};
+        uint32_t m_width{0};
+        uint32_t m_height{0};
+        uint32_t m_mipLevels{0};
+        VkImageView m_sourceView{VK_NULL_HANDLE};
+        std::array<VkImageView, MAX_LEVELS> m_levelViews{};
+        VkDescriptorSet m_descriptorSet{VK_NULL_HANDLE};
+        VkBuffer m_counterBuffer{VK_NULL_HANDLE};
+        VkDeviceMemory m_counterMemory{VK_NULL_HANDLE};
+    };
+
+    static bool IsSupported(VkPhysicalDevice physicalDevice);
+    static bool CanGenerate(VkFormat format, uint32_t width, uint32_t height,
+                            uint32_t mipLevels);
+
+    void Create(VkDevice device, VkPipelineCache pipelineCache,
+                const ReadShaderFunction& readShader,
+                const VkAllocationCallbacks *allocator);
+    void Destroy();
+
+    void CreateTarget(VkImage image, VkFormat format, uint32_t width,
+                    uint32_t height, uint32_t mipLevels,
+                    const CreateBufferFunction& createBuffer, Target& target);
+    void DestroyTarget(Target& target, const FreeMemoryFunction& freeMemory);
+
+    // Level 0 is read in srcLayout after srcStage, every level ends up in
+    // SHADER_READ_ONLY_OPTIMAL for dstStage.
+    void Record(VkCommandBuffer commandBuffer, const Target& target,
+                Reduction reduction, VkImageLayout srcLayout,
+                VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                VkPipelineStageFlags dstStage);
+
+private:
+    enum class Variant
+    {
+        RGBA8,
+        RGBA16F,
+        R32F,
+        COUNT
+    };
+
+    struct FormatInfo
+    {
+        Variant m_variant;
+        VkFormat m_storageFormat;
+        bool m_srgb;
+    };
+
+    struct Constants
+    {
+        uint32_t m_levelCount;
+        uint32_t m_workgroupCount;
+    };
+
+    static constexpr uint32_t PIPELINE_COUNT =
+        static_cast<uint32_t>(Variant::COUNT) *
+        static_cast<uint32_t>(Reduction::COUNT) * 2;
+
+    static bool GetFormatInfo(VkFormat format, FormatInfo& info);
+    VkPipeline GetPipeline(const FormatInfo& info, Reduction reduction);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    const VkAllocationCallbacks *m_allocator{nullptr};
+    VkPipelineCache m_pipelineCache{VK_NULL_HANDLE};
+    std::array<VkShaderModule, static_cast<uint32_t>(Variant::COUNT)>
+                                                            m_shaderModules{};
+    std::array<VkPipeline, PIPELINE_COUNT> m_pipelines{};
+    VkSampler m_sampler{VK_NULL_HANDLE};
+    VkDescriptorSetLayout m_setLayout{VK_NULL_HANDLE};
+    VkPipelineLayout m_pipelineLayout{VK_NULL_HANDLE};
+    VkDescriptorPool m_descriptorPool{VK_NULL_HANDLE};
+};
+
+// the level array is indexed with the level being written and the shared
+// tile is just over the 16 KiB every device guarantees
+inline bool MipGenerator::IsSupported(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    return ((VK_TRUE == features.shaderStorageImageArrayDynamicIndexing) &&
+            (properties.limits.maxComputeSharedMemorySize >= SHARED_MEMORY_SIZE));
+}
+
+inline bool MipGenerator::CanGenerate(VkFormat format, uint32_t width,
+                                    uint32_t height, uint32_t mipLevels)
+{
+    FormatInfo info;
+
+    return (GetFormatInfo(format, info) &&
+            (std::max(width, height) <= MAX_SOURCE_SIZE) &&
+            (mipLevels >= 2) && (mipLevels - 1 <= MAX_LEVELS));
+}
+
+inline void MipGenerator::Create(VkDevice device, VkPipelineCache pipelineCache,
+                                const ReadShaderFunction& readShader,
+                                const VkAllocationCallbacks *allocator)
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_pipelineCache = pipelineCache;
+
+    const std::array<const char*, static_cast<uint32_t>(Variant::COUNT)>
+    paths = {"shaders/downsample_rgba8_comp.spv",
+            "shaders/downsample_rgba16f_comp.spv",
+            "shaders/downsample_r32f_comp.spv"};
+    for (uint32_t i = 0; i < paths.size(); ++i)
+    {
+        std::vector<char> code = readShader(paths[i]);
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        if (VK_SUCCESS != vkCreateShaderModule(m_device, &moduleInfo,
+                                        m_allocator, &m_shaderModules[i]))
+        {
+            throw std::runtime_error("failed to create downsample shader module");
+        }
+    }
+
+    // level 0 is read with texelFetch, the sampler is never used to filter
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    if (VK_SUCCESS != vkCreateSampler(m_device, &samplerInfo, m_allocator,
+                                        &m_sampler))
+    {
+        throw std::runtime_error("failed to create downsample sampler");
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = MAX_LEVELS;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(m_device, &layoutInfo,
+                                                m_allocator, &m_setLayout))
+    {
+        throw std::runtime_error("failed to create downsample set layout");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(Constants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (VK_SUCCESS != vkCreatePipelineLayout(m_device, &pipelineLayoutInfo,
+                                            m_allocator, &m_pipelineLayout))
+    {
+        throw std::runtime_error("failed to create downsample pipeline layout");
+    }
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = MAX_TARGETS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = MAX_TARGETS * MAX_LEVELS;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = MAX_TARGETS;
+
+    // texture uploads create a target per image and free it right away
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_TARGETS;
+
+    if (VK_SUCCESS != vkCreateDescriptorPool(m_device, &poolInfo, m_allocator,
+                                            &m_descriptorPool))
+    {
+        throw std::runtime_error("failed to create downsample descriptor pool");
+    }
+}
+
+inline void MipGenerator::Destroy()
+{
+    for (VkPipeline& pipeline : m_pipelines)
+    {
+        vkDestroyPipeline(m_device, pipeline, m_allocator);
+        pipeline = VK_NULL_HANDLE;
+    }
+    for (VkShaderModule& shaderModule : m_shaderModules)
+    {
+        vkDestroyShaderModule(m_device, shaderModule, m_allocator);
+        shaderModule = VK_NULL_HANDLE;
+    }
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, m_allocator);
+    vkDestroySampler(m_device, m_sampler, m_allocator);
+
+    m_descriptorPool = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_setLayout = VK_NULL_HANDLE;
+    m_sampler = VK_NULL_HANDLE;
+}
+
+inline void MipGenerator::CreateTarget(VkImage image, VkFormat format,
+                                    uint32_t width, uint32_t height,
+                                    uint32_t mipLevels,
+                                    const CreateBufferFunction& createBuffer,
+                                    Target& target)
+{
+    FormatInfo info;
+    if (!CanGenerate(format, width, height, mipLevels) ||
+        !GetFormatInfo(format, info))
+    {
+        throw std::runtime_error("mip generator does not support the image");
+    }
+
+    target.m_image = image;
+    target.m_format = format;
+    target.m_width = width;
+    target.m_height = height;
+    target.m_mipLevels = mipLevels;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (VK_SUCCESS != vkCreateImageView(m_device, &viewInfo, m_allocator,
+                                        &target.m_sourceView))
+    {
+        throw std::runtime_error("failed to create downsample source view");
+    }
+
+    // a view may only have storage usage if its format supports it
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+    viewInfo.pNext = &usageInfo;
+    viewInfo.format = info.m_storageFormat;
+    for (uint32_t level = 1; level < mipLevels; ++level)
+    {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        if (VK_SUCCESS != vkCreateImageView(m_device, &viewInfo, m_allocator,
+                                            &target.m_levelViews[level - 1]))
+        {
+            throw std::runtime_error("failed to create downsample level view");
+        }
+    }
+
+    createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT, target.m_counterBuffer,
+                target.m_counterMemory);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_setLayout;
+
+    if (VK_SUCCESS != vkAllocateDescriptorSets(m_device, &allocInfo,
+                                                &target.m_descriptorSet))
+    {
+        throw std::runtime_error("failed to allocate downsample descriptor set");
+    }
+
+    VkDescriptorImageInfo sourceInfo{};
+    sourceInfo.sampler = m_sampler;
+    sourceInfo.imageView = target.m_sourceView;
+    sourceInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    // the binding is not partially bound, levels past the chain repeat the
+    // last one and are never written
+    std::array<VkDescriptorImageInfo, MAX_LEVELS> levelInfos{};
+    for (uint32_t i = 0; i < MAX_LEVELS; ++i)
+    {
+        levelInfos[i].imageView = target.m_levelViews[std::min(i, mipLevels - 2)];
+        levelInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkDescriptorBufferInfo counterInfo{};
+    counterInfo.buffer = target.m_counterBuffer;
+    counterInfo.offset = 0;
+    counterInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+    for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding)
+    {
+        descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[binding].dstSet = target.m_descriptorSet;
+        descriptorWrites[binding].dstBinding = binding;
+        descriptorWrites[binding].dstArrayElement = 0;
+        descriptorWrites[binding].descriptorCount = 1;
+    }
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].pImageInfo = &sourceInfo;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = MAX_LEVELS;
+    descriptorWrites[1].pImageInfo = levelInfos.data();
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[2].pBufferInfo = &counterInfo;
+
+    vkUpdateDescriptorSets(m_device,
+                        static_cast<uint32_t>(descriptorWrites.size()),
+                        descriptorWrites.data(), 0, nullptr);
+}
+
+inline void MipGenerator::DestroyTarget(Target& target,
+                                        const FreeMemoryFunction& freeMemory)
+{
+    vkFreeDescriptorSets(m_device, m_descriptorPool, 1, &target.m_descriptorSet);
+    vkDestroyBuffer(m_device, target.m_counterBuffer, m_allocator);
+    freeMemory(target.m_counterMemory);
+    for (VkImageView& view : target.m_levelViews)
+    {
+        vkDestroyImageView(m_device, view, m_allocator);
+        view = VK_NULL_HANDLE;
+    }
+    vkDestroyImageView(m_device, target.m_sourceView, m_allocator);
+
+    target.m_descriptorSet = VK_NULL_HANDLE;
+    target.m_counterBuffer = VK_NULL_HANDLE;
+    target.m_counterMemory = VK_NULL_HANDLE;
+    target.m_sourceView = VK_NULL_HANDLE;
+}
+
+inline void MipGenerator::Record(VkCommandBuffer commandBuffer,
+                                const Target& target, Reduction reduction,
+                                VkImageLayout srcLayout,
+                                VkPipelineStageFlags srcStage,
+                                VkAccessFlags srcAccess,
+                                VkPipelineStageFlags dstStage)
+{
+    if (target.m_mipLevels < 2)
+    {
+        return;
+    }
+
+    FormatInfo info;
+    GetFormatInfo(target.m_format, info);
+    VkPipeline pipeline = GetPipeline(info, reduction);
+
+    vkCmdFillBuffer(commandBuffer, target.m_counterBuffer, 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier counterBarrier{};
+    counterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                    VK_ACCESS_SHADER_WRITE_BIT;
+
+    // the previous contents of levels 1 and up are discarded
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (VkImageMemoryBarrier& barrier : barriers)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = target.m_image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    barriers[0].subresourceRange.baseMipLevel = 0;
+    barriers[0].subresourceRange.levelCount = 1;
+    barriers[0].oldLayout = srcLayout;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = srcAccess;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].subresourceRange.baseMipLevel = 1;
+    barriers[1].subresourceRange.levelCount = target.m_mipLevels - 1;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                        &counterBarrier, 0, nullptr,
+                        static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    uint32_t width = std::max(1u, target.m_width >> 1);
+    uint32_t height = std::max(1u, target.m_height >> 1);
+    uint32_t groupsX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t groupsY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    Constants constants{target.m_mipLevels - 1, groupsX * groupsY};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_pipelineLayout, 0, 1, &target.m_descriptorSet,
+                            0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout,
+                        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                        &constants);
+    vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    // the counter is cleared again by the next Record()
+    counterBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                    VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        dstStage | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                        &counterBarrier, 0, nullptr, 1, &barriers[1]);
+}
+
+inline bool MipGenerator::GetFormatInfo(VkFormat format, FormatInfo& info)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        info = {Variant::RGBA8, VK_FORMAT_R8G8B8A8_UNORM, false};
+        return true;
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        info = {Variant::RGBA8, VK_FORMAT_R8G8B8A8_UNORM, true};
+        return true;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        info = {Variant::RGBA16F, VK_FORMAT_R16G16B16A16_SFLOAT, false};
+        return true;
+    case VK_FORMAT_R32_SFLOAT:
+        info = {Variant::R32F, VK_FORMAT_R32_SFLOAT, false};
+        return true;
+    default:
+        return false;
+    }
+}
+
+// pipelines are specialized for the reduction and the sRGB encoding the
+// first time they are used
+inline VkPipeline MipGenerator::GetPipeline(const FormatInfo& info,
+                                            Reduction reduction)
+{
+    uint32_t index = (static_cast<uint32_t>(info.m_variant) *
+                    static_cast<uint32_t>(Reduction::COUNT) +
+                    static_cast<uint32_t>(reduction)) * 2 +
+                    (info.m_srgb ? 1 : 0);
+    if (VK_NULL_HANDLE != m_pipelines[index])
+    {
+        return m_pipelines[index];
+    }
+
+    struct Specialization
+    {
+        uint32_t m_reduction;
+        VkBool32 m_srgb;
+    } specialization{static_cast<uint32_t>(reduction),
+                    info.m_srgb ? VK_TRUE : VK_FALSE};
+
+    std::array<VkSpecializationMapEntry, 2> entries{};
+    entries[0].constantID = 0;
+    entries[0].offset = offsetof(Specialization, m_reduction);
+    entries[0].size = sizeof(uint32_t);
+    entries[1].constantID = 1;
+    entries[1].offset = offsetof(Specialization, m_srgb);
+    entries[1].size = sizeof(VkBool32);
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+    specializationInfo.pMapEntries = entries.data();
+    specializationInfo.dataSize = sizeof(specialization);
+    specializationInfo.pData = &specialization;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module =
+                    m_shaderModules[static_cast<uint32_t>(info.m_variant)];
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipelineInfo.layout = m_pipelineLayout;
+
+    if (VK_SUCCESS != vkCreateComputePipelines(m_device, m_pipelineCache, 1,
+                        &pipelineInfo, m_allocator, &m_pipelines[index]))
+    {
+        throw std::runtime_error("failed to create downsample pipeline");
+    }
+
+    return m_pipelines[index];
+}
+
+#endif // MIP_GENERATOR_HPP
@@ -0,0 +1,614 @@
+#ifndef OCCLUSION_CULLING_HPP
+#define OCCLUSION_CULLING_HPP
+
+#include <glm/glm.hpp> // linear algebra
+
+#include <vector> // std::vector
+#include <algorithm> // std::min, std::max, std::clamp, std::partial_sort
+#include <cmath> // std::floor
+#include <utility> // std::pair
+#include <limits> // std::numeric_limits
+#include <cstdint> // uint32_t, uint64_t
+
+#include "profiler.hpp" // PROFILE_ZONE
+#include "worker_pool.hpp" // WorkerPool
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE, AVX2
+#define OCCLUSION_X86
+#endif
+
+// A low resolution masked software rasterizer for CPU occlusion culling.
+// Occluder triangles are rasterized into 8x8 pixel tiles, each tile keeps a
+// 64 bit coverage mask and two depths: the conservative farthest depth of the
+// whole tile and the farthest depth of the partially covered layer in front
+// of it. When the layer covers the tile it becomes the tile depth. Tiles are
+// grouped in blocks holding the farthest tile depth, so a query rejects most
+// boxes without touching single tiles.
+// Render() hands the frame to the workers and returns, Wait() joins them
+// before any query. Depth is Vulkan clip depth, smaller is nearer.
+class OcclusionCuller
+{
+public:
+    static constexpr uint32_t WIDTH = 256;
+    static constexpr uint32_t HEIGHT = 128;
+    static constexpr uint32_t TILE_SIZE = 8;
+    static constexpr uint32_t TILES_X = WIDTH / TILE_SIZE;
+    static constexpr uint32_t TILES_Y = HEIGHT / TILE_SIZE;
+    static constexpr uint32_t BLOCK_TILES = 4;
+    static constexpr uint32_t BLOCKS_X = TILES_X / BLOCK_TILES;
+    static constexpr uint32_t BLOCKS_Y = TILES_Y / BLOCK_TILES;
+
+    enum class Isa
+    {
+        SCALAR,
+        SSE,
+        AVX2
+    };
+
+    ~OcclusionCuller();
+
+    void Create(uint32_t workerCount, Isa isa);
+    void Destroy();
+
+    void SetOccluders(const std::vector<glm::vec3>& positions,
+                        const std::vector<uint32_t>& indices);
+    void Render(const glm::mat4& modelViewProj);
+    void Wait();
+    bool IsVisible(const glm::vec3& minPos, const glm::vec3& maxPos) const;
+
+    uint32_t GetTriangleCount() const;
+    uint32_t GetWorkerCount() const;
+    Isa GetIsa() const;
+
+    static Isa DetectIsa();
+    static const char *GetIsaName(Isa isa);
+    static void SelectOccluders(const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount, uint32_t budget,
+                    std::vector<uint32_t>& occluderIndices);
+
+private:
+    static constexpr uint64_t FULL_MASK = ~uint64_t{0};
+    static constexpr float MIN_W = 1e-5f;
+
+    struct Triangle
+    {
+        float m_edges[3][3]; // a, b, c of a * x + b * y + c
+        float m_zMax;
+        int32_t m_tileMinX;
+        int32_t m_tileMinY;
+        int32_t m_tileMaxX;
+        int32_t m_tileMaxY;
+        bool m_valid;
+    };
+
+    struct Tile
+    {
+        uint64_t m_mask;
+        float m_zMax0;
+        float m_zMax1;
+    };
+
+    void RunWorker(uint32_t worker, uint32_t workerCount);
+    void Setup(uint32_t first, uint32_t last);
+    void Rasterize(uint32_t worker, uint32_t workerCount);
+    void BuildBlocks();
+    uint64_t CoverTile(const Triangle& triangle, int32_t tileX,
+                        int32_t tileY) const;
+    static void UpdateTile(Tile& tile, uint64_t mask, float zMax);
+
+    static uint64_t CoverTileScalar(const Triangle& triangle, float x,
+                                    float y);
+#ifdef OCCLUSION_X86
+    static uint64_t CoverTileSse(const Triangle& triangle, float x, float y);
+    static uint64_t CoverTileAvx2(const Triangle& triangle, float x, float y);
+#endif
+
+    std::vector<glm::vec3> m_positions;
+    std::vector<uint32_t> m_indices;
+    std::vector<Triangle> m_triangles;
+    std::vector<Tile> m_tiles;
+    std::vector<float> m_blocks;
+    glm::mat4 m_modelViewProj{1.0f};
+    Isa m_isa{Isa::SCALAR};
+
+    WorkerPool m_pool;
+};
+
+inline OcclusionCuller::~OcclusionCuller()
+{
+    Destroy();
+}
+
+// zero workers renders on the calling thread inside Render()
+inline void OcclusionCuller::Create(uint32_t workerCount, Isa isa)
+{
+    m_isa = isa;
+    m_tiles.assign(TILES_X * TILES_Y, Tile{});
+    m_blocks.assign(BLOCKS_X * BLOCKS_Y, 1.0f);
+    m_pool.Create(workerCount, "occlusion worker");
+}
+
+inline void OcclusionCuller::Destroy()
+{
+    m_pool.Destroy();
+}
+
+inline void OcclusionCuller::SetOccluders(const std::vector<glm::vec3>& positions,
+                                        const std::vector<uint32_t>& indices)
+{
+    m_positions = positions;
+    m_indices = indices;
+    m_triangles.resize(m_indices.size() / 3);
+}
+
+inline void OcclusionCuller::Render(const glm::mat4& modelViewProj)
+{
+    m_modelViewProj = modelViewProj;
+
+    for (Tile& tile : m_tiles)
+    {
+        tile = {0, 1.0f, 0.0f};
+    }
+
+    uint32_t workerCount = m_pool.GetWorkerCount();
+    if (0 == workerCount)
+    {
+        RunWorker(0, 1);
+        return;
+    }
+
+    m_pool.Start([this, workerCount](uint32_t worker)
+    {
+        RunWorker(worker, workerCount);
+    });
+}
+
+inline void OcclusionCuller::Wait()
+{
+    m_pool.Wait();
+    BuildBlocks();
+}
+
+// the box is in model space, boxes crossing the near plane are visible
+inline bool OcclusionCuller::IsVisible(const glm::vec3& minPos,
+                                        const glm::vec3& maxPos) const
+{
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxY = std::numeric_limits<float>::lowest();
+    float zMin = 1.0f;
+
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 position((corner & 1) ? maxPos.x : minPos.x,
+                            (corner & 2) ? maxPos.y : minPos.y,
+                            (corner & 4) ? maxPos.z : minPos.z, 1.0f);
+        glm::vec4 clip = m_modelViewProj * position;
+        if ((clip.w <= MIN_W) || (clip.z < 0.0f))
+        {
+            return true;
+        }
+
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+        zMin = std::min(zMin, clip.z / clip.w);
+    }
+
+    if ((maxX < 0.0f) || (maxY < 0.0f) || (minX >= WIDTH) || (minY >= HEIGHT))
+    {
+        return false;
+    }
+
+    // a corner just in front of the camera projects far outside the buffer
+    minX = std::max(minX, 0.0f);
+    minY = std::max(minY, 0.0f);
+    maxX = std::min(maxX, static_cast<float>(WIDTH - 1));
+    maxY = std::min(maxY, static_cast<float>(HEIGHT - 1));
+
+    int32_t tileMinX = std::max(0, static_cast<int32_t>(minX) /
+                                    static_cast<int32_t>(TILE_SIZE));
+    int32_t tileMinY = std::max(0, static_cast<int32_t>(minY) /
+                                    static_cast<int32_t>(TILE_SIZE));
+    int32_t tileMaxX = std::min(static_cast<int32_t>(TILES_X) - 1,
+                        static_cast<int32_t>(maxX) / static_cast<int32_t>(TILE_SIZE));
+    int32_t tileMaxY = std::min(static_cast<int32_t>(TILES_Y) - 1,
+                        static_cast<int32_t>(maxY) / static_cast<int32_t>(TILE_SIZE));
+
+    int32_t block = static_cast<int32_t>(BLOCK_TILES);
+    for (int32_t blockY = tileMinY / block; blockY <= tileMaxY / block; ++blockY)
+    {
+        for (int32_t blockX = tileMinX / block; blockX <= tileMaxX / block;
+            ++blockX)
+        {
+            if (zMin > m_blocks[blockY * BLOCKS_X + blockX])
+            {
+                continue;
+            }
+
+            int32_t lastY = std::min(tileMaxY, blockY * block + block - 1);
+            int32_t lastX = std::min(tileMaxX, blockX * block + block - 1);
+            for (int32_t y = std::max(tileMinY, blockY * block); y <= lastY; ++y)
+            {
+                for (int32_t x = std::max(tileMinX, blockX * block); x <= lastX;
+                    ++x)
+                {
+                    if (zMin <= m_tiles[y * TILES_X + x].m_zMax0)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+inline uint32_t OcclusionCuller::GetTriangleCount() const
+{
+    return static_cast<uint32_t>(m_triangles.size());
+}
+
+inline uint32_t OcclusionCuller::GetWorkerCount() const
+{
+    return m_pool.GetWorkerCount();
+}
+
+inline OcclusionCuller::Isa OcclusionCuller::GetIsa() const
+{
+    return m_isa;
+}
+
+inline OcclusionCuller::Isa OcclusionCuller::DetectIsa()
+{
+#ifdef OCCLUSION_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Isa::AVX2;
+    }
+
+    return Isa::SSE;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+inline const char *OcclusionCuller::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::SSE:
+        return "sse";
+    default:
+        return "scalar";
+    }
+}
+
+// The largest triangles of a mesh stand in for it. A subset of the real
+// surface never occludes more than the mesh itself, so culling stays
+// conservative without a simplifier.
+inline void OcclusionCuller::SelectOccluders(
+                    const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices, uint32_t firstIndex,
+                    uint32_t indexCount, uint32_t budget,
+                    std::vector<uint32_t>& occluderIndices)
+{
+    std::vector<std::pair<float, uint32_t>> areas;
+    areas.reserve(indexCount / 3);
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3)
+    {
+        const glm::vec3& a = positions[indices[i + 0]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        areas.push_back({glm::length(glm::cross(b - a, c - a)), i});
+    }
+
+    uint32_t count = std::min(budget, static_cast<uint32_t>(areas.size()));
+    std::partial_sort(areas.begin(), areas.begin() + count, areas.end(),
+                    [](const std::pair<float, uint32_t>& lhs,
+                        const std::pair<float, uint32_t>& rhs)
+                    {
+                        return lhs.first > rhs.first;
+                    });
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t first = areas[i].second;
+        occluderIndices.insert(occluderIndices.end(), &indices[first],
+                                &indices[first] + 3);
+    }
+}
+
+// setup is split by triangles, rasterization by interleaved tile rows so no
+// two workers write the same tile
+inline void OcclusionCuller::RunWorker(uint32_t worker, uint32_t workerCount)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(m_triangles.size());
+    uint32_t chunk = (triangleCount + workerCount - 1) / workerCount;
+    uint32_t first = std::min(triangleCount, worker * chunk);
+    {
+        PROFILE_ZONE("occluder setup");
+        Setup(first, std::min(triangleCount, first + chunk));
+    }
+
+    m_pool.ArriveAndWait(workerCount);
+
+    PROFILE_ZONE("occluder raster");
+    Rasterize(worker, workerCount);
+}
+
+inline void OcclusionCuller::Setup(uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first; i < last; ++i)
+    {
+        Triangle& triangle = m_triangles[i];
+        triangle.m_valid = false;
+
+        // occluders crossing the near plane are dropped, not clipped; with
+        // the [0, 1] depth range that is z < 0, w only catches the camera
+        // plane
+        glm::vec3 screen[3];
+        float zMax = 0.0f;
+        bool behind = false;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            glm::vec4 clip = m_modelViewProj *
+                            glm::vec4(m_positions[m_indices[3 * i + corner]], 1.0f);
+            if ((clip.w <= MIN_W) || (clip.z < 0.0f))
+            {
+                behind = true;
+                break;
+            }
+
+            screen[corner] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * WIDTH,
+                                    (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT,
+                                    clip.z / clip.w);
+            zMax = std::max(zMax, screen[corner].z);
+        }
+
+        if (behind || (1.0f < zMax))
+        {
+            continue;
+        }
+
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+                    (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+        if (0.0f == area)
+        {
+            continue;
+        }
+
+        // both windings occlude, the edges are flipped to face inwards
+        float sign = (0.0f < area) ? 1.0f : -1.0f;
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            const glm::vec3& a = screen[edge];
+            const glm::vec3& b = screen[(edge + 1) % 3];
+            triangle.m_edges[edge][0] = sign * (a.y - b.y);
+            triangle.m_edges[edge][1] = sign * (b.x - a.x);
+            triangle.m_edges[edge][2] = sign * (a.x * b.y - a.y * b.x);
+        }
+
+        // clamped one pixel past the buffer so the casts stay in range and
+        // a triangle off either side still ends up with an empty tile range
+        float minX = std::clamp(std::min(screen[0].x,
+                        std::min(screen[1].x, screen[2].x)), -1.0f,
+                        static_cast<float>(WIDTH));
+        float minY = std::clamp(std::min(screen[0].y,
+                        std::min(screen[1].y, screen[2].y)), -1.0f,
+                        static_cast<float>(HEIGHT));
+        float maxX = std::clamp(std::max(screen[0].x,
+                        std::max(screen[1].x, screen[2].x)), -1.0f,
+                        static_cast<float>(WIDTH));
+        float maxY = std::clamp(std::max(screen[0].y,
+                        std::max(screen[1].y, screen[2].y)), -1.0f,
+                        static_cast<float>(HEIGHT));
+
+        triangle.m_tileMinX = std::max(0, static_cast<int32_t>(
+                                std::floor(minX / TILE_SIZE)));
+        triangle.m_tileMinY = std::max(0, static_cast<int32_t>(
+                                std::floor(minY / TILE_SIZE)));
+        triangle.m_tileMaxX = std::min(static_cast<int32_t>(TILES_X) - 1,
+                        static_cast<int32_t>(std::floor(maxX / TILE_SIZE)));
+        triangle.m_tileMaxY = std::min(static_cast<int32_t>(TILES_Y) - 1,
+                        static_cast<int32_t>(std::floor(maxY / TILE_SIZE)));
+        triangle.m_zMax = zMax;
+        triangle.m_valid = (triangle.m_tileMinX <= triangle.m_tileMaxX) &&
+                            (triangle.m_tileMinY <= triangle.m_tileMaxY);
+    }
+}
+
+inline void OcclusionCuller::Rasterize(uint32_t worker, uint32_t workerCount)
+{
+    for (const Triangle& triangle : m_triangles)
+    {
+        if (!triangle.m_valid)
+        {
+            continue;
+        }
+
+        int32_t firstRow = triangle.m_tileMinY +
+            static_cast<int32_t>((workerCount + worker -
+            static_cast<uint32_t>(triangle.m_tileMinY) % workerCount) %
+            workerCount);
+        for (int32_t y = firstRow; y <= triangle.m_tileMaxY;
+            y += static_cast<int32_t>(workerCount))
+        {
+            for (int32_t x = triangle.m_tileMinX; x <= triangle.m_tileMaxX; ++x)
+            {
+                UpdateTile(m_tiles[y * TILES_X + x], CoverTile(triangle, x, y),
+                            triangle.m_zMax);
+            }
+        }
+    }
+}
+
+inline void OcclusionCuller::BuildBlocks()
+{
+    for (uint32_t blockY = 0; blockY < BLOCKS_Y; ++blockY)
+    {
+        for (uint32_t blockX = 0; blockX < BLOCKS_X; ++blockX)
+        {
+            float zMax = 0.0f;
+            for (uint32_t y = 0; y < BLOCK_TILES; ++y)
+            {
+                for (uint32_t x = 0; x < BLOCK_TILES; ++x)
+                {
+                    const Tile& tile = m_tiles[(blockY * BLOCK_TILES + y) *
+                                        TILES_X + blockX * BLOCK_TILES + x];
+                    zMax = std::max(zMax, tile.m_zMax0);
+                }
+            }
+            m_blocks[blockY * BLOCKS_X + blockX] = zMax;
+        }
+    }
+}
+
+// the coverage bit of a pixel is set when its center is strictly inside,
+// occluders must never cover more than the triangle does
+inline uint64_t OcclusionCuller::CoverTile(const Triangle& triangle,
+                                        int32_t tileX, int32_t tileY) const
+{
+    float x = static_cast<float>(tileX * static_cast<int32_t>(TILE_SIZE)) + 0.5f;
+    float y = static_cast<float>(tileY * static_cast<int32_t>(TILE_SIZE)) + 0.5f;
+
+    switch (m_isa)
+    {
+#ifdef OCCLUSION_X86
+    case Isa::AVX2:
+        return CoverTileAvx2(triangle, x, y);
+    case Isa::SSE:
+        return CoverTileSse(triangle, x, y);
+#endif
+    default:
+        return CoverTileScalar(triangle, x, y);
+    }
+}
+
+// Merges the triangle into the tile's front layer. Triangles behind the tile
+// depth are ignored, a fully covered layer replaces the tile depth.
+inline void OcclusionCuller::UpdateTile(Tile& tile, uint64_t mask, float zMax)
+{
+    if ((0 == mask) || (zMax >= tile.m_zMax0))
+    {
+        return;
+    }
+
+    tile.m_mask |= mask;
+    tile.m_zMax1 = std::max(tile.m_zMax1, zMax);
+    if (FULL_MASK == tile.m_mask)
+    {
+        tile.m_zMax0 = tile.m_zMax1;
+        tile.m_zMax1 = 0.0f;
+        tile.m_mask = 0;
+    }
+}
+
+inline uint64_t OcclusionCuller::CoverTileScalar(const Triangle& triangle,
+                                                float x, float y)
+{
+    uint64_t mask = 0;
+    for (uint32_t row = 0; row < TILE_SIZE; ++row)
+    {
+        for (uint32_t column = 0; column < TILE_SIZE; ++column)
+        {
+            bool inside = true;
+            for (uint32_t edge = 0; edge < 3; ++edge)
+            {
+                const float *e = triangle.m_edges[edge];
+                inside = inside && (0.0f < e[0] * (x + column) +
+                                    e[1] * (y + row) + e[2]);
+            }
+            mask |= static_cast<uint64_t>(inside) << (row * TILE_SIZE + column);
+        }
+    }
+
+    return mask;
+}
+
+#ifdef OCCLUSION_X86
+inline uint64_t OcclusionCuller::CoverTileSse(const Triangle& triangle,
+                                            float x, float y)
+{
+    __m128 left = _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    __m128 right = _mm_add_ps(left, _mm_set1_ps(4.0f));
+    __m128 zero = _mm_setzero_ps();
+
+    // per edge a * x is the same for every row
+    __m128 leftEdges[3];
+    __m128 rightEdges[3];
+    for (uint32_t edge = 0; edge < 3; ++edge)
+    {
+        __m128 a = _mm_set1_ps(triangle.m_edges[edge][0]);
+        leftEdges[edge] = _mm_mul_ps(a, left);
+        rightEdges[edge] = _mm_mul_ps(a, right);
+    }
+
+    uint64_t mask = 0;
+    for (uint32_t row = 0; row < TILE_SIZE; ++row)
+    {
+        __m128 leftInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 rightInside = leftInside;
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            const float *e = triangle.m_edges[edge];
+            __m128 base = _mm_set1_ps(e[1] * (y + row) + e[2]);
+            leftInside = _mm_and_ps(leftInside,
+                        _mm_cmpgt_ps(_mm_add_ps(leftEdges[edge], base), zero));
+            rightInside = _mm_and_ps(rightInside,
+                        _mm_cmpgt_ps(_mm_add_ps(rightEdges[edge], base), zero));
+        }
+
+        uint64_t bits = static_cast<uint64_t>(_mm_movemask_ps(leftInside)) |
+                        (static_cast<uint64_t>(_mm_movemask_ps(rightInside)) << 4);
+        mask |= bits << (row * TILE_SIZE);
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+inline uint64_t OcclusionCuller::CoverTileAvx2(const Triangle& triangle,
+                                            float x, float y)
+{
+    __m256 columns = _mm256_add_ps(_mm256_set1_ps(x),
+            _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+    __m256 zero = _mm256_setzero_ps();
+
+    __m256 edges[3];
+    for (uint32_t edge = 0; edge < 3; ++edge)
+    {
+        edges[edge] = _mm256_mul_ps(_mm256_set1_ps(triangle.m_edges[edge][0]),
+                                    columns);
+    }
+
+    uint64_t mask = 0;
+    for (uint32_t row = 0; row < TILE_SIZE; ++row)
+    {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            const float *e = triangle.m_edges[edge];
+            __m256 base = _mm256_set1_ps(e[1] * (y + row) + e[2]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(
+                        _mm256_add_ps(edges[edge], base), zero, _CMP_GT_OQ));
+        }
+
+        mask |= static_cast<uint64_t>(_mm256_movemask_ps(inside)) <<
+                (row * TILE_SIZE);
+    }
+
+    return mask;
+}
+#endif
+
+#endif // OCCLUSION_CULLING_HPP
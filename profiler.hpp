@@ -0,0 +1,213 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <array> // std::array
+#include <vector> // std::vector
+#include <memory> // std::unique_ptr
+#include <atomic> // std::atomic, std::atomic_thread_fence
+#include <mutex> // std::mutex
+#include <algorithm> // std::max
+#include <chrono> // std::chrono::steady_clock
+#include <fstream> // std::ofstream
+#include <string> // std::string
+#include <cstdint> // uint64_t
+
+// Scoped CPU zones written to a ring per thread and exported as a Chrome
+// trace for chrome://tracing or Perfetto. A thread only ever writes its own
+// ring, so recording a zone is two clock reads and a release store. The
+// export copies the rings while they are written and drops the entries that
+// were overwritten during the copy. GPU zones are added on the CPU clock by
+// the caller, see AddGpuZone().
+// Without ENABLE_PROFILER the macros compile to nothing.
+class Profiler
+{
+public:
+    static constexpr uint64_t RING_CAPACITY = 1 << 16;
+
+    class Zone
+    {
+    public:
+        explicit Zone(const char *name);
+        ~Zone();
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char *m_name;
+        uint64_t m_begin;
+    };
+
+    static Profiler& Get();
+    static uint64_t Now();
+
+    void SetThreadName(const char *name);
+    void Record(const char *name, uint64_t begin, uint64_t end);
+    void AddGpuZone(const char *name, uint64_t begin, uint64_t end);
+    bool WriteChromeTrace(const std::string& path);
+
+private:
+    struct Event
+    {
+        const char *m_name;
+        uint64_t m_begin;
+        uint64_t m_end;
+    };
+
+    struct ThreadRing
+    {
+        std::array<Event, RING_CAPACITY> m_events;
+        std::atomic<uint64_t> m_head{0};
+        const char *m_name{"thread"};
+        uint32_t m_id{0};
+    };
+
+    Profiler() = default;
+    ThreadRing& GetThreadRing();
+    void WriteRing(std::ofstream& file, ThreadRing& ring, uint32_t pid,
+                    bool& first);
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+    ThreadRing m_gpuRing;
+    uint64_t m_start{Now()};
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) \
+    Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) Profiler::Get().SetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+inline Profiler::Zone::Zone(const char *name) : m_name(name), m_begin(Now())
+{}
+
+inline Profiler::Zone::~Zone()
+{
+    Profiler::Get().Record(m_name, m_begin, Now());
+}
+
+inline Profiler& Profiler::Get()
+{
+    static Profiler profiler;
+
+    return profiler;
+}
+
+// steady_clock is CLOCK_MONOTONIC on Linux, the clock calibrated GPU
+// timestamps are reported in
+inline uint64_t Profiler::Now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(std::chrono::steady_clock::now().
+                    time_since_epoch()).count());
+}
+
+// the name must outlive the profiler, string literals do
+inline void Profiler::SetThreadName(const char *name)
+{
+    GetThreadRing().m_name = name;
+}
+
+inline void Profiler::Record(const char *name, uint64_t begin, uint64_t end)
+{
+    ThreadRing& ring = GetThreadRing();
+    uint64_t head = ring.m_head.load(std::memory_order_relaxed);
+    ring.m_events[head % RING_CAPACITY] = {name, begin, end};
+    ring.m_head.store(head + 1, std::memory_order_release);
+}
+
+// GPU zones come from the render thread only, once per frame
+inline void Profiler::AddGpuZone(const char *name, uint64_t begin, uint64_t end)
+{
+    uint64_t head = m_gpuRing.m_head.load(std::memory_order_relaxed);
+    m_gpuRing.m_events[head % RING_CAPACITY] = {name, begin, end};
+    m_gpuRing.m_head.store(head + 1, std::memory_order_release);
+}
+
+inline bool Profiler::WriteChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const std::unique_ptr<ThreadRing>& ring : m_rings)
+    {
+        WriteRing(file, *ring, 1, first);
+    }
+    m_gpuRing.m_name = "gpu";
+    WriteRing(file, m_gpuRing, 2, first);
+
+    file << "]}" << std::endl;
+
+    return static_cast<bool>(file);
+}
+
+inline Profiler::ThreadRing& Profiler::GetThreadRing()
+{
+    static thread_local ThreadRing *threadRing = nullptr;
+    if (nullptr == threadRing)
+    {
+        // rings are owned by the profiler so they outlive their threads
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rings.push_back(std::make_unique<ThreadRing>());
+        threadRing = m_rings.back().get();
+        threadRing->m_id = static_cast<uint32_t>(m_rings.size());
+    }
+
+    return *threadRing;
+}
+
+inline void Profiler::WriteRing(std::ofstream& file, ThreadRing& ring,
+                                uint32_t pid, bool& first)
+{
+    uint64_t head = ring.m_head.load(std::memory_order_acquire);
+    uint64_t tail = (head > RING_CAPACITY) ? head - RING_CAPACITY : 0;
+    std::vector<Event> events;
+    events.reserve(head - tail);
+    for (uint64_t i = tail; i < head; ++i)
+    {
+        events.push_back(ring.m_events[i % RING_CAPACITY]);
+    }
+
+    // Entries the writer lapped while they were copied are torn. A writer
+    // that has published up to after may already be filling the slot of
+    // after - RING_CAPACITY, so only the entries past it are kept.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring.m_head.load(std::memory_order_relaxed);
+    uint64_t valid = (after >= RING_CAPACITY) ? after - RING_CAPACITY + 1 : 0;
+
+    file << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\"," <<
+    "\"pid\":" << pid << ",\"tid\":" << ring.m_id <<
+    ",\"args\":{\"name\":\"" << ring.m_name << "\"}}";
+    first = false;
+
+    for (uint64_t i = std::max(tail, valid); i < head; ++i)
+    {
+        const Event& event = events[i - tail];
+        if (event.m_begin < m_start)
+        {
+            continue;
+        }
+
+        file << ",{\"name\":\"" << event.m_name << "\",\"ph\":\"X\"," <<
+        "\"pid\":" << pid << ",\"tid\":" << ring.m_id << ",\"ts\":" <<
+        (event.m_begin - m_start) / 1000.0 << ",\"dur\":" <<
+        (event.m_end - event.m_begin) / 1000.0 << "}";
+    }
+}
+
+#endif // PROFILER_HPP
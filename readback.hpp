@@ -0,0 +1,468 @@
+#ifndef READBACK_HPP
+#define READBACK_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <stb_image_write.h> // stbi_write_png
+
+#include <vector> // std::vector
+#include <deque> // std::deque
+#include <string> // std::string
+#include <functional> // std::function
+#include <thread> // std::thread
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <stdexcept> // std::runtime_error
+#include <cstdio> // std::FILE, std::snprintf, popen
+#include <iostream> // std::cerr
+#include <cstdint> // uint32_t, uint64_t
+
+#include "profiler.hpp" // PROFILE_ZONE
+
+// Copies presented frames back to the host without stalling the frame loop.
+// A frame that captures takes a free slot of the ring, records a copy of the
+// back buffer into the slot's host buffer and is submitted as usual. Poll()
+// hands every slot whose frame has completed on the timeline to a writer
+// thread, which reads the mapped memory in place and frees the slot once the
+// frame is written. When every slot is still in flight or being written the
+// frame is dropped instead of waited for, so a slow disk or encoder costs
+// frames, never frame time.
+// PNG and raw frames are written to a directory, Y4M is streamed to a file, a
+// named pipe, or to a command when the target starts with '|'.
+class ReadbackRing
+{
+public:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    enum class Format
+    {
+        PNG,
+        RAW,
+        Y4M
+    };
+
+    // the buffer has to stay mapped, coherent is false for cached memory
+    // that needs invalidating
+    using CreateBufferFunction = std::function<void(VkDeviceSize size,
+                        VkBuffer& buffer, VkDeviceMemory& memory,
+                        void *& mapped, bool& coherent)>;
+    // called for buffers a recorded frame may still reference
+    using DestroyBufferFunction = std::function<void(VkBuffer buffer,
+                                                    VkDeviceMemory memory)>;
+
+    struct Stats
+    {
+        uint64_t m_captured{0};
+        uint64_t m_written{0};
+        uint64_t m_dropped{0};
+    };
+
+    static bool IsSupported(VkFormat format);
+
+    void Create(VkDevice device, uint32_t slotCount, VkFormat format,
+                VkExtent2D extent, Format outputFormat, const std::string& target,
+                const CreateBufferFunction& createBuffer,
+                const DestroyBufferFunction& destroyBuffer);
+    void Destroy();
+
+    uint32_t Acquire(VkExtent2D extent);
+    VkBuffer GetBuffer(uint32_t slot) const;
+    void RecordCopy(VkCommandBuffer commandBuffer, VkImage image,
+                    uint32_t slot) const;
+    void Submit(uint32_t slot, uint64_t timelineValue, uint64_t frame);
+    void Poll(uint64_t completedValue);
+
+    Stats GetStats();
+
+private:
+    enum class State
+    {
+        FREE,
+        PENDING,
+        WRITING
+    };
+
+    struct Slot
+    {
+        VkBuffer m_buffer{VK_NULL_HANDLE};
+        VkDeviceMemory m_memory{VK_NULL_HANDLE};
+        void *m_mapped{nullptr};
+        bool m_coherent{true};
+        VkDeviceSize m_capacity{0};
+        VkExtent2D m_extent{};
+        uint64_t m_timelineValue{0};
+        uint64_t m_frame{0};
+        State m_state{State::FREE};
+    };
+
+    void Allocate(Slot& slot, VkExtent2D extent);
+    void WriterLoop();
+    void Write(const Slot& slot);
+    void ToRgba(const Slot& slot);
+    void WriteY4m(const Slot& slot);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    VkFormat m_format{VK_FORMAT_UNDEFINED};
+    Format m_outputFormat{Format::PNG};
+    std::string m_target;
+    CreateBufferFunction m_createBuffer;
+    DestroyBufferFunction m_destroyBuffer;
+    std::vector<Slot> m_slots;
+    uint32_t m_next{0};
+    std::deque<uint32_t> m_pending;
+
+    // the writer queue and slot states are shared with the writer thread
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<uint32_t> m_written;
+    bool m_stop{false};
+    Stats m_stats;
+    std::thread m_writer;
+
+    // only touched by the writer thread
+    std::vector<unsigned char> m_rgba;
+    std::vector<unsigned char> m_planes;
+    std::FILE *m_stream{nullptr};
+    bool m_pipe{false};
+    bool m_streamFailed{false};
+    VkExtent2D m_streamExtent{};
+};
+
+// the copy is taken as is, the writer only swaps the channels of BGRA
+inline bool ReadbackRing::IsSupported(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline void ReadbackRing::Create(VkDevice device, uint32_t slotCount,
+                                VkFormat format, VkExtent2D extent,
+                                Format outputFormat, const std::string& target,
+                                const CreateBufferFunction& createBuffer,
+                                const DestroyBufferFunction& destroyBuffer)
+{
+    m_device = device;
+    m_format = format;
+    m_outputFormat = outputFormat;
+    m_target = target;
+    m_createBuffer = createBuffer;
+    m_destroyBuffer = destroyBuffer;
+    m_stats = Stats{};
+
+    // every slot exists from the start, a dropped frame still needs a buffer
+    // to put its barriers on
+    m_slots.assign(slotCount, Slot{});
+    for (Slot& slot : m_slots)
+    {
+        Allocate(slot, extent);
+    }
+
+    m_stop = false;
+    m_writer = std::thread(&ReadbackRing::WriterLoop, this);
+}
+
+// the GPU must be idle, frames that completed are written before returning
+inline void ReadbackRing::Destroy()
+{
+    Poll(UINT64_MAX);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    m_writer.join();
+
+    for (Slot& slot : m_slots)
+    {
+        m_destroyBuffer(slot.m_buffer, slot.m_memory);
+    }
+    m_slots.clear();
+}
+
+// returns NO_SLOT when the frame has to be dropped
+inline uint32_t ReadbackRing::Acquire(VkExtent2D extent)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t i = 0; i < m_slots.size(); ++i)
+    {
+        uint32_t index = (m_next + i) % static_cast<uint32_t>(m_slots.size());
+        Slot& slot = m_slots[index];
+        if (State::FREE != slot.m_state)
+        {
+            continue;
+        }
+
+        // after a resize slots grow as they come free
+        if (slot.m_capacity < static_cast<VkDeviceSize>(extent.width) *
+                                extent.height * 4)
+        {
+            m_destroyBuffer(slot.m_buffer, slot.m_memory);
+            Allocate(slot, extent);
+        }
+        slot.m_extent = extent;
+        m_next = (index + 1) % static_cast<uint32_t>(m_slots.size());
+
+        return index;
+    }
+
+    ++m_stats.m_dropped;
+
+    return NO_SLOT;
+}
+
+inline VkBuffer ReadbackRing::GetBuffer(uint32_t slot) const
+{
+    return m_slots[(NO_SLOT == slot) ? 0 : slot].m_buffer;
+}
+
+// the image is in TRANSFER_SRC_OPTIMAL, rows are tightly packed
+inline void ReadbackRing::RecordCopy(VkCommandBuffer commandBuffer,
+                                    VkImage image, uint32_t slot) const
+{
+    const Slot& target = m_slots[slot];
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {target.m_extent.width, target.m_extent.height, 1};
+
+    vkCmdCopyImageToBuffer(commandBuffer, image,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.m_buffer,
+                        1, &region);
+}
+
+inline void ReadbackRing::Submit(uint32_t slot, uint64_t timelineValue,
+                                uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[slot].m_timelineValue = timelineValue;
+    m_slots[slot].m_frame = frame;
+    m_slots[slot].m_state = State::PENDING;
+    m_pending.push_back(slot);
+    ++m_stats.m_captured;
+}
+
+// frames complete in submission order, so does the output
+inline void ReadbackRing::Poll(uint64_t completedValue)
+{
+    bool handed = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_pending.empty() &&
+               (m_slots[m_pending.front()].m_timelineValue <= completedValue))
+        {
+            m_slots[m_pending.front()].m_state = State::WRITING;
+            m_written.push_back(m_pending.front());
+            m_pending.pop_front();
+            handed = true;
+        }
+    }
+
+    if (handed)
+    {
+        m_condition.notify_one();
+    }
+}
+
+inline ReadbackRing::Stats ReadbackRing::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_stats;
+}
+
+inline void ReadbackRing::Allocate(Slot& slot, VkExtent2D extent)
+{
+    slot.m_capacity = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    slot.m_extent = extent;
+    m_createBuffer(slot.m_capacity, slot.m_buffer, slot.m_memory,
+                    slot.m_mapped, slot.m_coherent);
+}
+
+inline void ReadbackRing::WriterLoop()
+{
+    PROFILE_THREAD("readback writer");
+
+    for (;;)
+    {
+        uint32_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]
+            {
+                return (m_stop || !m_written.empty());
+            });
+
+            if (m_written.empty())
+            {
+                break;
+            }
+
+            index = m_written.front();
+            m_written.pop_front();
+        }
+
+        // the slot is not touched by the frame loop until it is freed
+        Write(m_slots[index]);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_slots[index].m_state = State::FREE;
+        ++m_stats.m_written;
+    }
+
+    if (nullptr != m_stream)
+    {
+        m_pipe ? pclose(m_stream) : std::fclose(m_stream);
+        m_stream = nullptr;
+    }
+}
+
+inline void ReadbackRing::Write(const Slot& slot)
+{
+    PROFILE_ZONE("write frame");
+    if (!slot.m_coherent)
+    {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = slot.m_memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    }
+
+    ToRgba(slot);
+
+    int width = static_cast<int>(slot.m_extent.width);
+    int height = static_cast<int>(slot.m_extent.height);
+    char path[512];
+    switch (m_outputFormat)
+    {
+    case Format::PNG:
+        std::snprintf(path, sizeof(path), "%s/frame_%06llu.png",
+                    m_target.c_str(),
+                    static_cast<unsigned long long>(slot.m_frame));
+        if (0 == stbi_write_png(path, width, height, 4, m_rgba.data(),
+                                width * 4))
+        {
+            std::cerr << "capture: failed to write " << path << std::endl;
+        }
+        break;
+    case Format::RAW:
+    {
+        std::snprintf(path, sizeof(path), "%s/frame_%06llu_%dx%d.rgba",
+                    m_target.c_str(),
+                    static_cast<unsigned long long>(slot.m_frame), width, height);
+        std::FILE *file = std::fopen(path, "wb");
+        if (nullptr == file)
+        {
+            std::cerr << "capture: failed to open " << path << std::endl;
+            break;
+        }
+
+        bool written = (m_rgba.size() ==
+                        std::fwrite(m_rgba.data(), 1, m_rgba.size(), file));
+        if ((0 != std::fclose(file)) || !written)
+        {
+            std::cerr << "capture: failed to write " << path << std::endl;
+        }
+        break;
+    }
+    case Format::Y4M:
+        WriteY4m(slot);
+        break;
+    }
+}
+
+// the presented image is opaque, whatever alpha the passes left is dropped
+inline void ReadbackRing::ToRgba(const Slot& slot)
+{
+    bool bgra = ((VK_FORMAT_B8G8R8A8_UNORM == m_format) ||
+                (VK_FORMAT_B8G8R8A8_SRGB == m_format));
+    std::size_t texels = static_cast<std::size_t>(slot.m_extent.width) *
+                        slot.m_extent.height;
+    const unsigned char *source = static_cast<const unsigned char*>(
+                                                            slot.m_mapped);
+
+    m_rgba.resize(texels * 4);
+    for (std::size_t i = 0; i < texels; ++i)
+    {
+        const unsigned char *texel = source + 4 * i;
+        m_rgba[4 * i + 0] = bgra ? texel[2] : texel[0];
+        m_rgba[4 * i + 1] = texel[1];
+        m_rgba[4 * i + 2] = bgra ? texel[0] : texel[2];
+        m_rgba[4 * i + 3] = 255;
+    }
+}
+
+// 4:4:4 BT.601 in studio range. The stream keeps the size of its first
+// frame, frames captured after a resize are skipped.
+inline void ReadbackRing::WriteY4m(const Slot& slot)
+{
+    if (m_streamFailed)
+    {
+        return;
+    }
+
+    if (nullptr == m_stream)
+    {
+        m_pipe = (!m_target.empty() && ('|' == m_target[0]));
+        m_stream = m_pipe ? popen(m_target.c_str() + 1, "w") :
+                            std::fopen(m_target.c_str(), "wb");
+        if (nullptr == m_stream)
+        {
+            std::cerr << "capture: failed to open " << m_target << std::endl;
+            m_streamFailed = true;
+            return;
+        }
+
+        m_streamExtent = slot.m_extent;
+        std::fprintf(m_stream, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n",
+                    m_streamExtent.width, m_streamExtent.height);
+    }
+
+    if ((slot.m_extent.width != m_streamExtent.width) ||
+        (slot.m_extent.height != m_streamExtent.height))
+    {
+        return;
+    }
+
+    std::size_t texels = static_cast<std::size_t>(slot.m_extent.width) *
+                        slot.m_extent.height;
+    m_planes.resize(texels * 3);
+    for (std::size_t i = 0; i < texels; ++i)
+    {
+        float r = m_rgba[4 * i + 0];
+        float g = m_rgba[4 * i + 1];
+        float b = m_rgba[4 * i + 2];
+        m_planes[i] = static_cast<unsigned char>(
+                        16.5f + 0.257f * r + 0.504f * g + 0.098f * b);
+        m_planes[texels + i] = static_cast<unsigned char>(
+                        128.5f - 0.148f * r - 0.291f * g + 0.439f * b);
+        m_planes[2 * texels + i] = static_cast<unsigned char>(
+                        128.5f + 0.439f * r - 0.368f * g - 0.071f * b);
+    }
+
+    std::fputs("FRAME\n", m_stream);
+    if (m_planes.size() != std::fwrite(m_planes.data(), 1, m_planes.size(),
+                                        m_stream))
+    {
+        std::cerr << "capture: failed to write " << m_target << std::endl;
+        m_streamFailed = true;
+    }
+}
+
+#endif // READBACK_HPP
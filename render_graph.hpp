@@ -0,0 +1,799 @@
+#ifndef RENDER_GRAPH_HPP
+#define RENDER_GRAPH_HPP
+
+#include <vulkan/vulkan.h> // vulkan header
+
+#include <vector> // std::vector
+#include <functional> // std::function
+#include <string> // std::string
+#include <algorithm> // std::sort
+#include <stdexcept> // std::runtime_error
+#include <cstdint> // uint32_t
+
+#include "deletion_queue.hpp" // DeletionQueue
+
+// Per-frame render graph. Passes declare how they access images and buffers,
+// Compile() culls passes that do not contribute to an exported image, derives the
+// synchronization2 barriers between passes and places transient images whose
+// lifetimes do not overlap in the same memory. Images with the transient
+// attachment usage get their own lazily allocated memory instead, on tiled
+// GPUs it is never backed. Buffers are always imported. Execute() only patches
+// the imported image and buffer handles and records the precomputed barriers.
+class RenderGraph
+{
+public:
+    using Resource = uint32_t;
+    using Pass = uint32_t;
+    using ExecuteFunction = std::function<void(VkCommandBuffer)>;
+    using AllocateFunction =
+            std::function<VkDeviceMemory(const VkMemoryRequirements&, bool lazy)>;
+
+    enum class Access
+    {
+        COLOR_ATTACHMENT,
+        DEPTH_ATTACHMENT,
+        SAMPLED,
+        STORAGE_READ,
+        STORAGE_WRITE,
+        TRANSFER_SRC,
+        TRANSFER_DST,
+        PRESENT,
+        INDIRECT_READ,
+        VERTEX_STORAGE_READ,
+        HOST_READ
+    };
+
+    struct State
+    {
+        VkPipelineStageFlags2 m_stages{VK_PIPELINE_STAGE_2_NONE};
+        VkAccessFlags2 m_access{VK_ACCESS_2_NONE};
+        VkImageLayout m_layout{VK_IMAGE_LAYOUT_UNDEFINED};
+    };
+
+    struct ImageDesc
+    {
+        VkFormat m_format{VK_FORMAT_UNDEFINED};
+        VkExtent2D m_extent{};
+        VkSampleCountFlagBits m_samples{VK_SAMPLE_COUNT_1_BIT};
+        VkImageUsageFlags m_usage{0};
+        VkImageAspectFlags m_aspect{VK_IMAGE_ASPECT_COLOR_BIT};
+    };
+
+    struct Stats
+    {
+        uint32_t m_passes{0};
+        uint32_t m_culledPasses{0};
+        uint32_t m_barriers{0};
+        VkDeviceSize m_transientBytes{0};
+        VkDeviceSize m_allocatedBytes{0};
+        VkDeviceSize m_lazyBytes{0};
+    };
+
+    void Reset(DeletionQueue& deletionQueue, uint64_t lastUse);
+
+    Resource ImportImage(const char *name, VkImageAspectFlags aspect,
+                        const State& initialState);
+    Resource CreateImage(const char *name, const ImageDesc& desc);
+    Resource ImportBuffer(const char *name, const State& initialState);
+    Pass AddPass(const char *name, ExecuteFunction execute);
+    void Read(Pass pass, Resource resource, Access access);
+    void Write(Pass pass, Resource resource, Access access);
+    void Export(Resource resource, Access finalAccess);
+
+    void Compile(VkDevice device, const VkAllocationCallbacks *allocator,
+                const AllocateFunction& allocate);
+    void SetImportedImage(Resource resource, VkImage image);
+    void SetImportedBuffer(Resource resource, VkBuffer buffer);
+    void Execute(VkCommandBuffer commandBuffer);
+
+    VkImage GetImage(Resource resource) const;
+    VkImageView GetImageView(Resource resource) const;
+    const Stats& GetStats() const;
+
+private:
+    struct AccessInfo
+    {
+        VkPipelineStageFlags2 m_stages;
+        VkAccessFlags2 m_access;
+        VkImageLayout m_layout;
+        bool m_write;
+    };
+
+    struct ResourceNode
+    {
+        std::string m_name;
+        ImageDesc m_desc;
+        bool m_isBuffer{false};
+        bool m_imported{false};
+        bool m_exported{false};
+        Access m_finalAccess{Access::PRESENT};
+        State m_initialState;
+        VkImage m_image{VK_NULL_HANDLE};
+        VkImageView m_view{VK_NULL_HANDLE};
+        VkBuffer m_buffer{VK_NULL_HANDLE};
+        VkMemoryRequirements m_requirements{};
+        uint32_t m_firstPass{UINT32_MAX};
+        uint32_t m_lastPass{0};
+        uint32_t m_slot{UINT32_MAX};
+    };
+
+    struct PassAccess
+    {
+        Resource m_resource;
+        Access m_access;
+    };
+
+    struct RenderPassNode
+    {
+        std::string m_name;
+        ExecuteFunction m_execute;
+        std::vector<PassAccess> m_accesses;
+        bool m_culled{false};
+        uint32_t m_firstBarrier{0};
+        uint32_t m_barrierCount{0};
+        uint32_t m_firstBufferBarrier{0};
+        uint32_t m_bufferBarrierCount{0};
+    };
+
+    struct MemorySlot
+    {
+        VkDeviceMemory m_memory{VK_NULL_HANDLE};
+        VkDeviceSize m_size{0};
+        uint32_t m_memoryTypeBits{~0u};
+        bool m_lazy{false};
+        std::vector<Resource> m_resources;
+    };
+
+    // synchronization state of one resource while the frame is simulated
+    struct Tracking
+    {
+        VkImageLayout m_layout{VK_IMAGE_LAYOUT_UNDEFINED};
+        VkPipelineStageFlags2 m_writeStages{VK_PIPELINE_STAGE_2_NONE};
+        VkAccessFlags2 m_writeAccess{VK_ACCESS_2_NONE};
+        VkPipelineStageFlags2 m_readStages{VK_PIPELINE_STAGE_2_NONE};
+        VkPipelineStageFlags2 m_visibleStages{VK_PIPELINE_STAGE_2_NONE};
+        VkAccessFlags2 m_visibleAccess{VK_ACCESS_2_NONE};
+    };
+
+    static AccessInfo GetAccessInfo(Access access);
+    static bool Overlaps(const ResourceNode& a, const ResourceNode& b);
+    static bool IsLazy(const ResourceNode& image);
+    void Cull();
+    void ComputeLifetimes();
+    void AllocateTransients(VkDevice device,
+                            const VkAllocationCallbacks *allocator,
+                            const AllocateFunction& allocate);
+    void BuildBarriers();
+    bool Transition(Resource resource, Tracking& tracking,
+                    const AccessInfo& info, bool record);
+
+    std::vector<ResourceNode> m_resources;
+    std::vector<RenderPassNode> m_passes;
+    std::vector<MemorySlot> m_slots;
+    std::vector<VkImageMemoryBarrier2> m_barriers;
+    std::vector<Resource> m_barrierResources;
+    std::vector<VkBufferMemoryBarrier2> m_bufferBarriers;
+    std::vector<Resource> m_bufferBarrierResources;
+    uint32_t m_finalBarrier{0};
+    uint32_t m_finalBufferBarrier{0};
+    Stats m_stats;
+};
+
+inline void RenderGraph::Reset(DeletionQueue& deletionQueue, uint64_t lastUse)
+{
+    for (const auto& image : m_resources)
+    {
+        if (!image.m_imported)
+        {
+            deletionQueue.Retire(image.m_view, lastUse);
+            deletionQueue.Retire(image.m_image, lastUse);
+        }
+    }
+
+    for (const auto& slot : m_slots)
+    {
+        deletionQueue.Retire(slot.m_memory, lastUse);
+    }
+
+    m_resources.clear();
+    m_passes.clear();
+    m_slots.clear();
+    m_barriers.clear();
+    m_barrierResources.clear();
+    m_bufferBarriers.clear();
+    m_bufferBarrierResources.clear();
+    m_finalBarrier = 0;
+    m_finalBufferBarrier = 0;
+    m_stats = Stats{};
+}
+
+inline RenderGraph::Resource RenderGraph::ImportImage(const char *name,
+                    VkImageAspectFlags aspect, const State& initialState)
+{
+    ResourceNode image;
+    image.m_name = name;
+    image.m_desc.m_aspect = aspect;
+    image.m_imported = true;
+    image.m_initialState = initialState;
+    m_resources.push_back(std::move(image));
+
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+inline RenderGraph::Resource RenderGraph::CreateImage(const char *name,
+                                                    const ImageDesc& desc)
+{
+    ResourceNode image;
+    image.m_name = name;
+    image.m_desc = desc;
+    m_resources.push_back(std::move(image));
+
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+inline RenderGraph::Resource RenderGraph::ImportBuffer(const char *name,
+                                                const State& initialState)
+{
+    ResourceNode buffer;
+    buffer.m_name = name;
+    buffer.m_isBuffer = true;
+    buffer.m_imported = true;
+    buffer.m_initialState = initialState;
+    m_resources.push_back(std::move(buffer));
+
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+inline RenderGraph::Pass RenderGraph::AddPass(const char *name,
+                                            ExecuteFunction execute)
+{
+    RenderPassNode pass;
+    pass.m_name = name;
+    pass.m_execute = std::move(execute);
+    m_passes.push_back(std::move(pass));
+
+    return static_cast<Pass>(m_passes.size() - 1);
+}
+
+inline void RenderGraph::Read(Pass pass, Resource resource, Access access)
+{
+    if (GetAccessInfo(access).m_write)
+    {
+        throw std::invalid_argument("render graph read with a write access");
+    }
+
+    m_passes[pass].m_accesses.push_back(PassAccess{resource, access});
+}
+
+inline void RenderGraph::Write(Pass pass, Resource resource, Access access)
+{
+    if (!GetAccessInfo(access).m_write)
+    {
+        throw std::invalid_argument("render graph write with a read access");
+    }
+
+    m_passes[pass].m_accesses.push_back(PassAccess{resource, access});
+}
+
+inline void RenderGraph::Export(Resource resource, Access finalAccess)
+{
+    m_resources[resource].m_exported = true;
+    m_resources[resource].m_finalAccess = finalAccess;
+}
+
+inline void RenderGraph::Compile(VkDevice device,
+                                const VkAllocationCallbacks *allocator,
+                                const AllocateFunction& allocate)
+{
+    Cull();
+    ComputeLifetimes();
+    AllocateTransients(device, allocator, allocate);
+    BuildBarriers();
+}
+
+inline void RenderGraph::SetImportedImage(Resource resource, VkImage image)
+{
+    m_resources[resource].m_image = image;
+}
+
+inline void RenderGraph::SetImportedBuffer(Resource resource, VkBuffer buffer)
+{
+    m_resources[resource].m_buffer = buffer;
+}
+
+inline void RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+    for (std::size_t i = 0; i < m_barriers.size(); ++i)
+    {
+        m_barriers[i].image = m_resources[m_barrierResources[i]].m_image;
+    }
+
+    for (std::size_t i = 0; i < m_bufferBarriers.size(); ++i)
+    {
+        m_bufferBarriers[i].buffer = 
+                        m_resources[m_bufferBarrierResources[i]].m_buffer;
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+
+    for (const auto& pass : m_passes)
+    {
+        if (pass.m_culled)
+        {
+            continue;
+        }
+
+        if ((0 != pass.m_barrierCount) || (0 != pass.m_bufferBarrierCount))
+        {
+            dependencyInfo.imageMemoryBarrierCount = pass.m_barrierCount;
+            dependencyInfo.pImageMemoryBarriers =
+                                    m_barriers.data() + pass.m_firstBarrier;
+            dependencyInfo.bufferMemoryBarrierCount = pass.m_bufferBarrierCount;
+            dependencyInfo.pBufferMemoryBarriers = 
+                            m_bufferBarriers.data() + pass.m_firstBufferBarrier;
+            vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        }
+
+        pass.m_execute(commandBuffer);
+    }
+
+    uint32_t finalCount = static_cast<uint32_t>(m_barriers.size()) -
+                                                    m_finalBarrier;
+    uint32_t finalBufferCount = static_cast<uint32_t>(m_bufferBarriers.size()) -
+                                                    m_finalBufferBarrier;
+    if ((0 != finalCount) || (0 != finalBufferCount))
+    {
+        dependencyInfo.imageMemoryBarrierCount = finalCount;
+        dependencyInfo.pImageMemoryBarriers = m_barriers.data() + m_finalBarrier;
+        dependencyInfo.bufferMemoryBarrierCount = finalBufferCount;
+        dependencyInfo.pBufferMemoryBarriers = 
+                            m_bufferBarriers.data() + m_finalBufferBarrier;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+}
+
+inline VkImage RenderGraph::GetImage(Resource resource) const
+{
+    return m_resources[resource].m_image;
+}
+
+inline VkImageView RenderGraph::GetImageView(Resource resource) const
+{
+    return m_resources[resource].m_view;
+}
+
+inline const RenderGraph::Stats& RenderGraph::GetStats() const
+{
+    return m_stats;
+}
+
+inline RenderGraph::AccessInfo RenderGraph::GetAccessInfo(Access access)
+{
+    switch (access)
+    {
+    case Access::COLOR_ATTACHMENT:
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+    case Access::DEPTH_ATTACHMENT:
+        return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+    case Access::SAMPLED:
+        return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+    case Access::STORAGE_READ:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, false};
+    case Access::STORAGE_WRITE:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, true};
+    case Access::TRANSFER_SRC:
+        return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+                VK_ACCESS_2_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+    case Access::TRANSFER_DST:
+        return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+                VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+    case Access::PRESENT:
+        return {VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false};
+    case Access::INDIRECT_READ:
+        return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false};
+    case Access::VERTEX_STORAGE_READ:
+        return {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false};
+    case Access::HOST_READ:
+        return {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false};
+    }
+
+    throw std::invalid_argument("unknown render graph access");
+}
+
+inline bool RenderGraph::Overlaps(const ResourceNode& a,
+                                    const ResourceNode& b)
+{
+    return ((a.m_firstPass <= b.m_lastPass) && (b.m_firstPass <= a.m_lastPass));
+}
+
+inline bool RenderGraph::IsLazy(const ResourceNode& image)
+{
+    return (0 != (image.m_desc.m_usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT));
+}
+
+// a pass survives if it writes something that an exported image depends on
+inline void RenderGraph::Cull()
+{
+    std::vector<bool> needed(m_resources.size(), false);
+    for (std::size_t i = 0; i < m_resources.size(); ++i)
+    {
+        needed[i] = m_resources[i].m_exported;
+    }
+
+    for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass)
+    {
+        pass->m_culled = true;
+        for (const auto& access : pass->m_accesses)
+        {
+            if (GetAccessInfo(access.m_access).m_write &&
+                needed[access.m_resource])
+            {
+                pass->m_culled = false;
+            }
+        }
+
+        if (!pass->m_culled)
+        {
+            for (const auto& access : pass->m_accesses)
+            {
+                needed[access.m_resource] = true;
+            }
+        }
+    }
+
+    m_stats.m_passes = 0;
+    m_stats.m_culledPasses = 0;
+    for (const auto& pass : m_passes)
+    {
+        ++(pass.m_culled ? m_stats.m_culledPasses : m_stats.m_passes);
+    }
+}
+
+inline void RenderGraph::ComputeLifetimes()
+{
+    for (uint32_t i = 0; i < m_passes.size(); ++i)
+    {
+        if (m_passes[i].m_culled)
+        {
+            continue;
+        }
+
+        for (const auto& access : m_passes[i].m_accesses)
+        {
+            ResourceNode& image = m_resources[access.m_resource];
+            image.m_firstPass = std::min(image.m_firstPass, i);
+            image.m_lastPass = std::max(image.m_lastPass, i);
+        }
+    }
+}
+
+// greedy first fit of the largest transients into shared memory slots
+inline void RenderGraph::AllocateTransients(VkDevice device,
+                                    const VkAllocationCallbacks *allocator,
+                                    const AllocateFunction& allocate)
+{
+    std::vector<Resource> transients;
+
+    for (Resource i = 0; i < m_resources.size(); ++i)
+    {
+        ResourceNode& image = m_resources[i];
+        if (image.m_imported || (UINT32_MAX == image.m_firstPass))
+        {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {image.m_desc.m_extent.width,
+                            image.m_desc.m_extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = image.m_desc.m_format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = image.m_desc.m_usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = image.m_desc.m_samples;
+
+        if (VK_SUCCESS != vkCreateImage(device, &imageInfo, allocator,
+                                        &image.m_image))
+        {
+            throw std::runtime_error("failed to create transient image");
+        }
+
+        vkGetImageMemoryRequirements(device, image.m_image,
+                                    &image.m_requirements);
+        m_stats.m_transientBytes += image.m_requirements.size;
+        transients.push_back(i);
+    }
+
+    std::sort(transients.begin(), transients.end(),
+    [this](Resource a, Resource b)
+    {
+        return (m_resources[a].m_requirements.size >
+                m_resources[b].m_requirements.size);
+    });
+
+    for (Resource resource : transients)
+    {
+        ResourceNode& image = m_resources[resource];
+        const VkMemoryRequirements& requirements = image.m_requirements;
+        bool lazy = IsLazy(image);
+
+        // lazily allocated memory has nothing to save by sharing
+        for (uint32_t i = 0; !lazy && (i < m_slots.size()) &&
+                                (UINT32_MAX == image.m_slot); ++i)
+        {
+            MemorySlot& slot = m_slots[i];
+            bool fits = !slot.m_lazy && (0 != (slot.m_memoryTypeBits &
+                                                requirements.memoryTypeBits));
+
+            for (Resource other : slot.m_resources)
+            {
+                fits = fits && !Overlaps(image, m_resources[other]);
+            }
+
+            if (fits)
+            {
+                image.m_slot = i;
+            }
+        }
+
+        if (UINT32_MAX == image.m_slot)
+        {
+            image.m_slot = static_cast<uint32_t>(m_slots.size());
+            m_slots.emplace_back();
+            m_slots.back().m_lazy = lazy;
+        }
+
+        // images are bound at offset 0, so the slot only grows in size
+        MemorySlot& slot = m_slots[image.m_slot];
+        slot.m_size = std::max(slot.m_size, requirements.size);
+        slot.m_memoryTypeBits &= requirements.memoryTypeBits;
+        slot.m_resources.push_back(resource);
+    }
+
+    for (auto& slot : m_slots)
+    {
+        VkMemoryRequirements requirements{};
+        requirements.size = slot.m_size;
+        requirements.alignment = 1;
+        requirements.memoryTypeBits = slot.m_memoryTypeBits;
+        slot.m_memory = allocate(requirements, slot.m_lazy);
+        (slot.m_lazy ? m_stats.m_lazyBytes : m_stats.m_allocatedBytes) += 
+                                                                slot.m_size;
+
+        for (Resource resource : slot.m_resources)
+        {
+            ResourceNode& image = m_resources[resource];
+            vkBindImageMemory(device, image.m_image, slot.m_memory, 0);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = image.m_image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = image.m_desc.m_format;
+            viewInfo.subresourceRange.aspectMask = image.m_desc.m_aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (VK_SUCCESS != vkCreateImageView(device, &viewInfo,
+                                                allocator, &image.m_view))
+            {
+                throw std::runtime_error("failed to create transient image view");
+            }
+        }
+    }
+}
+
+// Returns true if a barrier is needed for the access and updates the tracked
+// state. Writes and layout changes wait for every earlier access, reads only
+// wait for a write that has not been made visible to them yet.
+inline bool RenderGraph::Transition(Resource resource, Tracking& tracking,
+                                    const AccessInfo& info, bool record)
+{
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = tracking.m_layout;
+    barrier.newLayout = info.m_layout;
+    barrier.dstStageMask = info.m_stages;
+    barrier.dstAccessMask = info.m_access;
+    barrier.subresourceRange.aspectMask = m_resources[resource].m_desc.m_aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    bool isBuffer = m_resources[resource].m_isBuffer;
+    bool needed = false;
+    bool layoutChange = !isBuffer && (tracking.m_layout != info.m_layout);
+
+    if (info.m_write || layoutChange)
+    {
+        barrier.srcStageMask = tracking.m_writeStages | tracking.m_readStages;
+        barrier.srcAccessMask = tracking.m_writeAccess;
+        needed = layoutChange || (VK_PIPELINE_STAGE_2_NONE !=
+                                    barrier.srcStageMask);
+
+        tracking.m_layout = isBuffer ? tracking.m_layout : info.m_layout;
+        tracking.m_writeStages = info.m_stages;
+        tracking.m_writeAccess = info.m_write ? info.m_access : VK_ACCESS_2_NONE;
+        tracking.m_readStages = info.m_write ? VK_PIPELINE_STAGE_2_NONE :
+                                                info.m_stages;
+        tracking.m_visibleStages = info.m_write ? VK_PIPELINE_STAGE_2_NONE :
+                                                info.m_stages;
+        tracking.m_visibleAccess = info.m_write ? VK_ACCESS_2_NONE :
+                                                info.m_access;
+    }
+    else
+    {
+        bool visible =
+            ((info.m_stages & tracking.m_visibleStages) == info.m_stages) &&
+            ((info.m_access & tracking.m_visibleAccess) == info.m_access);
+        needed = (VK_PIPELINE_STAGE_2_NONE != tracking.m_writeStages) &&
+                 !visible;
+
+        barrier.srcStageMask = tracking.m_writeStages;
+        barrier.srcAccessMask = tracking.m_writeAccess;
+
+        tracking.m_readStages |= info.m_stages;
+        if (needed)
+        {
+            tracking.m_visibleStages |= info.m_stages;
+            tracking.m_visibleAccess |= info.m_access;
+        }
+    }
+
+    if (needed && record)
+    {
+        if (VK_PIPELINE_STAGE_2_NONE == barrier.srcStageMask)
+        {
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+        }
+
+        if (isBuffer)
+        {
+            VkBufferMemoryBarrier2 bufferBarrier{};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            bufferBarrier.srcStageMask = barrier.srcStageMask;
+            bufferBarrier.srcAccessMask = barrier.srcAccessMask;
+            bufferBarrier.dstStageMask = barrier.dstStageMask;
+            bufferBarrier.dstAccessMask = barrier.dstAccessMask;
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.offset = 0;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+            m_bufferBarriers.push_back(bufferBarrier);
+            m_bufferBarrierResources.push_back(resource);
+        }
+        else
+        {
+            m_barriers.push_back(barrier);
+            m_barrierResources.push_back(resource);
+        }
+    }
+
+    return needed;
+}
+
+// Simulates the frame twice. The first run yields the state every transient
+// is left in, which becomes the starting point of whichever image uses the
+// same memory next (in this frame or, for the first user, the next frame).
+inline void RenderGraph::BuildBarriers()
+{
+    std::vector<Tracking> tracking(m_resources.size());
+
+    for (int run = 0; run < 2; ++run)
+    {
+        bool record = (1 == run);
+
+        for (Resource i = 0; i < m_resources.size(); ++i)
+        {
+            const ResourceNode& image = m_resources[i];
+            tracking[i] = Tracking{};
+
+            if (image.m_imported)
+            {
+                tracking[i].m_layout = image.m_initialState.m_layout;
+                tracking[i].m_writeStages = image.m_initialState.m_stages;
+                tracking[i].m_writeAccess = image.m_initialState.m_access;
+            }
+            else if (record)
+            {
+                tracking[i].m_writeStages = image.m_initialState.m_stages;
+                tracking[i].m_writeAccess = image.m_initialState.m_access;
+            }
+        }
+
+        for (auto& pass : m_passes)
+        {
+            pass.m_firstBarrier = static_cast<uint32_t>(m_barriers.size());
+            pass.m_firstBufferBarrier = 
+                                static_cast<uint32_t>(m_bufferBarriers.size());
+            if (!pass.m_culled)
+            {
+                for (const auto& access : pass.m_accesses)
+                {
+                    Transition(access.m_resource, tracking[access.m_resource],
+                                GetAccessInfo(access.m_access), record);
+                }
+            }
+            pass.m_barrierCount = static_cast<uint32_t>(m_barriers.size()) -
+                                    pass.m_firstBarrier;
+            pass.m_bufferBarrierCount = 
+                            static_cast<uint32_t>(m_bufferBarriers.size()) -
+                            pass.m_firstBufferBarrier;
+        }
+
+        m_finalBarrier = static_cast<uint32_t>(m_barriers.size());
+        m_finalBufferBarrier = static_cast<uint32_t>(m_bufferBarriers.size());
+        for (Resource i = 0; i < m_resources.size(); ++i)
+        {
+            if (m_resources[i].m_exported)
+            {
+                Transition(i, tracking[i],
+                            GetAccessInfo(m_resources[i].m_finalAccess), record);
+            }
+        }
+
+        if (record)
+        {
+            break;
+        }
+
+        // hand each transient's end state to the next user of its memory
+        for (auto& slot : m_slots)
+        {
+            std::sort(slot.m_resources.begin(), slot.m_resources.end(),
+            [this](Resource a, Resource b)
+            {
+                return (m_resources[a].m_firstPass < m_resources[b].m_firstPass);
+            });
+
+            for (std::size_t i = 0; i < slot.m_resources.size(); ++i)
+            {
+                Resource previous = slot.m_resources[
+                        (i + slot.m_resources.size() - 1) %
+                        slot.m_resources.size()];
+                State& state = m_resources[slot.m_resources[i]].m_initialState;
+                state.m_stages = tracking[previous].m_writeStages |
+                                 tracking[previous].m_readStages;
+                state.m_access = tracking[previous].m_writeAccess;
+            }
+        }
+    }
+
+    m_stats.m_barriers = static_cast<uint32_t>(m_barriers.size() + 
+                                                m_bufferBarriers.size());
+}
+
+#endif // RENDER_GRAPH_HPP
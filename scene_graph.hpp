@@ -0,0 +1,509 @@
+#ifndef SCENE_GRAPH_HPP
+#define SCENE_GRAPH_HPP
+
+#include <glm/glm.hpp> // linear algebra
+#include <glm/gtc/quaternion.hpp> // glm::quat, glm::mat4_cast
+
+#include <vector> // std::vector
+#include <algorithm> // std::sort, std::reverse, std::fill
+#include <limits> // std::numeric_limits
+#include <stdexcept> // std::runtime_error
+#include <cstdint> // uint8_t, uint32_t
+
+#include "profiler.hpp" // PROFILE_ZONE
+#include "worker_pool.hpp" // WorkerPool
+
+// A transform hierarchy kept in flat arrays sorted depth first, so a parent
+// always comes before its children and every subtree is one contiguous range
+// starting at its root. Nodes are addressed by stable ids, adding nodes only
+// appends and the arrays are sorted again by the next Update().
+// Setting a local transform or bounds marks the node dirty. Update() skips
+// dirty nodes inside an already dirty subtree and recomputes world matrices
+// and world bounds of the remaining subtrees only, a scene that did not
+// change costs nothing but the call. Large subtrees are split into their
+// child subtrees, which are independent and spread over the workers.
+class SceneGraph
+{
+public:
+    using NodeId = uint32_t;
+
+    static constexpr NodeId NO_PARENT = std::numeric_limits<NodeId>::max();
+
+    // empty when m_min is larger than m_max, e.g. for nodes that only group
+    struct Bounds
+    {
+        glm::vec3 m_min{std::numeric_limits<float>::max()};
+        glm::vec3 m_max{std::numeric_limits<float>::lowest()};
+    };
+
+    ~SceneGraph();
+
+    void Create(uint32_t workerCount);
+    void Destroy();
+
+    NodeId Add(NodeId parent, const glm::vec3& position,
+                const glm::quat& rotation, const glm::vec3& scale,
+                const Bounds& bounds);
+    void Clear();
+    void Reserve(uint32_t capacity);
+
+    void SetPosition(NodeId node, const glm::vec3& position);
+    void SetRotation(NodeId node, const glm::quat& rotation);
+    void SetScale(NodeId node, const glm::vec3& scale);
+    void SetLocalBounds(NodeId node, const Bounds& bounds);
+
+    void Update();
+
+    const glm::vec3& GetPosition(NodeId node) const;
+    const glm::quat& GetRotation(NodeId node) const;
+    const glm::vec3& GetScale(NodeId node) const;
+    const glm::mat4& GetWorld(NodeId node) const;
+    const Bounds& GetWorldBounds(NodeId node) const;
+    uint32_t GetNodeCount() const;
+    uint32_t GetWorkerCount() const;
+    // nodes recomputed by the last Update()
+    uint32_t GetUpdatedCount() const;
+
+private:
+    // subtrees above this size are split into their children
+    static constexpr uint32_t SPLIT_SIZE = 1024;
+    // fewer dirty nodes than this are updated on the calling thread
+    static constexpr uint32_t PARALLEL_MIN = 4096;
+
+    struct Range
+    {
+        uint32_t m_begin;
+        uint32_t m_end;
+    };
+
+    void MarkDirty(uint32_t index);
+    void Sort();
+    void CollectRanges();
+    void RunRanges(uint32_t worker, uint32_t threadCount);
+    void UpdateRange(const Range& range);
+    void UpdateNode(uint32_t index);
+    static Bounds TransformBounds(const glm::mat4& world, const Bounds& bounds);
+
+    // in depth first order, m_parent holds sorted indices as well
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_subtreeSize;
+    std::vector<glm::vec3> m_position;
+    std::vector<glm::quat> m_rotation;
+    std::vector<glm::vec3> m_scale;
+    std::vector<Bounds> m_localBounds;
+    std::vector<glm::mat4> m_world;
+    std::vector<Bounds> m_worldBounds;
+    std::vector<uint8_t> m_dirty;
+    std::vector<NodeId> m_node;
+
+    std::vector<uint32_t> m_index; // node id to sorted index
+    std::vector<uint32_t> m_dirtyNodes;
+    std::vector<Range> m_ranges;
+    std::vector<Range> m_splitStack;
+    bool m_sorted{true};
+    uint32_t m_updatedCount{0};
+
+    WorkerPool m_pool;
+};
+
+inline SceneGraph::~SceneGraph()
+{
+    Destroy();
+}
+
+// zero workers updates on the calling thread inside Update()
+inline void SceneGraph::Create(uint32_t workerCount)
+{
+    m_pool.Create(workerCount, "scene worker");
+}
+
+inline void SceneGraph::Destroy()
+{
+    m_pool.Destroy();
+}
+
+// The parent must already exist, so appending keeps parents before children
+// even before the subtrees are made contiguous again. Building depth first
+// appends at the end of the parent's subtree and needs no sort.
+inline SceneGraph::NodeId SceneGraph::Add(NodeId parent,
+                        const glm::vec3& position, const glm::quat& rotation,
+                        const glm::vec3& scale, const Bounds& bounds)
+{
+    if ((NO_PARENT != parent) && (parent >= m_index.size()))
+    {
+        throw std::runtime_error("scene node parent does not exist");
+    }
+
+    NodeId node = static_cast<NodeId>(m_index.size());
+    uint32_t index = static_cast<uint32_t>(m_node.size());
+    m_index.push_back(index);
+
+    m_parent.push_back((NO_PARENT == parent) ? NO_PARENT : m_index[parent]);
+    m_subtreeSize.push_back(1);
+    m_position.push_back(position);
+    m_rotation.push_back(rotation);
+    m_scale.push_back(scale);
+    m_localBounds.push_back(bounds);
+    m_world.emplace_back(1.0f);
+    m_worldBounds.emplace_back();
+    m_dirty.push_back(0);
+    m_node.push_back(node);
+
+    MarkDirty(index);
+
+    uint32_t parentIndex = m_parent[index];
+    if (NO_PARENT == parentIndex)
+    {
+        return node;
+    }
+
+    if (m_sorted && (index == parentIndex + m_subtreeSize[parentIndex]))
+    {
+        for (uint32_t i = parentIndex; NO_PARENT != i; i = m_parent[i])
+        {
+            ++m_subtreeSize[i];
+        }
+    }
+    else
+    {
+        m_sorted = false;
+    }
+
+    return node;
+}
+
+inline void SceneGraph::Clear()
+{
+    m_parent.clear();
+    m_subtreeSize.clear();
+    m_position.clear();
+    m_rotation.clear();
+    m_scale.clear();
+    m_localBounds.clear();
+    m_world.clear();
+    m_worldBounds.clear();
+    m_dirty.clear();
+    m_node.clear();
+    m_index.clear();
+    m_dirtyNodes.clear();
+    m_sorted = true;
+    m_updatedCount = 0;
+}
+
+inline void SceneGraph::Reserve(uint32_t capacity)
+{
+    m_parent.reserve(capacity);
+    m_subtreeSize.reserve(capacity);
+    m_position.reserve(capacity);
+    m_rotation.reserve(capacity);
+    m_scale.reserve(capacity);
+    m_localBounds.reserve(capacity);
+    m_world.reserve(capacity);
+    m_worldBounds.reserve(capacity);
+    m_dirty.reserve(capacity);
+    m_node.reserve(capacity);
+    m_index.reserve(capacity);
+    m_dirtyNodes.reserve(capacity);
+}
+
+inline void SceneGraph::SetPosition(NodeId node, const glm::vec3& position)
+{
+    uint32_t index = m_index[node];
+    m_position[index] = position;
+    MarkDirty(index);
+}
+
+inline void SceneGraph::SetRotation(NodeId node, const glm::quat& rotation)
+{
+    uint32_t index = m_index[node];
+    m_rotation[index] = rotation;
+    MarkDirty(index);
+}
+
+inline void SceneGraph::SetScale(NodeId node, const glm::vec3& scale)
+{
+    uint32_t index = m_index[node];
+    m_scale[index] = scale;
+    MarkDirty(index);
+}
+
+inline void SceneGraph::SetLocalBounds(NodeId node, const Bounds& bounds)
+{
+    uint32_t index = m_index[node];
+    m_localBounds[index] = bounds;
+    MarkDirty(index);
+}
+
+inline void SceneGraph::Update()
+{
+    PROFILE_ZONE("scene update");
+    m_updatedCount = 0;
+
+    if (!m_sorted)
+    {
+        Sort();
+    }
+    if (m_dirtyNodes.empty())
+    {
+        return;
+    }
+
+    CollectRanges();
+
+    uint32_t workerCount = m_pool.GetWorkerCount();
+    if ((0 == workerCount) || (m_updatedCount < PARALLEL_MIN))
+    {
+        RunRanges(0, 1);
+        return;
+    }
+
+    m_pool.Dispatch([this, workerCount](uint32_t worker)
+    {
+        RunRanges(worker, workerCount + 1);
+    });
+}
+
+inline const glm::vec3& SceneGraph::GetPosition(NodeId node) const
+{
+    return m_position[m_index[node]];
+}
+
+inline const glm::quat& SceneGraph::GetRotation(NodeId node) const
+{
+    return m_rotation[m_index[node]];
+}
+
+inline const glm::vec3& SceneGraph::GetScale(NodeId node) const
+{
+    return m_scale[m_index[node]];
+}
+
+inline const glm::mat4& SceneGraph::GetWorld(NodeId node) const
+{
+    return m_world[m_index[node]];
+}
+
+inline const SceneGraph::Bounds& SceneGraph::GetWorldBounds(NodeId node) const
+{
+    return m_worldBounds[m_index[node]];
+}
+
+inline uint32_t SceneGraph::GetNodeCount() const
+{
+    return static_cast<uint32_t>(m_node.size());
+}
+
+inline uint32_t SceneGraph::GetWorkerCount() const
+{
+    return m_pool.GetWorkerCount();
+}
+
+inline uint32_t SceneGraph::GetUpdatedCount() const
+{
+    return m_updatedCount;
+}
+
+inline void SceneGraph::MarkDirty(uint32_t index)
+{
+    if (0 == m_dirty[index])
+    {
+        m_dirty[index] = 1;
+        m_dirtyNodes.push_back(index);
+    }
+}
+
+// Rebuilds the depth first order after nodes were appended. Children keep the
+// order they were added in. Only structural changes pay for this, the dirty
+// list is rebuilt from the flags since its indices moved.
+inline void SceneGraph::Sort()
+{
+    PROFILE_ZONE("scene sort");
+    uint32_t count = static_cast<uint32_t>(m_node.size());
+
+    std::vector<uint32_t> firstChild(count, NO_PARENT);
+    std::vector<uint32_t> nextSibling(count, NO_PARENT);
+    std::vector<uint32_t> roots;
+    for (uint32_t i = count; i-- > 0;)
+    {
+        if (NO_PARENT == m_parent[i])
+        {
+            roots.push_back(i);
+        }
+        else
+        {
+            nextSibling[i] = firstChild[m_parent[i]];
+            firstChild[m_parent[i]] = i;
+        }
+    }
+
+    // old index of every new position, roots are pushed last to first so the
+    // stack pops them in order
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    std::vector<uint32_t> stack(roots);
+    while (!stack.empty())
+    {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        order.push_back(index);
+
+        std::size_t children = stack.size();
+        for (uint32_t child = firstChild[index]; NO_PARENT != child;
+            child = nextSibling[child])
+        {
+            stack.push_back(child);
+        }
+        std::reverse(stack.begin() + children, stack.end());
+    }
+
+    std::vector<uint32_t> newIndex(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        newIndex[order[i]] = i;
+    }
+
+    auto permute = [&order](auto& values)
+    {
+        auto old = values;
+        for (std::size_t i = 0; i < order.size(); ++i)
+        {
+            values[i] = old[order[i]];
+        }
+    };
+    permute(m_parent);
+    permute(m_position);
+    permute(m_rotation);
+    permute(m_scale);
+    permute(m_localBounds);
+    permute(m_world);
+    permute(m_worldBounds);
+    permute(m_dirty);
+    permute(m_node);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (NO_PARENT != m_parent[i])
+        {
+            m_parent[i] = newIndex[m_parent[i]];
+        }
+        m_index[m_node[i]] = i;
+    }
+
+    // children come after their parent, so walking backwards sums subtrees
+    std::fill(m_subtreeSize.begin(), m_subtreeSize.end(), 1);
+    for (uint32_t i = count; i-- > 0;)
+    {
+        if (NO_PARENT != m_parent[i])
+        {
+            m_subtreeSize[m_parent[i]] += m_subtreeSize[i];
+        }
+    }
+
+    m_dirtyNodes.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (0 != m_dirty[i])
+        {
+            m_dirtyNodes.push_back(i);
+        }
+    }
+    m_sorted = true;
+}
+
+// Turns the dirty nodes into disjoint subtree ranges. A dirty node inside the
+// range of an earlier one is covered by it. Ranges larger than SPLIT_SIZE
+// update their root here and hand on their child subtrees instead.
+inline void SceneGraph::CollectRanges()
+{
+    std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+
+    m_ranges.clear();
+    uint32_t coveredEnd = 0;
+    for (uint32_t index : m_dirtyNodes)
+    {
+        m_dirty[index] = 0;
+        if (index < coveredEnd)
+        {
+            continue;
+        }
+
+        coveredEnd = index + m_subtreeSize[index];
+        m_splitStack.push_back({index, coveredEnd});
+        while (!m_splitStack.empty())
+        {
+            Range range = m_splitStack.back();
+            m_splitStack.pop_back();
+
+            if (range.m_end - range.m_begin <= SPLIT_SIZE)
+            {
+                m_ranges.push_back(range);
+                continue;
+            }
+
+            UpdateNode(range.m_begin);
+            for (uint32_t child = range.m_begin + 1; child < range.m_end;
+                child += m_subtreeSize[child])
+            {
+                m_splitStack.push_back({child, child + m_subtreeSize[child]});
+            }
+        }
+        m_updatedCount += m_subtreeSize[index];
+    }
+    m_dirtyNodes.clear();
+}
+
+// no range is larger than SPLIT_SIZE, so handing them out in turn keeps the
+// threads about even
+inline void SceneGraph::RunRanges(uint32_t worker, uint32_t threadCount)
+{
+    for (std::size_t i = worker; i < m_ranges.size(); i += threadCount)
+    {
+        UpdateRange(m_ranges[i]);
+    }
+}
+
+// the parent of the first node is outside the range and already up to date
+inline void SceneGraph::UpdateRange(const Range& range)
+{
+    for (uint32_t i = range.m_begin; i < range.m_end; ++i)
+    {
+        UpdateNode(i);
+    }
+}
+
+inline void SceneGraph::UpdateNode(uint32_t index)
+{
+    glm::mat4 local = glm::mat4_cast(m_rotation[index]);
+    local[0] *= m_scale[index].x;
+    local[1] *= m_scale[index].y;
+    local[2] *= m_scale[index].z;
+    local[3] = glm::vec4(m_position[index], 1.0f);
+
+    uint32_t parent = m_parent[index];
+    m_world[index] = (NO_PARENT == parent) ? local : m_world[parent] * local;
+    m_worldBounds[index] = TransformBounds(m_world[index],
+                                            m_localBounds[index]);
+}
+
+// the box around the transformed box, from its center and the absolute
+// values of the matrix applied to its extent
+inline SceneGraph::Bounds SceneGraph::TransformBounds(const glm::mat4& world,
+                                                    const Bounds& bounds)
+{
+    if (bounds.m_min.x > bounds.m_max.x)
+    {
+        return bounds;
+    }
+
+    glm::vec3 center = (bounds.m_min + bounds.m_max) * 0.5f;
+    glm::vec3 extent = (bounds.m_max - bounds.m_min) * 0.5f;
+
+    glm::vec3 worldCenter(world * glm::vec4(center, 1.0f));
+    glm::vec3 worldExtent = glm::abs(glm::vec3(world[0])) * extent.x +
+                            glm::abs(glm::vec3(world[1])) * extent.y +
+                            glm::abs(glm::vec3(world[2])) * extent.z;
+
+    return {worldCenter - worldExtent, worldCenter + worldExtent};
+}
+
+#endif // SCENE_GRAPH_HPP
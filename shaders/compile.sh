@@ -1,2 +1,9 @@
 /usr/local/bin/glslc shader.vert -o vert.spv
-/usr/local/bin/glslc shader.frag -o frag.spv
\ No newline at end of file
+/usr/local/bin/glslc shader.frag -o frag.spv
+/usr/local/bin/glslc upscale.vert -o upscale_vert.spv
+/usr/local/bin/glslc upscale.frag -o upscale_frag.spv
+/usr/local/bin/glslc prepass.vert -o prepass_vert.spv
+/usr/local/bin/glslc cull.comp -o cull_comp.spv
+/usr/local/bin/glslc -DFORMAT=rgba8 downsample.comp -o downsample_rgba8_comp.spv
+/usr/local/bin/glslc -DFORMAT=rgba16f downsample.comp -o downsample_rgba16f_comp.spv
+/usr/local/bin/glslc -DFORMAT=r32f downsample.comp -o downsample_r32f_comp.spv
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 450
+
+// TransformSystem::Instance, composed on the CPU
+layout(set = 0, binding = 0) uniform Instance 
+{
+    mat4 world;
+    mat4 modelViewProj;
+} instance;
+
+layout(location = 0) in vec3 inPosition;
+
+// must match shader.vert bit for bit for the equal depth test
+invariant gl_Position;
+
+void main() 
+{
+    gl_Position = instance.modelViewProj * vec4(inPosition, 1.0);
+}
@@ -1,13 +1,32 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
 
-layout(binding = 1) uniform sampler2D texSampler;
+struct Material
+{
+    vec4 baseColor;
+    uint albedoTexture;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Materials
+{
+    Material materials[];
+};
+
+layout(set = 1, binding = 1) uniform sampler2D textures[];
 
 layout(location = 0) out vec4 outColor;
 
 void main() 
 {
-    outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
-}
\ No newline at end of file
+    Material material = materials[fragMaterial];
+    vec4 albedo = texture(textures[nonuniformEXT(material.albedoTexture)], 
+                            fragTexCoord);
+    outColor = vec4(fragColor * albedo.rgb * material.baseColor.rgb, 1.0);
+}
@@ -1,11 +1,21 @@
 #version 450
 
-layout(set = 0, binding = 0) uniform UniformBufferObject 
+// TransformSystem::Instance, composed on the CPU
+layout(set = 0, binding = 0) uniform Instance 
 {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+    mat4 world;
+    mat4 modelViewProj;
+} instance;
+
+struct DrawData
+{
+    uint materialIndex;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Draws
+{
+    DrawData draws[];
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -13,10 +23,15 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
+
+// the depth prepass computes the same position in prepass.vert
+invariant gl_Position;
 
 void main() 
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = instance.modelViewProj * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragMaterial = draws[gl_InstanceIndex].materialIndex;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 450
+
+layout(location = 0) in vec2 fragUV;
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform Upscale
+{
+    vec2 uvScale;   // rendered area / target size
+    vec2 uvMax;     // last texel center inside the rendered area
+    vec2 texelSize;
+    float sharpness;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+void main() 
+{
+    vec2 uv = min(fragUV * pc.uvScale, pc.uvMax);
+    vec3 center = texture(sceneColor, uv).rgb;
+    vec3 north = texture(sceneColor, min(uv - vec2(0.0, pc.texelSize.y), pc.uvMax)).rgb;
+    vec3 south = texture(sceneColor, min(uv + vec2(0.0, pc.texelSize.y), pc.uvMax)).rgb;
+    vec3 west = texture(sceneColor, min(uv - vec2(pc.texelSize.x, 0.0), pc.uvMax)).rgb;
+    vec3 east = texture(sceneColor, min(uv + vec2(pc.texelSize.x, 0.0), pc.uvMax)).rgb;
+
+    // unsharp mask, limited to the local range so edges do not ring
+    vec3 minColor = min(center, min(min(north, south), min(west, east)));
+    vec3 maxColor = max(center, max(max(north, south), max(west, east)));
+    vec3 sharpened = center + pc.sharpness * (4.0 * center - north - south - west - east);
+
+    outColor = vec4(clamp(sharpened, minColor, maxColor), 1.0);
+}
@@ -0,0 +1,316 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <vector> // std::vector
+#include <deque> // std::deque
+#include <functional> // std::function
+#include <thread> // std::thread
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <exception> // std::exception_ptr
+#include <ostream> // std::ostream
+#include <iomanip> // std::setw
+#include <chrono> // std::chrono::steady_clock
+#include <cstdint> // uint32_t, uint64_t
+
+#include "profiler.hpp" // PROFILE_THREAD
+
+// Runs a one-shot dependency graph of tasks. MAIN tasks run on the thread
+// that calls Run(), in the order they were added as they become ready, so
+// everything that touches the window or creates Vulkan objects stays on one
+// thread. WORKER tasks run on a pool started for the run. A task can only
+// depend on tasks added before it, so the graph has no cycles. The first
+// exception thrown by a task stops scheduling and is rethrown by Run() once
+// the running tasks have finished.
+class TaskGraph
+{
+public:
+    enum class Affinity
+    {
+        MAIN,
+        WORKER
+    };
+
+    using TaskId = uint32_t;
+
+    TaskId Add(const char *name, Affinity affinity, std::function<void()> task,
+                const std::vector<TaskId>& dependencies = {});
+    void Run(uint32_t workerCount);
+
+    void Report(std::ostream& os) const;
+    double GetElapsedMs() const;
+    double GetCriticalPathMs() const;
+
+private:
+    struct Task
+    {
+        const char *m_name;
+        Affinity m_affinity;
+        std::function<void()> m_function;
+        std::vector<TaskId> m_dependencies;
+        std::vector<TaskId> m_dependents;
+        uint32_t m_pending;
+        uint64_t m_begin;
+        uint64_t m_end;
+    };
+
+    static uint64_t Now();
+
+    void WorkerLoop();
+    void Execute(TaskId id);
+    std::vector<TaskId> GetCriticalPath() const;
+
+    std::vector<Task> m_tasks;
+    std::deque<TaskId> m_mainReady;
+    std::deque<TaskId> m_workerReady;
+    std::mutex m_mutex;
+    std::condition_variable m_mainCondition;
+    std::condition_variable m_workerCondition;
+    uint32_t m_remaining{0};
+    uint32_t m_running{0};
+    bool m_stop{false};
+    std::exception_ptr m_error;
+    uint64_t m_start{0};
+    uint64_t m_end{0};
+};
+
+inline TaskGraph::TaskId TaskGraph::Add(const char *name, Affinity affinity,
+                                    std::function<void()> task,
+                                    const std::vector<TaskId>& dependencies)
+{
+    TaskId id = static_cast<TaskId>(m_tasks.size());
+    m_tasks.push_back({name, affinity, std::move(task), dependencies, {},
+                        static_cast<uint32_t>(dependencies.size()), 0, 0});
+
+    for (TaskId dependency : dependencies)
+    {
+        m_tasks[dependency].m_dependents.push_back(id);
+    }
+
+    return id;
+}
+
+// without workers the calling thread runs the WORKER tasks as well
+inline void TaskGraph::Run(uint32_t workerCount)
+{
+    m_start = Now();
+    m_remaining = static_cast<uint32_t>(m_tasks.size());
+    for (TaskId id = 0; id < m_tasks.size(); ++id)
+    {
+        if (0 == m_tasks[id].m_pending)
+        {
+            ((Affinity::MAIN == m_tasks[id].m_affinity) ? m_mainReady :
+                                                m_workerReady).push_back(id);
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        workers.emplace_back(&TaskGraph::WorkerLoop, this);
+    }
+
+    for (;;)
+    {
+        TaskId id = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_mainCondition.wait(lock, [this, workerCount]
+            {
+                if (m_error)
+                {
+                    return (0 == m_running);
+                }
+
+                return ((0 == m_remaining) || !m_mainReady.empty() ||
+                        ((0 == workerCount) && !m_workerReady.empty()));
+            });
+
+            if ((0 == m_remaining) || m_error)
+            {
+                break;
+            }
+
+            std::deque<TaskId>& ready = m_mainReady.empty() ? m_workerReady :
+                                                                m_mainReady;
+            id = ready.front();
+            ready.pop_front();
+            ++m_running;
+        }
+
+        Execute(id);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workerCondition.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    m_end = Now();
+
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+inline void TaskGraph::WorkerLoop()
+{
+    PROFILE_THREAD("task worker");
+
+    for (;;)
+    {
+        TaskId id = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workerCondition.wait(lock, [this]
+            {
+                return (m_stop || (!m_error && !m_workerReady.empty()));
+            });
+
+            if (m_stop)
+            {
+                return;
+            }
+
+            id = m_workerReady.front();
+            m_workerReady.pop_front();
+            ++m_running;
+        }
+
+        Execute(id);
+    }
+}
+
+inline void TaskGraph::Execute(TaskId id)
+{
+    Task& task = m_tasks[id];
+    std::exception_ptr error;
+
+    task.m_begin = Now();
+    try
+    {
+        task.m_function();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    task.m_end = Now();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_running;
+        --m_remaining;
+
+        if (error)
+        {
+            if (!m_error)
+            {
+                m_error = error;
+            }
+        }
+        else if (!m_error)
+        {
+            for (TaskId dependent : task.m_dependents)
+            {
+                Task& next = m_tasks[dependent];
+                if (0 == --next.m_pending)
+                {
+                    ((Affinity::MAIN == next.m_affinity) ? m_mainReady :
+                                            m_workerReady).push_back(dependent);
+                }
+            }
+        }
+    }
+
+    m_mainCondition.notify_one();
+    m_workerCondition.notify_all();
+}
+
+// walks back from the task that finished last through the dependency that
+// released each task, the time between them is spent waiting for a thread
+inline std::vector<TaskGraph::TaskId> TaskGraph::GetCriticalPath() const
+{
+    std::vector<TaskId> path;
+    if (m_tasks.empty())
+    {
+        return path;
+    }
+
+    TaskId last = 0;
+    for (TaskId id = 1; id < m_tasks.size(); ++id)
+    {
+        if (m_tasks[id].m_end > m_tasks[last].m_end)
+        {
+            last = id;
+        }
+    }
+
+    for (;;)
+    {
+        path.push_back(last);
+        const Task& task = m_tasks[last];
+        if (task.m_dependencies.empty())
+        {
+            break;
+        }
+
+        last = task.m_dependencies.front();
+        for (TaskId dependency : task.m_dependencies)
+        {
+            if (m_tasks[dependency].m_end > m_tasks[last].m_end)
+            {
+                last = dependency;
+            }
+        }
+    }
+
+    return std::vector<TaskId>(path.rbegin(), path.rend());
+}
+
+inline void TaskGraph::Report(std::ostream& os) const
+{
+    constexpr double MS = 1000000.0;
+
+    os << "init: " << m_tasks.size() << " tasks in " << GetElapsedMs() <<
+    " ms, critical path " << GetCriticalPathMs() << " ms" << std::endl;
+
+    for (TaskId id : GetCriticalPath())
+    {
+        const Task& task = m_tasks[id];
+        os << "  " << std::setw(24) << task.m_name <<
+        ((Affinity::MAIN == task.m_affinity) ? " main   " : " worker ") <<
+        std::setw(8) << (task.m_begin - m_start) / MS << " +" <<
+        (task.m_end - task.m_begin) / MS << " ms" << std::endl;
+    }
+}
+
+inline double TaskGraph::GetElapsedMs() const
+{
+    return (m_end - m_start) / 1000000.0;
+}
+
+inline double TaskGraph::GetCriticalPathMs() const
+{
+    uint64_t total = 0;
+    for (TaskId id : GetCriticalPath())
+    {
+        total += m_tasks[id].m_end - m_tasks[id].m_begin;
+    }
+
+    return total / 1000000.0;
+}
+
+inline uint64_t TaskGraph::Now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(std::chrono::steady_clock::now().
+                    time_since_epoch()).count());
+}
+
+#endif // TASK_GRAPH_HPP
@@ -0,0 +1,194 @@
+#ifndef TEXTURE_RESIDENCY_HPP
+#define TEXTURE_RESIDENCY_HPP
+
+#include <vulkan/vulkan.h> // VkDeviceSize
+
+#include <vector> // std::vector
+#include <algorithm> // std::min, std::max, std::sort
+#include <cmath> // std::floor
+#include <cstdint> // uint32_t, uint64_t
+
+// Decides which mip levels of every texture stay in memory. Each frame the
+// renderer reports the finest level a visible texture needs on screen. Every
+// Update() the finest resident level moves towards that demand: levels are
+// dropped at once, streamed back one at a time. Textures unused for a while
+// fall back to their tail, and while the chains do not fit the budget the
+// least recently used textures give up their finest levels first. The tail of
+// levels at or below TAIL_SIZE texels is always resident.
+class TextureResidency
+{
+public:
+    static constexpr uint32_t TAIL_SIZE = 64;
+    static constexpr uint64_t IDLE_FRAMES = 120;
+
+    struct Change
+    {
+        uint32_t m_texture;
+        uint32_t m_baseMip;
+    };
+
+    uint32_t AddTexture(uint32_t width, uint32_t height, uint32_t mipLevels,
+                        uint32_t texelBytes);
+    void SetBudget(VkDeviceSize budget);
+    void Request(uint32_t texture, float mip, uint64_t frame);
+    const std::vector<Change>& Update(uint64_t frame);
+
+    uint32_t GetBaseMip(uint32_t texture) const;
+    VkDeviceSize GetResidentBytes() const;
+    VkDeviceSize GetBudget() const;
+    VkDeviceSize GetChainBytes(uint32_t texture, uint32_t baseMip) const;
+
+private:
+    struct Entry
+    {
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_mipLevels;
+        uint32_t m_texelBytes;
+        uint32_t m_tailMip;
+        uint32_t m_baseMip;
+        uint32_t m_demandMip;
+        uint32_t m_targetMip;
+        uint64_t m_lastUse;
+    };
+
+    std::vector<Entry> m_entries;
+    std::vector<Change> m_changes;
+    std::vector<uint32_t> m_order;
+    VkDeviceSize m_budget{0};
+};
+
+inline uint32_t TextureResidency::AddTexture(uint32_t width, uint32_t height,
+                                    uint32_t mipLevels, uint32_t texelBytes)
+{
+    Entry entry{};
+    entry.m_width = width;
+    entry.m_height = height;
+    entry.m_mipLevels = mipLevels;
+    entry.m_texelBytes = texelBytes;
+
+    while ((entry.m_tailMip + 1 < mipLevels) &&
+           (std::max(width, height) >> entry.m_tailMip > TAIL_SIZE))
+    {
+        ++entry.m_tailMip;
+    }
+    entry.m_demandMip = entry.m_tailMip;
+
+    m_entries.push_back(entry);
+
+    return static_cast<uint32_t>(m_entries.size() - 1);
+}
+
+// zero keeps every demanded level resident
+inline void TextureResidency::SetBudget(VkDeviceSize budget)
+{
+    m_budget = budget;
+}
+
+inline void TextureResidency::Request(uint32_t texture, float mip,
+                                        uint64_t frame)
+{
+    Entry& entry = m_entries[texture];
+    uint32_t level = static_cast<uint32_t>(std::max(0.0f, std::floor(mip)));
+    entry.m_demandMip = std::min(entry.m_demandMip, level);
+    entry.m_lastUse = frame;
+}
+
+inline const std::vector<TextureResidency::Change>& TextureResidency::Update(
+                                                                uint64_t frame)
+{
+    m_changes.clear();
+    VkDeviceSize total = 0;
+
+    for (Entry& entry : m_entries)
+    {
+        bool idle = (frame - entry.m_lastUse > IDLE_FRAMES);
+        uint32_t demand = idle ? entry.m_tailMip :
+                        std::min(entry.m_demandMip, entry.m_tailMip);
+
+        // streaming in costs a decode and an upload, one level per update
+        entry.m_targetMip = (demand < entry.m_baseMip) ?
+                            entry.m_baseMip - 1 : demand;
+        entry.m_demandMip = entry.m_tailMip;
+    }
+
+    for (uint32_t i = 0; i < m_entries.size(); ++i)
+    {
+        total += GetChainBytes(i, m_entries[i].m_targetMip);
+    }
+
+    if ((0 != m_budget) && (total > m_budget))
+    {
+        m_order.resize(m_entries.size());
+        for (uint32_t i = 0; i < m_order.size(); ++i)
+        {
+            m_order[i] = i;
+        }
+        std::sort(m_order.begin(), m_order.end(),
+                [this](uint32_t lhs, uint32_t rhs)
+                {
+                    return m_entries[lhs].m_lastUse < m_entries[rhs].m_lastUse;
+                });
+
+        for (uint32_t texture : m_order)
+        {
+            Entry& entry = m_entries[texture];
+            while ((total > m_budget) && (entry.m_targetMip < entry.m_tailMip))
+            {
+                total -= GetChainBytes(texture, entry.m_targetMip) -
+                        GetChainBytes(texture, entry.m_targetMip + 1);
+                ++entry.m_targetMip;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < m_entries.size(); ++i)
+    {
+        Entry& entry = m_entries[i];
+        if (entry.m_targetMip != entry.m_baseMip)
+        {
+            entry.m_baseMip = entry.m_targetMip;
+            m_changes.push_back({i, entry.m_baseMip});
+        }
+    }
+
+    return m_changes;
+}
+
+inline uint32_t TextureResidency::GetBaseMip(uint32_t texture) const
+{
+    return m_entries[texture].m_baseMip;
+}
+
+inline VkDeviceSize TextureResidency::GetResidentBytes() const
+{
+    VkDeviceSize total = 0;
+    for (uint32_t i = 0; i < m_entries.size(); ++i)
+    {
+        total += GetChainBytes(i, m_entries[i].m_baseMip);
+    }
+
+    return total;
+}
+
+inline VkDeviceSize TextureResidency::GetBudget() const
+{
+    return m_budget;
+}
+
+inline VkDeviceSize TextureResidency::GetChainBytes(uint32_t texture,
+                                                    uint32_t baseMip) const
+{
+    const Entry& entry = m_entries[texture];
+    VkDeviceSize bytes = 0;
+    for (uint32_t level = baseMip; level < entry.m_mipLevels; ++level)
+    {
+        VkDeviceSize width = std::max(1u, entry.m_width >> level);
+        VkDeviceSize height = std::max(1u, entry.m_height >> level);
+        bytes += width * height * entry.m_texelBytes;
+    }
+
+    return bytes;
+}
+
+#endif // TEXTURE_RESIDENCY_HPP
@@ -0,0 +1,263 @@
+#ifndef TEXTURE_STREAMER_HPP
+#define TEXTURE_STREAMER_HPP
+
+#include <stb_image.h> // stbi_load
+
+#include <vector> // std::vector
+#include <deque> // std::deque
+#include <string> // std::string
+#include <memory> // std::unique_ptr
+#include <thread> // std::thread
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <algorithm> // std::min, std::max, std::clamp
+#include <array> // std::array
+#include <cmath> // std::pow, std::lround
+#include <iostream> // std::cerr
+#include <utility> // std::move
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint32_t
+
+#include "profiler.hpp" // PROFILE_ZONE, PROFILE_THREAD
+
+// Decodes the mip levels the residency manager streams back in on a thread of
+// its own, so the render thread never waits for a file. Request() queues the
+// levels a texture is missing, the decoder loads the file and filters it
+// down to those levels the way the mip chain was built, in linear space, 2x2
+// texels at a time. Poll() hands back the requests that have finished. A file
+// that fails to load comes back without pixels.
+class TextureStreamer
+{
+public:
+    // RGBA8 sRGB levels from m_baseMip on, finest first and tightly packed
+    struct Levels
+    {
+        uint32_t m_texture{0};
+        uint32_t m_baseMip{0};
+        uint32_t m_levelCount{0};
+        std::vector<uint8_t> m_pixels;
+    };
+
+    void Start();
+    void Stop();
+
+    void Request(uint32_t texture, const std::string& path, uint32_t baseMip,
+                uint32_t levelCount);
+    void Poll(std::vector<Levels>& finished);
+
+private:
+    struct Job
+    {
+        uint32_t m_texture;
+        std::string m_path;
+        uint32_t m_baseMip;
+        uint32_t m_levelCount;
+    };
+
+    // linear values are looked up with 12 bits of precision
+    static constexpr uint32_t LINEAR_STEPS = 4096;
+
+    void DecoderLoop();
+    void Decode(const Job& job, Levels& levels);
+    void Downsample(const uint8_t *source, uint32_t width, uint32_t height,
+                    std::vector<uint8_t>& destination) const;
+    uint8_t ToSrgb(float linear) const;
+
+    // the queues are shared with the decoder thread
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Job> m_jobs;
+    std::vector<Levels> m_finished;
+    bool m_stop{false};
+    std::thread m_decoder;
+
+    // written before the decoder starts, read only afterwards
+    std::array<float, 256> m_toLinear{};
+    std::array<uint8_t, LINEAR_STEPS> m_toSrgb{};
+
+    // only touched by the decoder thread
+    std::array<std::vector<uint8_t>, 2> m_scratch;
+};
+
+inline void TextureStreamer::Start()
+{
+    for (uint32_t i = 0; i < m_toLinear.size(); ++i)
+    {
+        float srgb = static_cast<float>(i) / 255.0f;
+        m_toLinear[i] = (srgb <= 0.04045f) ? srgb / 12.92f :
+                        std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (uint32_t i = 0; i < m_toSrgb.size(); ++i)
+    {
+        float linear = static_cast<float>(i) / (LINEAR_STEPS - 1);
+        float srgb = (linear <= 0.0031308f) ? linear * 12.92f :
+                    1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        m_toSrgb[i] = static_cast<uint8_t>(std::lround(srgb * 255.0f));
+    }
+
+    m_stop = false;
+    m_decoder = std::thread(&TextureStreamer::DecoderLoop, this);
+}
+
+// queued requests are dropped, a decode in progress is finished first
+inline void TextureStreamer::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_jobs.clear();
+    }
+    m_condition.notify_one();
+    m_decoder.join();
+
+    m_finished.clear();
+}
+
+inline void TextureStreamer::Request(uint32_t texture, const std::string& path,
+                                    uint32_t baseMip, uint32_t levelCount)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back({texture, path, baseMip, levelCount});
+    }
+    m_condition.notify_one();
+}
+
+// replaces the contents of finished
+inline void TextureStreamer::Poll(std::vector<Levels>& finished)
+{
+    finished.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    finished.swap(m_finished);
+}
+
+inline void TextureStreamer::DecoderLoop()
+{
+    PROFILE_THREAD("texture streamer");
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]
+            {
+                return (m_stop || !m_jobs.empty());
+            });
+
+            if (m_stop)
+            {
+                break;
+            }
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        Levels levels;
+        Decode(job, levels);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(std::move(levels));
+    }
+}
+
+inline void TextureStreamer::Decode(const Job& job, Levels& levels)
+{
+    PROFILE_ZONE("stream texture");
+    levels.m_texture = job.m_texture;
+    levels.m_baseMip = job.m_baseMip;
+    levels.m_levelCount = job.m_levelCount;
+
+    int texWidth = 0, texHeight = 0, texChannels = 0;
+    std::unique_ptr<stbi_uc, void (*)(void*)> pixels(
+                            stbi_load(job.m_path.c_str(), &texWidth,
+                            &texHeight, &texChannels, STBI_rgb_alpha),
+                            &stbi_image_free);
+    if (nullptr == pixels)
+    {
+        std::cerr << "texture streamer: failed to load " << job.m_path <<
+        std::endl;
+        return;
+    }
+
+    // level 0 is read in place, every coarser level from the one before
+    const uint8_t *source = pixels.get();
+    uint32_t width = static_cast<uint32_t>(texWidth);
+    uint32_t height = static_cast<uint32_t>(texHeight);
+    uint32_t end = job.m_baseMip + job.m_levelCount;
+    for (uint32_t level = 0; level < end; ++level)
+    {
+        if (level >= job.m_baseMip)
+        {
+            levels.m_pixels.insert(levels.m_pixels.end(), source,
+                        source + static_cast<std::size_t>(width) * height * 4);
+        }
+
+        if (level + 1 < end)
+        {
+            std::vector<uint8_t>& destination = m_scratch[level % 2];
+            Downsample(source, width, height, destination);
+            source = destination.data();
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+    }
+}
+
+// odd edges repeat their last texel, alpha is averaged as is
+inline void TextureStreamer::Downsample(const uint8_t *source, uint32_t width,
+                                        uint32_t height,
+                                        std::vector<uint8_t>& destination) const
+{
+    uint32_t halfWidth = std::max(1u, width / 2);
+    uint32_t halfHeight = std::max(1u, height / 2);
+    destination.resize(static_cast<std::size_t>(halfWidth) * halfHeight * 4);
+
+    for (uint32_t y = 0; y < halfHeight; ++y)
+    {
+        const uint8_t *rows[2] =
+        {
+            source + static_cast<std::size_t>(std::min(2 * y, height - 1)) *
+                                                                    width * 4,
+            source + static_cast<std::size_t>(std::min(2 * y + 1, height - 1)) *
+                                                                    width * 4
+        };
+
+        for (uint32_t x = 0; x < halfWidth; ++x)
+        {
+            uint32_t columns[2] = {std::min(2 * x, width - 1) * 4,
+                                    std::min(2 * x + 1, width - 1) * 4};
+            uint8_t *texel = &destination[
+                            (static_cast<std::size_t>(y) * halfWidth + x) * 4];
+
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                float sum = 0.0f;
+                for (const uint8_t *row : rows)
+                {
+                    for (uint32_t column : columns)
+                    {
+                        uint8_t value = row[column + channel];
+                        sum += (3 == channel) ? value : m_toLinear[value];
+                    }
+                }
+
+                texel[channel] = (3 == channel) ?
+                        static_cast<uint8_t>(std::lround(sum * 0.25f)) :
+                        ToSrgb(sum * 0.25f);
+            }
+        }
+    }
+}
+
+inline uint8_t TextureStreamer::ToSrgb(float linear) const
+{
+    float step = std::clamp(linear, 0.0f, 1.0f) * (LINEAR_STEPS - 1);
+
+    return m_toSrgb[static_cast<uint32_t>(std::lround(step))];
+}
+
+#endif // TEXTURE_STREAMER_HPP
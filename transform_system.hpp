@@ -0,0 +1,493 @@
+#ifndef TRANSFORM_SYSTEM_HPP
+#define TRANSFORM_SYSTEM_HPP
+
+#include <glm/glm.hpp> // linear algebra
+#include <glm/gtc/quaternion.hpp> // glm::quat
+#include <glm/gtc/matrix_transform.hpp> // glm::translate, glm::scale
+
+#include <vector> // std::vector
+#include <new> // std::align_val_t
+#include <cstddef> // std::size_t
+#include <cstdint> // uint32_t
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE, AVX2, FMA
+#define TRANSFORM_X86
+#endif
+
+// Object transforms stored as structure of arrays: every component of the
+// positions, rotation quaternions and scales lives in its own aligned array,
+// so the SIMD kernels load one component of 4 or 8 objects per instruction.
+// Compose() builds local to world and model-view-projection matrices for a
+// range of objects and stores them object by object, in the layout the
+// shaders read, straight into the caller's memory: object first goes to
+// destination[0]. Every object is written as one sequential 128 byte run,
+// which suits write-combined mapped memory.
+class TransformSystem
+{
+public:
+    enum class Isa
+    {
+        SCALAR,
+        SSE,
+        AVX2
+    };
+
+    // matches the std140 Instance in shader.vert
+    struct Instance
+    {
+        glm::mat4 m_world;
+        glm::mat4 m_modelViewProj;
+    };
+
+    uint32_t Add(const glm::vec3& position, const glm::quat& rotation,
+                const glm::vec3& scale);
+    void Clear();
+    void Reserve(uint32_t capacity);
+
+    void SetPosition(uint32_t object, const glm::vec3& position);
+    void SetRotation(uint32_t object, const glm::quat& rotation);
+    void SetScale(uint32_t object, const glm::vec3& scale);
+    uint32_t GetCount() const;
+
+    void Compose(const glm::mat4& viewProj, Instance *destination,
+                uint32_t first, uint32_t count) const;
+
+    void SetIsa(Isa isa);
+    Isa GetIsa() const;
+    static Isa DetectIsa();
+    static const char *GetIsaName(Isa isa);
+
+private:
+    static constexpr std::size_t ALIGNMENT = 32;
+
+    template <typename T>
+    struct AlignedAllocator
+    {
+        using value_type = T;
+
+        AlignedAllocator() = default;
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U>&) {}
+
+        T *allocate(std::size_t count)
+        {
+            return static_cast<T*>(::operator new(count * sizeof(T),
+                                        std::align_val_t{ALIGNMENT}));
+        }
+
+        void deallocate(T *pointer, std::size_t)
+        {
+            ::operator delete(pointer, std::align_val_t{ALIGNMENT});
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U>&) const { return true; }
+        template <typename U>
+        bool operator!=(const AlignedAllocator<U>&) const { return false; }
+    };
+
+    using Array = std::vector<float, AlignedAllocator<float>>;
+
+    void ComposeScalar(const glm::mat4& viewProj, Instance *destination,
+                        uint32_t first, uint32_t last) const;
+#ifdef TRANSFORM_X86
+    void ComposeSse(const glm::mat4& viewProj, Instance *destination,
+                    uint32_t first, uint32_t last) const;
+    void ComposeAvx2(const glm::mat4& viewProj, Instance *destination,
+                    uint32_t first, uint32_t last) const;
+    static void Transpose(__m256 rows[4]);
+#endif
+
+    Array m_positionX;
+    Array m_positionY;
+    Array m_positionZ;
+    Array m_rotationX;
+    Array m_rotationY;
+    Array m_rotationZ;
+    Array m_rotationW;
+    Array m_scaleX;
+    Array m_scaleY;
+    Array m_scaleZ;
+    Isa m_isa{DetectIsa()};
+};
+
+inline uint32_t TransformSystem::Add(const glm::vec3& position,
+                        const glm::quat& rotation, const glm::vec3& scale)
+{
+    uint32_t object = GetCount();
+
+    m_positionX.push_back(position.x);
+    m_positionY.push_back(position.y);
+    m_positionZ.push_back(position.z);
+    m_rotationX.push_back(rotation.x);
+    m_rotationY.push_back(rotation.y);
+    m_rotationZ.push_back(rotation.z);
+    m_rotationW.push_back(rotation.w);
+    m_scaleX.push_back(scale.x);
+    m_scaleY.push_back(scale.y);
+    m_scaleZ.push_back(scale.z);
+
+    return object;
+}
+
+inline void TransformSystem::Clear()
+{
+    for (Array *array : {&m_positionX, &m_positionY, &m_positionZ,
+                        &m_rotationX, &m_rotationY, &m_rotationZ, &m_rotationW,
+                        &m_scaleX, &m_scaleY, &m_scaleZ})
+    {
+        array->clear();
+    }
+}
+
+inline void TransformSystem::Reserve(uint32_t capacity)
+{
+    for (Array *array : {&m_positionX, &m_positionY, &m_positionZ,
+                        &m_rotationX, &m_rotationY, &m_rotationZ, &m_rotationW,
+                        &m_scaleX, &m_scaleY, &m_scaleZ})
+    {
+        array->reserve(capacity);
+    }
+}
+
+inline void TransformSystem::SetPosition(uint32_t object,
+                                        const glm::vec3& position)
+{
+    m_positionX[object] = position.x;
+    m_positionY[object] = position.y;
+    m_positionZ[object] = position.z;
+}
+
+inline void TransformSystem::SetRotation(uint32_t object,
+                                        const glm::quat& rotation)
+{
+    m_rotationX[object] = rotation.x;
+    m_rotationY[object] = rotation.y;
+    m_rotationZ[object] = rotation.z;
+    m_rotationW[object] = rotation.w;
+}
+
+inline void TransformSystem::SetScale(uint32_t object, const glm::vec3& scale)
+{
+    m_scaleX[object] = scale.x;
+    m_scaleY[object] = scale.y;
+    m_scaleZ[object] = scale.z;
+}
+
+inline uint32_t TransformSystem::GetCount() const
+{
+    return static_cast<uint32_t>(m_positionX.size());
+}
+
+// the kernels take whole batches, the objects left over go through the
+// scalar path; every kernel writes object first of its range to
+// destination[0]
+inline void TransformSystem::Compose(const glm::mat4& viewProj,
+            Instance *destination, uint32_t first, uint32_t count) const
+{
+    uint32_t last = first + count;
+
+#ifdef TRANSFORM_X86
+    if (Isa::AVX2 == m_isa)
+    {
+        uint32_t end = first + count / 8 * 8;
+        ComposeAvx2(viewProj, destination, first, end);
+        destination += end - first;
+        first = end;
+    }
+    else if (Isa::SSE == m_isa)
+    {
+        uint32_t end = first + count / 4 * 4;
+        ComposeSse(viewProj, destination, first, end);
+        destination += end - first;
+        first = end;
+    }
+#endif
+
+    ComposeScalar(viewProj, destination, first, last);
+}
+
+inline void TransformSystem::SetIsa(Isa isa)
+{
+    m_isa = isa;
+}
+
+inline TransformSystem::Isa TransformSystem::GetIsa() const
+{
+    return m_isa;
+}
+
+inline TransformSystem::Isa TransformSystem::DetectIsa()
+{
+#ifdef TRANSFORM_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return Isa::AVX2;
+    }
+
+    return Isa::SSE;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+inline const char *TransformSystem::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::SSE:
+        return "sse";
+    default:
+        return "scalar";
+    }
+}
+
+// one object at a time through glm, the reference for the kernels
+inline void TransformSystem::ComposeScalar(const glm::mat4& viewProj,
+            Instance *destination, uint32_t first, uint32_t last) const
+{
+    for (uint32_t i = first; i < last; ++i)
+    {
+        glm::quat rotation(m_rotationW[i], m_rotationX[i], m_rotationY[i],
+                            m_rotationZ[i]);
+        glm::mat4 world = glm::translate(glm::mat4(1.0f),
+                    glm::vec3(m_positionX[i], m_positionY[i], m_positionZ[i]));
+        world = world * glm::mat4_cast(rotation);
+        world = glm::scale(world,
+                        glm::vec3(m_scaleX[i], m_scaleY[i], m_scaleZ[i]));
+
+        destination[i - first].m_world = world;
+        destination[i - first].m_modelViewProj = viewProj * world;
+    }
+}
+
+#ifdef TRANSFORM_X86
+// Every register holds one matrix element of 4 objects. The world matrix is
+// the rotation with its columns scaled and the position as the last column,
+// the projection multiplies the 3 rotation columns and adds its own fourth
+// column for the position. A 4x4 transpose turns the elements of a matrix
+// column into one column per object for the store.
+inline void TransformSystem::ComposeSse(const glm::mat4& viewProj,
+            Instance *destination, uint32_t first, uint32_t last) const
+{
+    __m128 vp[4][4];
+    for (uint32_t column = 0; column < 4; ++column)
+    {
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            vp[column][row] = _mm_set1_ps(viewProj[column][row]);
+        }
+    }
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t i = first; i < last; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&m_rotationX[i]);
+        __m128 y = _mm_loadu_ps(&m_rotationY[i]);
+        __m128 z = _mm_loadu_ps(&m_rotationZ[i]);
+        __m128 w = _mm_loadu_ps(&m_rotationW[i]);
+        __m128 sx = _mm_loadu_ps(&m_scaleX[i]);
+        __m128 sy = _mm_loadu_ps(&m_scaleY[i]);
+        __m128 sz = _mm_loadu_ps(&m_scaleZ[i]);
+
+        __m128 xx = _mm_mul_ps(x, x);
+        __m128 yy = _mm_mul_ps(y, y);
+        __m128 zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y);
+        __m128 xz = _mm_mul_ps(x, z);
+        __m128 yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x);
+        __m128 wy = _mm_mul_ps(w, y);
+        __m128 wz = _mm_mul_ps(w, z);
+
+        // world[column][row], row 3 of the first 3 columns is zero
+        __m128 world[4][4];
+        world[0][0] = _mm_mul_ps(_mm_sub_ps(one,
+                        _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        world[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        world[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        world[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        world[1][1] = _mm_mul_ps(_mm_sub_ps(one,
+                        _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        world[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        world[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        world[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        world[2][2] = _mm_mul_ps(_mm_sub_ps(one,
+                        _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        world[3][0] = _mm_loadu_ps(&m_positionX[i]);
+        world[3][1] = _mm_loadu_ps(&m_positionY[i]);
+        world[3][2] = _mm_loadu_ps(&m_positionZ[i]);
+        world[0][3] = zero;
+        world[1][3] = zero;
+        world[2][3] = zero;
+        world[3][3] = one;
+
+        __m128 mvp[4][4];
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                __m128 sum = _mm_add_ps(
+                        _mm_mul_ps(vp[0][row], world[column][0]),
+                        _mm_mul_ps(vp[1][row], world[column][1]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(vp[2][row], world[column][2]));
+                mvp[column][row] = (3 == column) ?
+                                    _mm_add_ps(sum, vp[3][row]) : sum;
+            }
+        }
+
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            _MM_TRANSPOSE4_PS(world[column][0], world[column][1],
+                            world[column][2], world[column][3]);
+            _MM_TRANSPOSE4_PS(mvp[column][0], mvp[column][1],
+                            mvp[column][2], mvp[column][3]);
+        }
+
+        for (uint32_t object = 0; object < 4; ++object)
+        {
+            Instance& instance = destination[i - first + object];
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                _mm_storeu_ps(&instance.m_world[column][0],
+                            world[column][object]);
+            }
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                _mm_storeu_ps(&instance.m_modelViewProj[column][0],
+                            mvp[column][object]);
+            }
+        }
+    }
+}
+
+// same as ComposeSse for 8 objects
+__attribute__((target("avx2,fma")))
+inline void TransformSystem::ComposeAvx2(const glm::mat4& viewProj,
+            Instance *destination, uint32_t first, uint32_t last) const
+{
+    __m256 vp[4][4];
+    for (uint32_t column = 0; column < 4; ++column)
+    {
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            vp[column][row] = _mm256_set1_ps(viewProj[column][row]);
+        }
+    }
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (uint32_t i = first; i < last; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&m_rotationX[i]);
+        __m256 y = _mm256_loadu_ps(&m_rotationY[i]);
+        __m256 z = _mm256_loadu_ps(&m_rotationZ[i]);
+        __m256 w = _mm256_loadu_ps(&m_rotationW[i]);
+        __m256 sx = _mm256_loadu_ps(&m_scaleX[i]);
+        __m256 sy = _mm256_loadu_ps(&m_scaleY[i]);
+        __m256 sz = _mm256_loadu_ps(&m_scaleZ[i]);
+
+        __m256 xx = _mm256_mul_ps(x, x);
+        __m256 yy = _mm256_mul_ps(y, y);
+        __m256 zz = _mm256_mul_ps(z, z);
+        __m256 xy = _mm256_mul_ps(x, y);
+        __m256 xz = _mm256_mul_ps(x, z);
+        __m256 yz = _mm256_mul_ps(y, z);
+        __m256 wx = _mm256_mul_ps(w, x);
+        __m256 wy = _mm256_mul_ps(w, y);
+        __m256 wz = _mm256_mul_ps(w, z);
+
+        __m256 world[4][4];
+        world[0][0] = _mm256_mul_ps(_mm256_fnmadd_ps(two,
+                        _mm256_add_ps(yy, zz), one), sx);
+        world[0][1] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_add_ps(xy, wz)), sx);
+        world[0][2] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_sub_ps(xz, wy)), sx);
+        world[1][0] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_sub_ps(xy, wz)), sy);
+        world[1][1] = _mm256_mul_ps(_mm256_fnmadd_ps(two,
+                        _mm256_add_ps(xx, zz), one), sy);
+        world[1][2] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_add_ps(yz, wx)), sy);
+        world[2][0] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_add_ps(xz, wy)), sz);
+        world[2][1] = _mm256_mul_ps(_mm256_mul_ps(two,
+                        _mm256_sub_ps(yz, wx)), sz);
+        world[2][2] = _mm256_mul_ps(_mm256_fnmadd_ps(two,
+                        _mm256_add_ps(xx, yy), one), sz);
+        world[3][0] = _mm256_loadu_ps(&m_positionX[i]);
+        world[3][1] = _mm256_loadu_ps(&m_positionY[i]);
+        world[3][2] = _mm256_loadu_ps(&m_positionZ[i]);
+        world[0][3] = zero;
+        world[1][3] = zero;
+        world[2][3] = zero;
+        world[3][3] = one;
+
+        __m256 mvp[4][4];
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                __m256 sum = (3 == column) ? vp[3][row] : zero;
+                sum = _mm256_fmadd_ps(vp[0][row], world[column][0], sum);
+                sum = _mm256_fmadd_ps(vp[1][row], world[column][1], sum);
+                mvp[column][row] = _mm256_fmadd_ps(vp[2][row],
+                                                world[column][2], sum);
+            }
+        }
+
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            Transpose(world[column]);
+            Transpose(mvp[column]);
+        }
+
+        for (uint32_t object = 0; object < 8; ++object)
+        {
+            Instance& instance = destination[i - first + object];
+            uint32_t lane = object % 4;
+            bool high = (4 <= object);
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                __m256 value = world[column][lane];
+                _mm_storeu_ps(&instance.m_world[column][0], high ?
+                            _mm256_extractf128_ps(value, 1) :
+                            _mm256_castps256_ps128(value));
+            }
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                __m256 value = mvp[column][lane];
+                _mm_storeu_ps(&instance.m_modelViewProj[column][0], high ?
+                            _mm256_extractf128_ps(value, 1) :
+                            _mm256_castps256_ps128(value));
+            }
+        }
+    }
+}
+
+// rows hold one element of 8 objects, afterwards element i of the low half
+// is the column of object i and of the high half the column of object i + 4
+__attribute__((target("avx2")))
+inline void TransformSystem::Transpose(__m256 rows[4])
+{
+    __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    rows[0] = _mm256_shuffle_ps(t0, t2, 0x44);
+    rows[1] = _mm256_shuffle_ps(t0, t2, 0xEE);
+    rows[2] = _mm256_shuffle_ps(t1, t3, 0x44);
+    rows[3] = _mm256_shuffle_ps(t1, t3, 0xEE);
+}
+#endif
+
+#endif // TRANSFORM_SYSTEM_HPP
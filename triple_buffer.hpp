@@ -0,0 +1,72 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <array> // std::array
+#include <atomic> // std::atomic
+#include <cstdint> // uint8_t
+
+// Hands the latest value from one producer thread to one consumer thread
+// without locks or waiting. The producer fills the back slot and swaps it with
+// the middle one, the consumer swaps the middle slot with its front slot only
+// when a new value was published. Neither side ever touches the slot the other
+// one owns, a value the consumer did not pick up in time is overwritten.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer side
+    T& GetBack();
+    void Publish();
+
+    // consumer side, returns false when nothing new was published since the
+    // last call and the front value is unchanged
+    bool Update();
+    const T& GetFront() const;
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    std::array<T, 3> m_slots{};
+    // every index on its own cache line, the sides never share one
+    alignas(64) std::atomic<uint8_t> m_middle{1};
+    alignas(64) uint8_t m_back{0};
+    alignas(64) uint8_t m_front{2};
+};
+
+template <typename T>
+inline T& TripleBuffer<T>::GetBack()
+{
+    return m_slots[m_back];
+}
+
+// release makes the slot contents visible to the consumer that acquires it
+template <typename T>
+inline void TripleBuffer<T>::Publish()
+{
+    uint8_t previous = m_middle.exchange(m_back | FRESH_BIT,
+                                        std::memory_order_acq_rel);
+    m_back = previous & INDEX_MASK;
+}
+
+template <typename T>
+inline bool TripleBuffer<T>::Update()
+{
+    if (0 == (m_middle.load(std::memory_order_relaxed) & FRESH_BIT))
+    {
+        return false;
+    }
+
+    uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+    m_front = previous & INDEX_MASK;
+
+    return true;
+}
+
+template <typename T>
+inline const T& TripleBuffer<T>::GetFront() const
+{
+    return m_slots[m_front];
+}
+
+#endif // TRIPLE_BUFFER_HPP
@@ -0,0 +1,186 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <vector> // std::vector
+#include <functional> // std::function
+#include <thread> // std::thread
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <utility> // std::move
+#include <cstdint> // uint32_t, uint64_t
+
+#include "profiler.hpp" // PROFILE_THREAD
+
+// Persistent threads that run one task at a time, every worker calls
+// task(worker) with its own index. Start() hands the task over and returns,
+// Wait() blocks until every worker is done with it. Dispatch() does both and
+// runs the task on the calling thread as well, as the worker after the last
+// one. ArriveAndWait() is a barrier for the threads running one task.
+// The workers sleep between tasks, a task is started by bumping a generation
+// the workers compare against the last one they ran.
+class WorkerPool
+{
+public:
+    using Task = std::function<void(uint32_t worker)>;
+
+    ~WorkerPool();
+
+    void Create(uint32_t workerCount, const char *name);
+    void Destroy();
+
+    void Start(Task task);
+    void Wait();
+    void Dispatch(const Task& task);
+    void ArriveAndWait(uint32_t threadCount);
+
+    uint32_t GetWorkerCount() const;
+
+private:
+    void WorkerLoop(uint32_t worker);
+
+    std::vector<std::thread> m_workers;
+    const char *m_name{nullptr};
+    std::mutex m_mutex;
+    std::condition_variable m_startCondition;
+    std::condition_variable m_doneCondition;
+    std::condition_variable m_barrierCondition;
+    Task m_task;
+    uint64_t m_generation{0};
+    uint32_t m_finished{0};
+    uint32_t m_barrierCount{0};
+    uint64_t m_barrierPhase{0};
+    bool m_stop{false};
+};
+
+inline WorkerPool::~WorkerPool()
+{
+    Destroy();
+}
+
+// the name labels the worker threads in the profiler
+inline void WorkerPool::Create(uint32_t workerCount, const char *name)
+{
+    m_name = name;
+    m_stop = false;
+    m_generation = 0;
+    m_finished = 0;
+    m_barrierCount = 0;
+
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_workers.emplace_back(&WorkerPool::WorkerLoop, this, i);
+    }
+}
+
+inline void WorkerPool::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_startCondition.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+// the previous task must have been waited for
+inline void WorkerPool::Start(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = std::move(task);
+        m_finished = 0;
+        ++m_generation;
+    }
+    m_startCondition.notify_all();
+}
+
+inline void WorkerPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this]
+    {
+        return (m_workers.size() == m_finished);
+    });
+}
+
+// without workers the task runs on the calling thread alone, as worker 0
+inline void WorkerPool::Dispatch(const Task& task)
+{
+    if (m_workers.empty())
+    {
+        task(0);
+        return;
+    }
+
+    Start(task);
+    task(static_cast<uint32_t>(m_workers.size()));
+    Wait();
+}
+
+inline void WorkerPool::ArriveAndWait(uint32_t threadCount)
+{
+    if (1 == threadCount)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t phase = m_barrierPhase;
+    if (threadCount == ++m_barrierCount)
+    {
+        m_barrierCount = 0;
+        ++m_barrierPhase;
+        m_barrierCondition.notify_all();
+        return;
+    }
+
+    m_barrierCondition.wait(lock, [this, phase]
+    {
+        return (phase != m_barrierPhase);
+    });
+}
+
+inline uint32_t WorkerPool::GetWorkerCount() const
+{
+    return static_cast<uint32_t>(m_workers.size());
+}
+
+// the task is only replaced by Start() once every worker finished it, so it
+// is run without holding the lock
+inline void WorkerPool::WorkerLoop(uint32_t worker)
+{
+    PROFILE_THREAD(m_name);
+    uint64_t seen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCondition.wait(lock, [this, seen]
+            {
+                return (m_stop || (seen != m_generation));
+            });
+
+            if (m_stop)
+            {
+                return;
+            }
+            seen = m_generation;
+        }
+
+        m_task(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_finished;
+        }
+        m_doneCondition.notify_one();
+    }
+}
+
+#endif // WORKER_POOL_HPP